@@ -1,11 +1,37 @@
 #include <BotOp/bot.h>
 #include <BotOp/motionHelpers.h>
+#include <BotOp/SecMPC_Stepper.h>
+#include <Utils/dataLogger.h>
 
 //===========================================================================
 
 int main(int argc, char * argv[]){
   rai::initCmdLine(argc, argv);
 
+  //-- convert a binary control data log (z.panda0.log) into the text columns the plt scripts expect (z.panda0.dat)
+  if(rai::checkParameter<rai::String>("convertLog")){
+    rai::String filename = rai::getParameter<rai::String>("convertLog");
+    StringA names;
+    uintA dims;
+    arr data;
+    rai::readDataLog(filename, names, dims, data);
+    std::string outname = filename.p;
+    if(outname.size()>4 && outname.substr(outname.size()-4)==".log") outname.resize(outname.size()-4);
+    outname += ".dat";
+    ofstream fil(outname);
+    for(uint t=0;t<data.d0;t++){ data[t].modRaw().write(fil); fil <<endl; }
+    LOG(0) <<"converted " <<data.d0 <<" records with fields " <<names <<" (dims " <<dims <<") into '" <<outname <<"'";
+    return 0;
+  }
+
+  //-- replay a SecMPC log (z.SecMPC.log) -- -playLogConfig: the scenario it was recorded in, -playLogSpeed: x realtime
+  if(rai::checkParameter<rai::String>("playLog")){
+    playLog(rai::getParameter<rai::String>("playLog"),
+            rai::getParameter<rai::String>("playLogConfig", "pushScenario.g"),
+            rai::getParameter<double>("playLogSpeed", 1.));
+    return 0;
+  }
+
   //-- setup a configuration
   rai::Configuration C;
 
@@ -0,0 +1,153 @@
+#include "SecMPC_Log.h"
+
+#include <Kin/frame.h>
+
+namespace {
+
+const char mpcLog_magic[8] = "RAIMPC1";
+const char mpcLog_indexTrailer[8] = "RAIMPCX";
+const uint64_t mpcLog_frameMagic = 0x454d5246; //'FRME'
+const uint64_t mpcLog_indexMagic = 0x58444e49; //'INDX'
+
+void writeU64(std::ofstream& fil, uint64_t x){ fil.write((char*)&x, 8); }
+uint64_t readU64(std::ifstream& fil){ uint64_t x=0; fil.read((char*)&x, 8); return x; }
+
+void writeArray(std::ofstream& fil, const arr& x){ //d1=0 for vectors
+  uint64_t d0 = x.nd>1 ? x.d0 : x.N, d1 = x.nd>1 && x.d0 ? x.N/x.d0 : 0;
+  writeU64(fil, d0);
+  writeU64(fil, d1);
+  if(x.N) fil.write((char*)x.p, x.N*sizeof(double));
+}
+
+void readArray(std::ifstream& fil, arr& x){
+  uint64_t d0 = readU64(fil), d1 = readU64(fil);
+  if(!d1) x.resize(d0); else x.resize(d0, d1);
+  fil.read((char*)x.p, x.N*sizeof(double));
+}
+
+uint64_t arrayBytes(const arr& x){ return 16 + x.N*sizeof(double); }
+
+} //namespace
+
+//===========================================================================
+
+void SecMPC_LogWriter::write(const SecMPC_LogFrame& f, const FrameL& poseFrames){
+  if(!fil.is_open()){
+    fil.open(filename, std::ios::binary);
+    CHECK(fil.good(), "could not open '" <<filename <<"'");
+    uint64_t headerBytes = 24 + 24*poseFrames.N;
+    fil.write(mpcLog_magic, 8);
+    writeU64(fil, headerBytes);
+    writeU64(fil, poseFrames.N);
+    for(rai::Frame* p:poseFrames){
+      char name[24];
+      memset(name, 0, 24);
+      strncpy(name, p->name.p, 23);
+      fil.write(name, 24);
+    }
+    offsets.clear();
+  }
+
+  uint64_t frameBytes = 40 + arrayBytes(f.q_real) + arrayBytes(f.waypoints) + arrayBytes(f.tau) + arrayBytes(f.shortPath) + arrayBytes(f.poses);
+  offsets.push_back(fil.tellp());
+  writeU64(fil, mpcLog_frameMagic);
+  writeU64(fil, frameBytes);
+  writeU64(fil, f.stepCount);
+  fil.write((char*)&f.ctrlTime, 8);
+  writeU64(fil, f.phase);
+  writeArray(fil, f.q_real);
+  writeArray(fil, f.waypoints);
+  writeArray(fil, f.tau);
+  writeArray(fil, f.shortPath);
+  writeArray(fil, f.poses);
+}
+
+void SecMPC_LogWriter::close(){
+  if(!fil.is_open()) return;
+  uint64_t indexOffset = fil.tellp();
+  writeU64(fil, mpcLog_indexMagic);
+  writeU64(fil, offsets.size());
+  fil.write((char*)offsets.data(), offsets.size()*8);
+  writeU64(fil, indexOffset);
+  fil.write(mpcLog_indexTrailer, 8);
+  fil.close();
+}
+
+//===========================================================================
+
+SecMPC_LogReader::SecMPC_LogReader(const char* _filename) : filename(_filename) {
+  fil.open(filename, std::ios::binary);
+  CHECK(fil.good(), "could not open '" <<filename <<"'");
+  char magic[8];
+  fil.read(magic, 8);
+  CHECK(!memcmp(magic, mpcLog_magic, 8), "'" <<filename <<"' is not a binary SecMPC log");
+  uint64_t headerBytes = readU64(fil);
+  uint64_t nPoses = readU64(fil);
+  poseFrames.resize(nPoses);
+  for(uint k=0;k<nPoses;k++){
+    char name[25];
+    fil.read(name, 24);
+    name[24]=0;
+    poseFrames(k) = name;
+  }
+  if(!readIndex()){
+    LOG(0) <<"'" <<filename <<"' has no index (not closed properly?) -- scanning frames";
+    scanFrames(headerBytes);
+  }
+}
+
+bool SecMPC_LogReader::readIndex(){
+  fil.clear();
+  fil.seekg(-16, std::ios::end);
+  uint64_t indexOffset = readU64(fil);
+  char trailer[8];
+  fil.read(trailer, 8);
+  if(!fil.good() || memcmp(trailer, mpcLog_indexTrailer, 8)) return false;
+  fil.seekg(indexOffset);
+  if(readU64(fil)!=mpcLog_indexMagic) return false;
+  uint64_t n = readU64(fil);
+  offsets.resize(n);
+  fil.read((char*)offsets.data(), n*8);
+  return fil.good();
+}
+
+void SecMPC_LogReader::scanFrames(uint64_t headerBytes){
+  fil.clear();
+  fil.seekg(0, std::ios::end);
+  uint64_t fileBytes = fil.tellg();
+  offsets.clear();
+  for(uint64_t offset=headerBytes; offset+16<=fileBytes;){
+    fil.seekg(offset);
+    uint64_t frameMagic = readU64(fil), frameBytes = readU64(fil);
+    if(!fil.good() || frameMagic!=mpcLog_frameMagic || offset+frameBytes>fileBytes) break; //index or incomplete last frame
+    offsets.push_back(offset);
+    offset += frameBytes;
+  }
+  fil.clear();
+}
+
+void SecMPC_LogReader::read(SecMPC_LogFrame& f, uint k){
+  CHECK_LE(k+1, offsets.size(), "cycle " <<k <<" out of range (log has " <<offsets.size() <<" cycles)");
+  fil.clear();
+  fil.seekg(offsets[k]);
+  CHECK_EQ(readU64(fil), mpcLog_frameMagic, "corrupt frame " <<k <<" in '" <<filename <<"'");
+  readU64(fil); //frameBytes
+  f.stepCount = readU64(fil);
+  fil.read((char*)&f.ctrlTime, 8);
+  f.phase = readU64(fil);
+  readArray(fil, f.q_real);
+  readArray(fil, f.waypoints);
+  readArray(fil, f.tau);
+  readArray(fil, f.shortPath);
+  readArray(fil, f.poses);
+  CHECK(fil.good(), "could not read frame " <<k <<" of '" <<filename <<"'");
+}
+
+double SecMPC_LogReader::ctrlTime(uint k){
+  CHECK_LE(k+1, offsets.size(), "cycle " <<k <<" out of range (log has " <<offsets.size() <<" cycles)");
+  fil.clear();
+  fil.seekg(offsets[k]+24);
+  double t=0.;
+  fil.read((char*)&t, 8);
+  return t;
+}
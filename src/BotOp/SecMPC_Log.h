@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Kin/kin.h>
+
+#include <fstream>
+
+//===========================================================================
+//
+// binary SecMPC log with a frame index -- any cycle can be loaded in O(1)
+//
+// file layout (little endian, 8-byte aligned):
+//   header:  char magic[8]="RAIMPC1", uint64 headerBytes, uint64 nPoses, nPoses x char name[24] (the logged pose frames)
+//   frames:  uint64 frameMagic='FRME', uint64 frameBytes, uint64 stepCount, double ctrlTime, uint64 phase,
+//            5 x { uint64 d0, uint64 d1, d0*max(d1,1) doubles } for q_real, waypoints, tau, shortPath, poses (d1=0: vector)
+//   index:   uint64 indexMagic='INDX', uint64 nFrames, nFrames x uint64 offset,
+//            trailer: uint64 indexOffset, char magic[8]="RAIMPCX"
+// the index is written on close; without it (e.g. after a crash) the reader rebuilds it by skipping from frame to frame
+//
+
+/// one logged MPC cycle
+struct SecMPC_LogFrame {
+  uint stepCount=0;
+  double ctrlTime=0.;
+  uint phase=0;
+  arr q_real, waypoints, tau, shortPath, poses;
+};
+
+struct SecMPC_LogWriter {
+  rai::String filename;
+
+  SecMPC_LogWriter(const char* _filename) : filename(_filename) {}
+  ~SecMPC_LogWriter(){ close(); }
+
+  /// append a cycle -- the file (and the header, with the names of poseFrames) is created on the first call
+  void write(const SecMPC_LogFrame& f, const FrameL& poseFrames);
+  /// write the index -- called by the destructor
+  void close();
+
+  uint size() const{ return offsets.size(); }
+
+private:
+  std::ofstream fil;
+  std::vector<uint64_t> offsets;
+};
+
+struct SecMPC_LogReader {
+  rai::String filename;
+  StringA poseFrames; ///< names of the frames in SecMPC_LogFrame::poses
+
+  SecMPC_LogReader(const char* _filename);
+
+  uint size() const{ return offsets.size(); }
+  /// load cycle k (0 <= k < size())
+  void read(SecMPC_LogFrame& f, uint k);
+  /// only the ctrlTime of cycle k
+  double ctrlTime(uint k);
+
+private:
+  std::ifstream fil;
+  std::vector<uint64_t> offsets;
+  bool readIndex();
+  void scanFrames(uint64_t headerBytes);
+};
+
+//===========================================================================
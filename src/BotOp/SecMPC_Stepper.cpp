@@ -1,8 +1,5 @@
 #include "SecMPC_Stepper.h"
 
-#include <GL/glew.h>
-#include <GL/glut.h>
-
 #include <OptiTrack/optitrack.h>
 #include <Gui/opengl.h>
 #include <Kin/viewer.h>
@@ -28,13 +25,17 @@ bool SecMPC_Stepper::step(rai::Configuration& C, BotOp& bot, SecMPC& mpc, bool d
   mpc.report(C);
   if(mpc.phaseSwitch) bot.sound(7 * mpc.timingMPC.phase);
 
-  if(fil.is_open()){
-    fil <<stepCount <<' ' <<ctrlTime <<' ' <<mpc.timingMPC.phase <<endl;
-    q.writeTagged(fil, "q_real", true);
-    mpc.waypointMPC.path.writeTagged(fil, "waypoints", true);
-    mpc.timingMPC.tau.writeTagged(fil, "tau", true);
-    mpc.shortMPC.path.writeTagged(fil, "shortPath", true);
-    C.getFrameState(logPoses).writeTagged(fil, "poses", true);
+  {
+    SecMPC_LogFrame f;
+    f.stepCount = stepCount;
+    f.ctrlTime = ctrlTime;
+    f.phase = mpc.timingMPC.phase;
+    f.q_real = q;
+    f.waypoints = mpc.waypointMPC.path;
+    f.tau = mpc.timingMPC.tau;
+    f.shortPath = mpc.shortMPC.path;
+    f.poses = C.getFrameState(logPoses);
+    logWriter.write(f, logPoses.N ? logPoses : C.frames);
   }
 
   //-- send spline update
@@ -57,6 +58,166 @@ bool SecMPC_Stepper::step(rai::Configuration& C, BotOp& bot, SecMPC& mpc, bool d
 
 //===========================================================================
 
+SecMPC_AsyncStepper::SecMPC_AsyncStepper(SecMPC& _mpc, const rai::Configuration& C, double cycleTime)
+  : tic(cycleTime), logWriter("z.SecMPC.log"), expectedSolveTime(cycleTime), mpc(_mpc){
+  C_mpc.copy(C);
+  nextTic = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(cycleTime));
+  worker = std::thread(&SecMPC_AsyncStepper::workerLoop, this);
+}
+
+SecMPC_AsyncStepper::~SecMPC_AsyncStepper(){
+  {
+    std::lock_guard<std::mutex> lock(mux);
+    quit = true;
+  }
+  wakeup.notify_all();
+  worker.join();
+}
+
+bool SecMPC_AsyncStepper::waitForTic(BotOp& bot){
+  //(at most one solve finishes per tic: the next is only launched by step)
+  bool newResult=false;
+  {
+    std::unique_lock<std::mutex> lock(mux);
+    finished.wait_until(lock, nextTic, [this]{ return hasResult; });
+    if(hasResult){ logged = result; hasResult=false; newResult=true; }
+  }
+  if(newResult && logged.error) std::rethrow_exception(logged.error); //(the worker is idle again)
+
+
+  //-- splice in at the predicted time -- unless that has passed already
+  if(newResult && logged.splicePts.d0){
+    CHECK(!logged.spliceVels.N, "the short path has knot velocities -- BotOp::move splices positions and times only");
+    if(bot.get_t() < logged.ctrlTime){
+      bot.move(logged.splicePts, logged.spliceTimes, true, logged.ctrlTime);
+      splices++;
+    }else{
+      missedSplices++;
+    }
+  }
+  if(newResult) std::this_thread::sleep_until(nextTic); //the rest of the tic
+
+  //-- next tic (after an overrun: one cycle from now, instead of catching up)
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(tic.ticInterval));
+  nextTic += period;
+  auto now = std::chrono::steady_clock::now();
+  if(nextTic < now) nextTic = now + period;
+  return newResult;
+}
+
+bool SecMPC_AsyncStepper::step(rai::Configuration& C, BotOp& bot, bool doNotExecute){
+  stepCount++;
+
+  //-- iterate: wait for the tic -- a solve that finishes meanwhile is spliced in right away
+  bool newResult = waitForTic(bot);
+
+  //-- get optitrack
+  if(bot.optitrack) bot.optitrack->pull(C);
+
+  //-- get current state (time,q,qDot)
+  arr q, qDot;
+  double ctrlTime = 0.;
+  bot.getState(q, qDot, ctrlTime);
+
+  //-- report the finished solve (here, not on the worker: it may use the viewer -- and the worker is idle until the next
+  //   launch); launch the next one if the worker is idle
+  bool idle=false;
+  {
+    std::lock_guard<std::mutex> lock(mux);
+    idle = !busy && !hasJob;
+  }
+  if(newResult){
+    mpc.report(C);
+    if(logged.phaseSwitch) bot.sound(7 * logged.phase);
+  }
+
+  if(idle){
+    //predict the state at the time the solution will be spliced in: the current spline reference at that time
+    Job next;
+    next.ctrlTime = ctrlTime + expectedSolveTime.load();
+    bot.getReference(next.q, next.qDot, NoArr, q, qDot, next.ctrlTime);
+    next.X = C.getFrameState();
+    next.execute = !doNotExecute;
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      job = next;
+      hasJob = true;
+    }
+    wakeup.notify_all();
+  }else{
+    busyTics++;
+  }
+
+  //-- log (while the worker solves)
+  {
+    SecMPC_LogFrame f;
+    f.stepCount = stepCount;
+    f.ctrlTime = ctrlTime;
+    f.phase = logged.phase;
+    f.q_real = q;
+    f.waypoints = logged.waypoints;
+    f.tau = logged.tau;
+    f.shortPath = logged.shortPath;
+    f.poses = C.getFrameState(logPoses);
+    logWriter.write(f, logPoses.N ? logPoses : C.frames);
+  }
+
+  //-- update C
+  bot.sync(C, .0);
+  if(bot.keypressed=='q' || bot.keypressed==27) return false;
+
+  return true;
+}
+
+void SecMPC_AsyncStepper::workerLoop(){
+  Job J;
+  for(;;){
+    {
+      std::unique_lock<std::mutex> lock(mux);
+      wakeup.wait(lock, [this]{ return quit || hasJob; });
+      if(quit) return;
+      J = job;
+      hasJob = false;
+      busy = true;
+    }
+
+    //-- solve against the predicted state, and hand the solution back: step() splices it in at the predicted time (on the
+    //   user's thread) -- and rethrows what the solve threw
+    Result R;
+    R.ctrlTime = J.ctrlTime;
+    try{
+      auto t0 = std::chrono::steady_clock::now();
+      C_mpc.setFrameState(J.X);
+      mpc.cycle(C_mpc, J.q, J.qDot, J.q, J.qDot, J.ctrlTime);
+      solveTimes.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count());
+      if(solveTimes.count>=10) expectedSolveTime = 1.2e-9*solveTimes.percentile(.9);
+
+      if(J.execute){
+        auto sp = mpc.getShortPath(J.ctrlTime);
+        R.splicePts = sp.pts;
+        R.spliceVels = sp.vels;
+        R.spliceTimes = sp.times;
+      }
+      R.phase = mpc.timingMPC.phase;
+      R.phaseSwitch = mpc.phaseSwitch;
+      R.waypoints = mpc.waypointMPC.path;
+      R.tau = mpc.timingMPC.tau;
+      R.shortPath = mpc.shortMPC.path;
+    }catch(...){
+      R.error = std::current_exception();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      result = R;
+      hasResult = true;
+      busy = false;
+    }
+    finished.notify_all();
+  }
+}
+
+//===========================================================================
+
 void randomWalkPosition(rai::Frame* f, arr& centerPos, arr& velocity, double rate){
   arr pos = f->getPosition();
   if(!centerPos.N) centerPos = pos;
@@ -104,72 +265,85 @@ void SecMPC_Viewer::step(SecMPC& mpc){
   waypoints = mpc.waypointMPC.path;
   tau = mpc.timingMPC.tau;
   shortPath = mpc.shortMPC.path;
+  poses.clear();
 
-  C.view();
+  view();
 }
 
-void SecMPC_Viewer::glDraw(OpenGL& gl){
-  //C itself
-//  gl.drawOptions.drawVisualsOnly=true;
-//  gl.drawOptions.drawColors=true;
-//  C.setJointState(q_real);
-//  //C.setFrameState(poses, logPoses);
-//  C.glDraw(gl);
-
-  //waypoints
-  //double a = .6/(waypoints.d0-1);
-  gl.drawOptions.drawColors=false;
-  for(uint t=0;t<waypoints.d0;t++){
-//    glColor(1., 1.-a*t, .4+a*t);
-    C.setJointState(waypoints[t]);
-    NIY //C.glDraw(gl);
-  }
+void SecMPC_Viewer::set(const SecMPC_LogFrame& f){
+  stepCount = f.stepCount;
+  ctrlTime = f.ctrlTime;
+  phase = f.phase;
+  q_real = f.q_real;
+  waypoints = f.waypoints;
+  tau = f.tau;
+  shortPath = f.shortPath;
+  poses = f.poses;
+}
 
-  //shortPath
-//  glColor(.5, 1., 1., .3);
-//  gl.drawOptions.drawColors=false;
-//  for(uint t=0;t<shortPath.d0;t++){
-//    C.setJointState(shortPath[t]);
-//    C.glDraw(gl);
-//  }
+int SecMPC_Viewer::view(bool pause, const char* msg){
+  if(poses.N && poses.d0==poseFrames.N) C.setFrameState(poses, poseFrames);
+  arr q = q_real;
+  if(showWaypoint>=0 && waypoints.nd==2 && waypoints.d0) q = waypoints[showWaypoint%waypoints.d0];
+  if(q.N==C.getJointStateDimension()) C.setJointState(q);
 
-  //text
   rai::String text;
-  text <<"phase: " <<phase <<" ctrlTime:" <<ctrlTime <<"\ntau: " <<tau;
-  NIY; //glColor(.2,.2,.2,.5);
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glMatrixMode(GL_MODELVIEW);
-  glOrtho(0., (double)gl.width, (double)gl.height, .0, -1., 1.);
-  NIY; //glDrawText(text, 20, +20, 0, true);
+  text <<"step: " <<stepCount <<" phase: " <<phase <<" ctrlTime: " <<ctrlTime <<"\ntau: " <<tau;
+  if(showWaypoint>=0 && waypoints.nd==2 && waypoints.d0) text <<"\nwaypoint " <<showWaypoint%waypoints.d0+1 <<'/' <<waypoints.d0;
+  if(msg) text <<'\n' <<msg;
+  return C.view(pause, text);
 }
 
 //===========================================================================
 
-void playLog(const rai::String& logfile){
+void playLog(const rai::String& logfile, const char* configFile, double speed){
+  SecMPC_LogReader log(logfile);
+  CHECK(log.size(), "'" <<logfile <<"' contains no cycles");
+
   rai::Configuration C;
-  C.addFile("pushScenario.g");
+  C.addFile(configFile);
+  SecMPC_Viewer viewer(C);
+  for(const rai::String& name:log.poseFrames){
+    rai::Frame* f = viewer.C.getFrame(name, false);
+    if(!f){ LOG(-1) <<"logged frame '" <<name <<"' is not in '" <<configFile <<"' -- not showing poses"; viewer.poseFrames.clear(); break; }
+    viewer.poseFrames.append(f);
+  }
 
-  FrameL logPoses = C.getFrames({"puck", "target"});
-  OpenGL gl;
+  const char* keys = "[space] play/pause  [n/p] next/previous cycle  [+/-] speed  [>/<] skip 10%  [0-9] jump  [w] waypoints  [q] quit";
+  SecMPC_LogFrame f;
+  uint n = log.size(), k=0;
+  bool playing=true;
+  for(;;){
+    log.read(f, k);
+    viewer.set(f);
 
-  SecMPC_Viewer viewer(C);
-  NIY; //gl.add(viewer);
-
-  ifstream fil(logfile);
-  for(uint k=1;;k++){
-    fil >>viewer.stepCount >>viewer.ctrlTime >>viewer.phase;
-    if(!fil.good()) break;
-    CHECK_EQ(viewer.stepCount, k, "");
-
-    viewer.q_real.readTagged(fil, "q_real");
-    viewer.waypoints.readTagged(fil, "waypoints");
-    viewer.tau.readTagged(fil, "tau");
-    viewer.shortPath.readTagged(fil, "shortPath");
-    viewer.poses.readTagged(fil, "poses");
-
-    gl.update();
-    rai::wait(.1);
+    //-- show the cycle; when playing, keep polling for keys until the next cycle is due
+    rai::String status;
+    status <<(playing?"playing":"paused") <<" x" <<speed <<"  cycle " <<k+1 <<'/' <<n <<'\n' <<keys;
+    double due = rai::realTime() + (k+1<n ? (log.ctrlTime(k+1)-f.ctrlTime)/speed : 0.);
+    int key = viewer.view(!playing, status);
+    while(playing && !key && rai::realTime()<due){
+      rai::wait(.02);
+      key = viewer.view(false, status);
+    }
+    if(key) viewer.C.get_viewer()->_resetPressedKey();
+
+    //-- keys
+    if(key=='q' || key==27) break;
+    else if(key==' ') playing = !playing;
+    else if(key=='n'){ playing=false; if(k+1<n) k++; }
+    else if(key=='p'){ playing=false; if(k) k--; }
+    else if(key=='+') speed *= 2.;
+    else if(key=='-') speed /= 2.;
+    else if(key=='>'){ k += n/10+1; if(k>=n) k=n-1; }
+    else if(key=='<'){ k = k>n/10+1 ? k-(n/10+1) : 0; }
+    else if(key>='0' && key<='9') k = (n*(key-'0'))/10;
+    else if(key=='w'){ //cycle through the waypoints, then back to q_real
+      viewer.showWaypoint++;
+      if(viewer.waypoints.nd!=2 || viewer.showWaypoint>=(int)viewer.waypoints.d0) viewer.showWaypoint=-1;
+    }
+    else if(playing && !key){
+      if(k+1<n) k++; else playing=false; //stay at the last cycle
+    }
   }
 }
-
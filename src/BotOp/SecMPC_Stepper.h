@@ -1,20 +1,26 @@
 #pragma once
 
 #include "bot.h"
+#include "SecMPC_Log.h"
 #include <Control/SecMPC.h>
+#include <Utils/loopStats.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
 
 //===========================================================================
 
 struct SecMPC_Stepper{
   Metronome tic;
   uint stepCount = 0;
-  ofstream fil;
-  FrameL logPoses;
+  SecMPC_LogWriter logWriter; //binary, indexed -- replay with playLog
+  FrameL logPoses;            //frames whose poses are logged (default: all)
 
   SecMPC_Stepper( double cycleTime=.1)
-    : tic(cycleTime){
-    fil.open(STRING("z.SecMPC.log"));
-    //    fil.open(STRING("z." <<rai::date(true) <<".secMPC.log"));
+    : tic(cycleTime), logWriter("z.SecMPC.log"){
   }
 
   bool step(rai::Configuration& C, BotOp& bot, SecMPC& mpc, bool doNotExecute=false);
@@ -22,16 +28,69 @@ struct SecMPC_Stepper{
 
 //===========================================================================
 
+/// pipelined variant of SecMPC_Stepper: mpc.cycle runs on a worker thread against the state predicted for the time its
+/// solution will be ready (the spline reference at ctrlTime + expectedSolveTime); step() waits for its tic, splicing a
+/// solution in as soon as the worker hands it back, then senses, launches the next solve (if the worker is idle) and logs
+/// -- it never waits for a solve, so an overrunning cycle doesn't make the loop slip. Only step()'s thread uses the BotOp
+/// (which is not thread-safe) and the viewer; the worker only touches the mpc and its own copy of the configuration
+struct SecMPC_AsyncStepper {
+  Metronome tic;
+  uint stepCount = 0;
+  SecMPC_LogWriter logWriter; //binary, indexed -- replay with playLog
+  FrameL logPoses;            //frames whose poses are logged (default: all)
+
+  rai::LatencyHistogram solveTimes;         ///< measured durations of mpc.cycle
+  std::atomic<uint64_t> splices{0};        ///< solutions spliced in at their predicted time
+  std::atomic<uint64_t> missedSplices{0};  ///< solutions that were ready only after their predicted time (dropped)
+  uint64_t busyTics = 0;                   ///< tics at which the worker was still solving (no new solve launched)
+  std::atomic<double> expectedSolveTime;   ///< prediction horizon: 1.2 x p90 of the measured solve times (initially the cycle time)
+
+  SecMPC_AsyncStepper(SecMPC& _mpc, const rai::Configuration& C, double cycleTime=.1);
+  ~SecMPC_AsyncStepper();
+
+  bool step(rai::Configuration& C, BotOp& bot, bool doNotExecute=false);
+
+  rai::LoopStats::Summary getSolveTimes() const{ rai::LoopStats::Summary S; S.set(solveTimes); return S; }
+
+private:
+  SecMPC& mpc;               //used by the worker while it solves, by step() (report) only while the worker is idle
+  rai::Configuration C_mpc;  //the worker's copy of the user's configuration
+
+  struct Job { arr X, q, qDot; double ctrlTime=0.; bool execute=true; };
+  struct Result {
+    double ctrlTime=0.; uint phase=0; bool phaseSwitch=false; arr waypoints, tau, shortPath, splicePts, spliceVels, spliceTimes;
+    std::exception_ptr error; //thrown by the solve -- rethrown by step()
+  };
+
+  std::thread worker;
+  std::mutex mux;
+  std::condition_variable wakeup, finished;
+  bool quit=false, busy=false, hasJob=false, hasResult=false;
+  Job job;
+  Result result, logged;
+  std::chrono::steady_clock::time_point nextTic;
+
+  void workerLoop();
+  bool waitForTic(BotOp& bot); //true if a result was collected (and spliced in) while waiting
+};
+
+//===========================================================================
+
+/// shows one SecMPC cycle -- live from the mpc (step) or from a log (set): the configuration at q_real (or at one of the
+/// waypoints) with the logged poses, and phase, time and tau as text
 struct SecMPC_Viewer {
-  uint stepCount, phase;
-  double ctrlTime;
+  uint stepCount=0, phase=0;
+  double ctrlTime=0.;
   arr q_real, waypoints, tau, shortPath, poses;
   rai::Configuration C;
+  FrameL poseFrames;   ///< the frames 'poses' refers to
+  int showWaypoint=-1; ///< -1: show q_real, otherwise that waypoint
 
   SecMPC_Viewer(const rai::Configuration& C);
 
   void step(SecMPC& mpc);
-  void glDraw(OpenGL& gl);
+  void set(const SecMPC_LogFrame& f);
+  int view(bool pause=false, const char* msg=0);
 };
 
 //===========================================================================
@@ -39,5 +98,6 @@ struct SecMPC_Viewer {
 //helper
 void randomWalkPosition(rai::Frame* f, arr& centerPos, arr& velocity, double rate=.001);
 
-
-void playLog(const rai::String& logfile);
+/// replay a SecMPC log (z.SecMPC.log) in the configuration of configFile: play at speed x realtime, pause, step cycle by
+/// cycle and scrub -- the keys are shown in the viewer
+void playLog(const rai::String& logfile, const char* configFile="pushScenario.g", double speed=1.);
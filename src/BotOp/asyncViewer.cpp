@@ -0,0 +1,60 @@
+#include "asyncViewer.h"
+
+#include <Kin/viewer.h>
+#include <Utils/configSignature.h>
+
+AsyncViewer::AsyncViewer(const rai::Configuration& C, double maxFps)
+  : Thread("AsyncViewer", 1./maxFps){
+  viewC.copy(C);
+  structure = rai::structureSignature(C);
+  X = viewC.getFrameState();
+  threadLoop();
+}
+
+AsyncViewer::~AsyncViewer(){
+  threadClose();
+}
+
+void AsyncViewer::post(const rai::Configuration& C, const char* _msg){
+  std::lock_guard<std::mutex> lock(mux);
+  uint64_t s = rai::structureSignature(C);
+  if(s!=structure){ //frames added, removed, re-parented or with new shapes -> the render thread needs a fresh copy
+    structure = s;
+    newConfig = make_shared<rai::Configuration>();
+    newConfig->copy(C);
+  }
+  X = C.getFrameState();
+  msg = _msg;
+  posted++;
+}
+
+void AsyncViewer::step(){
+  //-- render only on a new snapshot (or to poll for key presses every ~.5 sec)
+  bool doRaise = raise.exchange(false);
+  rai::String text;
+  {
+    std::lock_guard<std::mutex> lock(mux);
+    if(posted==rendered && !doRaise && (++idleTicks)*metronome.ticInterval<.5) return;
+    idleTicks=0;
+    if(newConfig){
+      viewC.clear();
+      viewC.copy(*newConfig);
+      newConfig.reset();
+    }
+    viewC.setFrameState(X);
+    text = msg;
+    rendered = posted;
+  }
+
+  if(doRaise) viewC.get_viewer()->raiseWindow();
+  int key = viewC.view(false, text);
+  if(key){
+    keypressed = key;
+    viewC.get_viewer()->_resetPressedKey();
+    notifyEvents();
+  }
+}
+
+void AsyncViewer::close(){
+  viewC.view_close();
+}
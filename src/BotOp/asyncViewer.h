@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Kin/kin.h>
+#include <Core/thread.h>
+#include <Utils/botEvents.h>
+
+//===========================================================================
+
+/// renders snapshots of a configuration in its own thread at a capped frame rate (bot/viewer: async)
+/// post() only copies the frame state; key presses come back through an atomic
+struct AsyncViewer : Thread, rai::BotEventSource {
+  std::atomic<int> keypressed{0};
+
+  AsyncViewer(const rai::Configuration& C, double maxFps=30.);
+  ~AsyncViewer();
+
+  /// post a snapshot (frame state and message) -- never renders, never blocks on OpenGL
+  void post(const rai::Configuration& C, const char* msg);
+  /// the last key pressed in the viewer (0 if none) -- resets it
+  int getKeyPressed(){ return keypressed.exchange(0); }
+  void raiseWindow(){ raise=true; }
+
+  void step();
+  void close();
+
+private:
+  rai::Configuration viewC; //owned by the render thread
+  std::mutex mux;
+  arr X;                    //posted frame state
+  rai::String msg;
+  std::shared_ptr<rai::Configuration> newConfig; //posted when the structure of C changed
+  uint64_t structure=0;     //rai::structureSignature of C as last copied
+  uint posted=0, rendered=0;
+  std::atomic<bool> raise{false};
+  uint idleTicks=0;
+};
+
+//===========================================================================
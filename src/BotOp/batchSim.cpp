@@ -0,0 +1,88 @@
+#include "batchSim.h"
+
+BatchSim::BatchSim(const rai::Configuration& C, uint _N, double _tau, uint nThreads, const char* engine)
+  : N(_N), tau(_tau){
+  CHECK(N>0, "BatchSim needs at least one instance");
+  if(tau<0.) tau = rai::getParameter<double>("botsim/tau", .01);
+  rai::String _engine = engine ? rai::String(engine) : rai::getParameter<rai::String>("botsim/engine", "physx");
+  int verbose = rai::getParameter<int>("botsim/verbose", 0);
+
+  //-- clone the configuration and create the simulations (sequentially -- engine setup is not assumed to be thread-safe)
+  X0 = C.getFrameState();
+  dof = C.getJointStateDimension();
+  configs.resize(N);
+  sims.resize(N);
+  for(uint i=0;i<N;i++){
+    configs(i) = make_shared<rai::Configuration>();
+    configs(i)->copy(C);
+    sims(i) = make_shared<rai::Simulation>(*configs(i), rai::Enum<rai::Simulation::Engine>(_engine), verbose);
+  }
+  q.resize(N, dof);
+  qDot.resize(N, dof).setZero();
+  arr q0 = C.getJointState();
+  for(uint i=0;i<N;i++) q[i] = q0;
+
+  //-- worker pool (instances are statically partitioned into contiguous blocks)
+  if(!nThreads) nThreads = std::thread::hardware_concurrency();
+  if(nThreads>N) nThreads=N;
+  if(!nThreads) nThreads=1;
+  pool = std::make_unique<rai::WorkerPool>(nThreads);
+  LOG(0) <<"BatchSim: " <<N <<" instances (" <<_engine <<", dof=" <<dof <<") on " <<nThreads <<" threads";
+}
+
+void BatchSim::step(const arr& q_ref, const arr& qDot_ref){
+  bool hasRef = !!q_ref && q_ref.N;
+  if(hasRef){
+    CHECK(q_ref.nd==2 && q_ref.d0==N && q_ref.d1==dof, "q_ref needs to be (N x dof) = (" <<N <<" x " <<dof <<")");
+    CHECK(!!qDot_ref && qDot_ref.nd==2 && qDot_ref.d0==N && qDot_ref.d1==dof, "qDot_ref needs to be (N x dof) = (" <<N <<" x " <<dof <<")");
+    q_ref_step = &q_ref;
+    qDot_ref_step = &qDot_ref;
+  }else{
+    q_ref_step = qDot_ref_step = 0;
+  }
+
+  //-- release the workers and wait until all instances stepped
+  pool->run([&](uint k){
+    uint n = pool->numThreads();
+    stepRange((k*N)/n, ((k+1)*N)/n);
+  });
+
+  q_ref_step = qDot_ref_step = 0;
+  time += tau;
+  steps++;
+}
+
+void BatchSim::setJointStates(const arr& _q){
+  CHECK(_q.nd==2 && _q.d0==N && _q.d1==dof, "q needs to be (N x dof) = (" <<N <<" x " <<dof <<")");
+  for(uint i=0;i<N;i++){
+    configs(i)->setJointState(_q[i]);
+    sims(i)->setState(configs(i)->getFrameState());
+  }
+  q = _q;
+  qDot.setZero();
+}
+
+void BatchSim::reset(){
+  for(uint i=0;i<N;i++){
+    sims(i)->setState(X0);
+    q[i] = configs(i)->getJointState();
+  }
+  qDot.setZero();
+  time=0.;
+  steps=0;
+}
+
+void BatchSim::stepRange(uint i0, uint i1){
+  for(uint i=i0;i<i1;i++){
+    rai::Simulation& S = *sims(i);
+    if(q_ref_step){
+      const arr& q_ref = (*q_ref_step)[i];
+      const arr& qDot_ref = (*qDot_ref_step)[i];
+      S.step((q_ref, qDot_ref), tau, S._posVel);
+      qDot[i] = qDot_ref;
+    }else{
+      S.step({}, tau, S._none);
+    }
+    q[i] = configs(i)->getJointState();
+  }
+}
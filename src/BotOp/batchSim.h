@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Kin/kin.h>
+#include <Kin/simulation.h>
+#include <Utils/workerPool.h>
+
+#include <memory>
+
+//===========================================================================
+
+/// N independent copies of a configuration, each with its own rai::Simulation, stepped in lockstep
+/// across a pool of worker threads -- no metronome, no wall-clock pacing (for rollouts, policy evaluation, sweeps)
+/// the states of all instances are kept in (N x dof) arrays; step() writes them in place
+struct BatchSim {
+  uint N=0;   ///< number of instances
+  uint dof=0; ///< joint dimension of each instance
+  double tau;
+  rai::Array<std::shared_ptr<rai::Configuration>> configs;
+  rai::Array<std::shared_ptr<rai::Simulation>> sims;
+
+  arr q, qDot; ///< current states of all instances (N x dof), overwritten by each step
+  double time=0.;
+  uint steps=0;
+
+  BatchSim(const rai::Configuration& C, uint _N, double _tau=-1., uint nThreads=0, const char* engine=0);
+
+  /// one step of all instances: q_ref/qDot_ref are (N x dof) position/velocity references; if both are empty, instances step uncontrolled
+  void step(const arr& q_ref=NoArr, const arr& qDot_ref=NoArr);
+
+  /// set the joint states of all instances (N x dof), or reset to the initial state of C
+  void setJointStates(const arr& _q);
+  void reset();
+
+  uint numThreads() const{ return pool->numThreads(); }
+
+private:
+  arr X0; //initial frame state
+  const arr *q_ref_step=0, *qDot_ref_step=0;
+
+  std::unique_ptr<rai::WorkerPool> pool; //synchronized once per step
+
+  void stepRange(uint i0, uint i1);
+};
+
+//===========================================================================
@@ -7,11 +7,14 @@
 #include <Control/timingOpt.h>
 #include <Optim/NLP_Solver.h>
 #include <Gui/opengl.h>
-#include <Geo/depth2PointCloud.h>
 
 #include <Franka/franka.h>
 #include <Franka/FrankaGripper.h>
 #include "simulation.h"
+#include "asyncViewer.h"
+#include <Utils/ctrlChannel.h>
+#include <Utils/botEvents.h>
+#include <Utils/refCache.h>
 #include <Omnibase/omnibase.h>
 #include <Ranger/ranger.h>
 #include <Robotiq/RobotiqGripper.h>
@@ -29,6 +32,9 @@ BotOp::BotOp(rai::Configuration& C, bool useRealRobot){
   //-- launch arm(s) & gripper(s)
   bool useGripper = rai::getParameter<bool>("bot/useGripper", true);
   bool blockRealRobot = rai::getParameter<bool>("bot/blockRealRobot", false);
+  bool waitFree = rai::getParameter<bool>("bot/waitFree", false);
+
+  events = make_shared<rai::BotEvents>(rai::getParameter<double>("bot/eventsWakerPeriod", .001));
 
   C.ensure_indexedJoints();
   qHome = C.getJointState();
@@ -39,89 +45,152 @@ BotOp::BotOp(rai::Configuration& C, bool useRealRobot){
     useRealRobot=false;
   }
 
-  //-- launch robots & grippers
+  if(waitFree){
+    if(useRealRobot && (C.getFrame("omnibase_world", false) || C.getFrame("ranger_world", false))){
+      LOG(-1) <<"bot/waitFree is only implemented for Franka and simulation -- using the locked state/cmd exchange";
+    }else{
+      channel = make_shared<rai::CtrlChannel>();
+    }
+  }
+
+  //-- simulation (fast, sequential)
+  double startupTime = rai::realTime();
+  if(!useRealRobot){
+    simthread = make_shared<BotThreadedSim>(C, cmd, state, StringA{}, -1., -1., channel);
+    robotL = simthread;
+    if(useGripper) gripperL = make_shared<GripperSim>(simthread, "l_gripper");
+    startupTimings.append(BotStartupTiming{"simulation", rai::realTime()-startupTime, true, {}});
+  }
+
+  //-- launch devices concurrently: each is brought up in its own thread, with its own timeout (bot/startupTimeout, per kind
+  //   overridden by bot/startupTimeout_gripper, _franka, _omnibase, _ranger, _optitrack, _audio, _camera) and per-device
+  //   error report. Arms and bases are required (BotOp fails if one doesn't come up), all other devices are optional
+  double defaultTimeout = rai::getParameter<double>("bot/startupTimeout", 10.);
+  auto timeout = [defaultTimeout](const char* kind){ return rai::getParameter<double>(STRING("bot/startupTimeout_" <<kind), defaultTimeout); };
+  typedef DeviceStartup<rai::GripperAbstraction> GripperStartup;
+  typedef DeviceStartup<rai::RobotAbstraction> RobotStartup;
+  typedef DeviceStartup<rai::CameraAbstraction> CameraStartup;
+  std::shared_ptr<GripperStartup> startGripperL, startGripperR;
+  std::shared_ptr<RobotStartup> startRobotL, startRobotR, startOmnibase, startRanger;
+  std::shared_ptr<DeviceStartup<rai::OptiTrack>> startOptitrack;
+  std::shared_ptr<DeviceStartup<rai::Sound>> startAudio;
+  rai::Array<std::shared_ptr<CameraStartup>> startCameras;
+
   if(useRealRobot && useGripper){
     LOG(0) <<"CONNECTING TO GRIPPERS";
-    try{
-      if(C.getFrame("l_panda_hand", false) && C.getFrame("r_panda_hand", false)){
-        gripperL = make_shared<FrankaGripper>(0);
-        gripperR = make_shared<FrankaGripper>(1);
-      }else if(C.getFrame("l_panda_hand", false)){
-        gripperL = make_shared<FrankaGripper>(0);
-      }else if(C.getFrame("r_panda_hand", false)){
-        gripperR = make_shared<FrankaGripper>(1);
-
-      }else if(C.getFrame("l_robotiq_base", false) && C.getFrame("r_robotiq_base", false)){
-        gripperL = make_shared<RobotiqGripper>(0);
-        gripperR = make_shared<RobotiqGripper>(1);
-      }else if(C.getFrame("l_robotiq_base", false)){
-        gripperL = make_shared<RobotiqGripper>(0);
-      }else if(C.getFrame("r_robotiq_base", false)){
-        gripperR = make_shared<RobotiqGripper>(1);
-      }
-    } catch(const std::exception& ex) {
-      LOG(-1) <<"Starting the gripper(s) failed! Error msg: " <<ex.what();
+    if(C.getFrame("l_panda_hand", false) || C.getFrame("r_panda_hand", false)){
+      if(C.getFrame("l_panda_hand", false)) startGripperL = make_shared<GripperStartup>("gripperL (Franka)", timeout("gripper"), false, []{ return make_shared<FrankaGripper>(0); });
+      if(C.getFrame("r_panda_hand", false)) startGripperR = make_shared<GripperStartup>("gripperR (Franka)", timeout("gripper"), false, []{ return make_shared<FrankaGripper>(1); });
+    }else{
+      if(C.getFrame("l_robotiq_base", false)) startGripperL = make_shared<GripperStartup>("gripperL (Robotiq)", timeout("gripper"), false, []{ return make_shared<RobotiqGripper>(0); });
+      if(C.getFrame("r_robotiq_base", false)) startGripperR = make_shared<GripperStartup>("gripperR (Robotiq)", timeout("gripper"), false, []{ return make_shared<RobotiqGripper>(1); });
     }
   }
 
   if(useRealRobot){
     uint robotID=0;
     LOG(0) <<"CONNECTING TO FRANKAS";
-    try{
-      if(C.getFrame("l_panda_base", false) && C.getFrame("r_panda_base", false)){
-        robotL = make_shared<FrankaThread>(robotID++, franka_getJointIndices(C,'l'), cmd, state);
-        robotR = make_shared<FrankaThread>(robotID++, franka_getJointIndices(C,'r'), cmd, state);
-      } else if(C.getFrame("l_panda_base", false)){
-        robotL = make_shared<FrankaThread>(robotID++, franka_getJointIndices(C,'l'), cmd, state);
-      } else if(C.getFrame("r_panda_base", false)){
-        robotR = make_shared<FrankaThread>(robotID++, franka_getJointIndices(C,'r'), cmd, state);
-      }else{
-        LOG(0) <<"starting botop without franka robots (no frames l_panda_base or r_panda_base defined)";
-      }
-      C.setJointState(get_q());
-    } catch(const std::exception& ex) {
-      LOG(-1) <<"Starting the franka robot(s) failed! Error msg: " <<ex.what();
-    } catch(...) {
-      LOG(-1) <<"Starting the franka robot(s) failed! Error msg: " <<rai::errString();
+    if(C.getFrame("l_panda_base", false)){
+      uint id=robotID++;
+      uintA qIndices = franka_getJointIndices(C,'l');
+      startRobotL = make_shared<RobotStartup>("robotL (Franka)", timeout("franka"), true, [this, id, qIndices]{ return make_shared<FrankaThread>(id, qIndices, cmd, state, channel); });
+    }
+    if(C.getFrame("r_panda_base", false)){
+      uint id=robotID++;
+      uintA qIndices = franka_getJointIndices(C,'r');
+      startRobotR = make_shared<RobotStartup>("robotR (Franka)", timeout("franka"), true, [this, id, qIndices]{ return make_shared<FrankaThread>(id, qIndices, cmd, state, channel); });
+    }
+    if(!startRobotL && !startRobotR){
+      LOG(0) <<"starting botop without franka robots (no frames l_panda_base or r_panda_base defined)";
     }
 
-    try{
-      if(C.getFrame("omnibase_world", false)){
-        LOG(0) <<"CONNECTING TO OMNIBASE";
-        robotL = make_shared<OmnibaseThread>(robotID++, uintA{0,1,2}, cmd, state);
-      }
-    } catch(const std::exception& ex) {
-      LOG(-1) <<"Starting the omnibase failed! Error msg: " <<ex.what();
+    if(C.getFrame("omnibase_world", false)){
+      LOG(0) <<"CONNECTING TO OMNIBASE";
+      uint id=robotID++;
+      startOmnibase = make_shared<RobotStartup>("omnibase", timeout("omnibase"), true, [this, id]{ return make_shared<OmnibaseThread>(id, uintA{0,1,2}, cmd, state); });
     }
 
-    try{
-      if(C.getFrame("ranger_world", false)){
-        LOG(0) <<"CONNECTING TO RANGER";
-        robotL = make_shared<RangerThread>(robotID++, uintA{0,1,2}, cmd, state);
-      }
-    } catch(const std::exception& ex) {
-      LOG(-1) <<"Starting the ranger failed! Error msg: " <<ex.what();
+    if(C.getFrame("ranger_world", false)){
+      LOG(0) <<"CONNECTING TO RANGER";
+      uint id=robotID++;
+      startRanger = make_shared<RobotStartup>("ranger", timeout("ranger"), true, [this, id]{ return make_shared<RangerThread>(id, uintA{0,1,2}, cmd, state); });
     }
+  }
 
-  }else{
-    simthread = make_shared<BotThreadedSim>(C, cmd, state);
-    robotL = simthread;
-    if(useGripper) gripperL = make_shared<GripperSim>(simthread, "l_gripper");
+  if(rai::getParameter<bool>("bot/useOptitrack", false)){
+    LOG(0) <<"OPENING OPTITRACK";
+    if(!useRealRobot) LOG(-1) <<"useOptitrack with real:false -- that's usually wrong!";
+    startOptitrack = make_shared<DeviceStartup<rai::OptiTrack>>("optitrack", timeout("optitrack"), false, []{ return make_shared<rai::OptiTrack>(); });
+  }
+
+  if(rai::getParameter<bool>("bot/useAudio", false)){
+    LOG(0) <<"OPENING SOUND";
+    startAudio = make_shared<DeviceStartup<rai::Sound>>("audio", timeout("audio"), false, []{ return make_shared<rai::Sound>(); });
+  }
+
+  //cameras opened here (instead of lazily in getCamera) settle their auto-exposure in the background
+  StringA cameraNames = rai::getParameter<StringA>("bot/cameras", {});
+  for(const rai::String& name:cameraNames){
+    std::shared_ptr<BotThreadedSim> sim = simthread;
+    rai::String camName = name;
+    startCameras.append( make_shared<CameraStartup>(STRING("camera " <<name), timeout("camera"), false, [sim, camName]() -> std::shared_ptr<rai::CameraAbstraction> {
+      if(sim) return make_shared<CameraSim>(sim, camName);
+      return make_shared<RealSenseThread>(camName);
+    }) );
+  }
+
+  //-- collect the devices (in the original order of precedence: omnibase/ranger replace robotL)
+  if(startGripperL) gripperL = startGripperL->collect(startupTimings, startupPending);
+  if(startGripperR) gripperR = startGripperR->collect(startupTimings, startupPending);
+  if(startRobotL) robotL = startRobotL->collect(startupTimings, startupPending);
+  if(startRobotR) robotR = startRobotR->collect(startupTimings, startupPending);
+  if(robotL || robotR) C.setJointState(get_q());
+  if(startOmnibase){ auto r = startOmnibase->collect(startupTimings, startupPending); if(r) robotL = r; }
+  if(startRanger){ auto r = startRanger->collect(startupTimings, startupPending); if(r) robotL = r; }
+  if(startOptitrack){
+    optitrack = startOptitrack->collect(startupTimings, startupPending);
+    if(optitrack) optitrack->pull(C);
+  }
+  if(startAudio) audio = startAudio->collect(startupTimings, startupPending);
+  for(auto& cam:startCameras){
+    auto c = cam->collect(startupTimings, startupPending);
+    if(c) cameras.append(c);
   }
 
   startRealTime = rai::realTime();
+  startupTimings.append(BotStartupTiming{"total", startRealTime-startupTime, true, {}});
+  {
+    rai::String report;
+    bool failed=false;
+    for(const BotStartupTiming& t:startupTimings){
+      report <<"\n  " <<t.device <<": ";
+      if(t.ok) report <<t.seconds <<"sec"; else report <<"FAILED (" <<t.error <<")" <<(t.required ? " -- required" : "");
+      if(!t.ok && t.required) failed=true;
+    }
+    LOG(0) <<"startup timing:" <<report;
+    if(failed){ //e.g. without the lead arm (robotID 0) ctrlTime would never advance: stop what came up, as the destructor does
+      startupPending.clear();
+      gripperL.reset();
+      gripperR.reset();
+      robotL.reset();
+      robotR.reset();
+      optitrack.reset();
+      audio.reset();
+      cameras.clear();
+      HALT("a required device failed to start -- startup timing:" <<report);
+    }
+  }
+
+  //-- let control threads and grippers wake up wait
+  for(rai::BotEventSource* s:{dynamic_cast<rai::BotEventSource*>(robotL.get()), dynamic_cast<rai::BotEventSource*>(robotR.get()),
+                              dynamic_cast<rai::BotEventSource*>(gripperL.get()), dynamic_cast<rai::BotEventSource*>(gripperR.get())}){
+    if(s) s->events = events.get();
+  }
 
   //-- initialize the control reference
+  shareReference = rai::getParameter<bool>("bot/shareReference", true) && robotL && robotR;
   hold(false, true);
 
-  //-- launch OptiTrack
-  if(rai::getParameter<bool>("bot/useOptitrack", false)){
-    LOG(0) <<"OPENING OPTITRACK";
-    if(!useRealRobot) LOG(-1) <<"useOptitrack with real:false -- that's usually wrong!";
-    optitrack = make_shared<rai::OptiTrack>();
-    optitrack->pull(C);
-  }
-
 #ifdef RAI_VIVE
   //-- launch ViveController
   if(rai::getParameter<bool>("bot/useViveController", false)){
@@ -131,18 +200,26 @@ BotOp::BotOp(rai::Configuration& C, bool useRealRobot){
   }
 #endif
 
-  //-- launch Audio/Sound
-  if(rai::getParameter<bool>("bot/useAudio", false)){
-    LOG(0) <<"OPENING SOUND";
-    audio = make_shared<rai::Sound>();
+  //-- viewer: sync (render in sync), async (render thread at capped frame rate), or none (headless)
+  rai::String viewerMode = rai::getParameter<rai::String>("bot/viewer", "sync");
+  raiseWindow = rai::getParameter<bool>("bot/raiseWindow", false);
+  if(viewerMode=="none"){
+    headless=true;
+  }else if(viewerMode=="async"){
+    viewer = make_shared<AsyncViewer>(C, rai::getParameter<double>("bot/viewerFps", 30.));
+    viewer->events = events.get();
+    viewer->post(C, "time: 0");
+  }else{
+    CHECK(viewerMode=="sync", "bot/viewer needs to be sync, async or none");
+    C.gl().setTitle("BotOp associated Configuration");
+    C.view(false, STRING("time: 0"));
   }
-
-  C.gl().setTitle("BotOp associated Configuration");
-  C.view(false, STRING("time: 0"));
 }
 
 BotOp::~BotOp(){
   LOG(0) <<"shutting down BotOp...";
+  startupPending.clear(); //joins device startups that timed out (their devices are stopped when they come up)
+  viewer.reset();
   if(simthread) simthread.reset();
   gripperL.reset();
   gripperR.reset();
@@ -151,10 +228,12 @@ BotOp::~BotOp(){
 }
 
 double BotOp::get_t(){
+  if(channel) return channel->ctrlTime.load();
   return state.get()->ctrlTime;
 }
 
 void BotOp::getState(arr& q_real, arr& qDot_real, double& ctrlTime){
+  if(channel){ channel->getState(q_real, qDot_real, ctrlTime, qHome.N); return; }
   auto stateGet = state.get();
   q_real = stateGet->q;
   qDot_real = stateGet->qDot;
@@ -168,10 +247,12 @@ void BotOp::getReference(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q
 }
 
 arr BotOp::get_q() {
+  if(channel){ arr q; double t; channel->getState(q, NoArr, t, qHome.N); return q; }
   return state.get()->q;
 }
 
 arr BotOp::get_qDot() {
+  if(channel){ arr qDot; double t; channel->getState(NoArr, qDot, t, qHome.N); return qDot; }
   return state.get()->qDot;
 }
 
@@ -192,6 +273,7 @@ arr BotOp::getEndPoint(){
 }
 
 arr BotOp::get_tauExternal(){
+  if(channel) return channel->getTauExternal(qHome.N);
   arr tau;
   {
     auto stateSet = state.set();
@@ -205,7 +287,7 @@ arr BotOp::get_tauExternal(){
 
 int BotOp::sync(rai::Configuration& C, double waitTime, rai::String viewMsg){
   //update q state
-  C.setJointState(state.get()->q);
+  C.setJointState(get_q());
 
   //update optitrack state
   if(optitrack) optitrack->pull(C);
@@ -219,31 +301,93 @@ int BotOp::sync(rai::Configuration& C, double waitTime, rai::String viewMsg){
   if(simthread) simthread->pullDynamicStates(C);
 
   //gui
-  if(rai::getParameter<bool>("bot/raiseWindow",false)) C.get_viewer()->raiseWindow();
-  double ctrlTime = get_t();
-  keypressed = C.view(false, STRING("BotOp sync ctrl time: "<<ctrlTime <<" (=" <<int(100.*ctrlTime/(rai::realTime()-startRealTime)) <<"% real time)\n" <<viewMsg));
-  if(keypressed) C.get_viewer()->_resetPressedKey();
+  if(headless){
+    keypressed=0;
+  }else{
+    double ctrlTime = get_t();
+    rai::String msg = STRING("BotOp sync ctrl time: "<<ctrlTime <<" (=" <<int(100.*ctrlTime/(rai::realTime()-startRealTime)) <<"% real time)\n" <<viewMsg);
+    if(viewer){ //only post a snapshot; the viewer thread renders
+      if(raiseWindow) viewer->raiseWindow();
+      viewer->post(C, msg);
+      keypressed = viewer->getKeyPressed();
+    }else{
+      if(raiseWindow) C.get_viewer()->raiseWindow();
+      keypressed = C.view(false, msg);
+      if(keypressed) C.get_viewer()->_resetPressedKey();
+    }
+  }
 //  if(keypressed==13) return false;
 //  if(keypressed=='q' || keypressed==27) return false;
 //  auto sp = std::dynamic_pointer_cast<rai::SplineCtrlReference>(ref);
 //  if(sp && ctrlTime>sp->getEndTime()) return false;
-  if(!keypressed && waitTime>0.) rai::wait(waitTime);
+  if(!keypressed && waitTime>0. && !isLockstep()) rai::wait(waitTime);
   return keypressed;
 }
 
 int BotOp::wait(rai::Configuration& C, bool forKeyPressed, bool forTimeToEnd, bool forGripper){
-  C.get_viewer()->raiseWindow();
-  C.get_viewer()->_resetPressedKey();
+  if(isLockstep() && (forTimeToEnd || forGripper)){
+    //advance the simulation tick by tick, as fast as possible, until the motion (or gripper) is done -- no clock, no display in between
+    //(at most bot/lockstepWaitLimit of simulated time beyond the motion's end: a gripper might never report done)
+    double tau = simthread->getTau();
+    double limit = get_t() + rai::getParameter<double>("bot/lockstepWaitLimit", 10.);
+    if(forTimeToEnd && getTimeToEnd()>0.) limit += getTimeToEnd();
+    for(;;){
+      if(forTimeToEnd && getTimeToEnd()<=0.) break;
+      if(forGripper && gripperDone(rai::_left)){ sync(C, 0.); return 'g'; }
+      if(get_t()>=limit){
+        LOG(-1) <<"lockstep wait: " <<(forGripper && !gripperDone(rai::_left) ? "gripper" : "motion") <<" not done after bot/lockstepWaitLimit -- giving up";
+        break;
+      }
+      simthread->stepLockstep(tau);
+    }
+    sync(C, 0.);
+    return keypressed;
+  }
+
+  if(headless){
+    if(forKeyPressed && !forTimeToEnd && !forGripper) return ' '; //nobody can press a key
+  }else if(viewer){
+    viewer->raiseWindow();
+    viewer->getKeyPressed();
+  }else{
+    C.get_viewer()->raiseWindow();
+    C.get_viewer()->_resetPressedKey();
+  }
+  //sleep until the control thread (motion end), a gripper (done) or the viewer (key) signals -- or at the latest after .1 sec
+  //(to refresh the display and for sources that don't signal)
   for(;;){
-    sync(C, .1);
+    uint64_t revision = events->revision();
+    sync(C, 0.);
     //if(keypressed=='q') return keypressed;
     if(forKeyPressed && keypressed) return keypressed;
-    if(forTimeToEnd && getTimeToEnd()<=0.) return keypressed;
+    double timeToEnd = forTimeToEnd ? getTimeToEnd() : 0.;
+    if(forTimeToEnd && timeToEnd<=0.) return keypressed;
     if(forGripper && gripperDone(rai::_left)) return 'g';
     if(!rai::getInteractivity() && !forTimeToEnd && forKeyPressed) return ' ';
+    if(forTimeToEnd) events->armMotionEnd(get_t() + timeToEnd);
+    events->waitForNotification(revision, .1);
   }
 }
 
+bool BotOp::isLockstep(){
+  return simthread && simthread->lockstep;
+}
+
+void BotOp::step(double dt){
+  if(isLockstep()) simthread->stepLockstep(dt);
+  else rai::wait(dt);
+}
+
+std::shared_ptr<rai::ReferenceFeed> BotOp::ctrlRef(const std::shared_ptr<rai::ReferenceFeed>& _ref){
+  //only time-only references can be shared across control threads -- ZeroReference depends on each arm's q_real
+  refCache.reset();
+  if(shareReference && std::dynamic_pointer_cast<rai::BSplineCtrlReference>(_ref)){
+    refCache = make_shared<rai::TickCachedReference>(_ref);
+    return refCache;
+  }
+  return _ref;
+}
+
 std::shared_ptr<rai::BSplineCtrlReference> BotOp::getSplineRef(){
   auto sp = std::dynamic_pointer_cast<rai::BSplineCtrlReference>(ref);
   if(!sp){
@@ -280,6 +424,7 @@ void BotOp::move(const arr& path, const arr& times, bool overwrite, double overw
     //LOG(1) <<"append: " <<ctrlTime <<" - " <<_times;
     getSplineRef()->append(path, /*vels,*/ _times, get_t());
   }
+  if(refCache) refCache->invalidate();
 }
 
 void BotOp::move_oldCubic(const arr& path, const arr& times, bool overwrite, double overwriteCtrlTime){
@@ -325,12 +470,24 @@ void BotOp::move_oldCubic(const arr& path, const arr& times, bool overwrite, dou
   NIY; //move(path, vels, _times, overwrite, overwriteCtrlTime);
 }
 
-void BotOp::moveAutoTimed(const arr& path, double maxVel, double maxAcc){
-  CHECK_GE(path.d0, 16, "this only works for smooth paths!");
+PathTiming BotOp::moveAutoTimed(const arr& path, double maxVel, double maxAcc, double maxJerk){
+  //equal time spacing, limited by the slowest segment: used with bot/autoTiming: uniform, otherwise the reference of the saving
   double D = getMinDuration(path, maxVel, maxAcc);
-  arr times = range(0., D, path.d0-1);
-  times += times(1);
-  move(path, times);
+  arr uniformTimes = range(0., D, path.d0-1);
+  uniformTimes += uniformTimes(1);
+
+  PathTiming timing;
+  if(rai::getParameter<rai::String>("bot/autoTiming", "topp")=="uniform"){
+    timing.times = uniformTimes;
+    timing.duration = timing.uniformDuration = timing.times.last();
+  }else{
+    timing = getTimeOptimalTiming(path, getEndPoint(), arr{maxVel}, arr{maxAcc}, maxJerk>0. ? arr{maxJerk} : arr{});
+    CHECK(timing.times.N, "time-optimal parameterization failed -- use bot/autoTiming: uniform");
+    timing.uniformDuration = uniformTimes.last();
+    LOG(0) <<"moveAutoTimed: duration " <<timing.duration <<"sec (equal spacing: " <<timing.uniformDuration <<"sec, saving " <<100.*timing.saving() <<"%)";
+  }
+  move(path, timing.times);
+  return timing;
 }
 
 void BotOp::moveTo(const arr& q_target, double timeCost, bool overwrite){
@@ -355,8 +512,21 @@ void BotOp::moveTo(const arr& q_target, double timeCost, bool overwrite){
 }
 
 void BotOp::setControllerWriteData(int _writeData){
-  if(robotL) robotL->writeData=_writeData;
-  if(robotR) robotR->writeData=_writeData;
+  for(auto& robot:{robotL, robotR}){
+    if(!robot) continue;
+    //the log is built here, on the user thread, and handed to the control loop
+    auto L = dynamic_cast<rai::DataLogSource*>(robot.get());
+    if(L) L->setDataLogLevel(_writeData); else robot->writeData=_writeData;
+  }
+}
+
+rai::Array<rai::LoopStats::Report> BotOp::getLoopStats(bool reset){
+  rai::Array<rai::LoopStats::Report> R;
+  for(auto& robot:{robotL, robotR}){
+    auto P = dynamic_cast<rai::LoopStatsProvider*>(robot.get());
+    if(P) R.append(P->loopStats.report(reset));
+  }
+  return R;
 }
 
 void BotOp::setCompliance(const arr& J, double compliance){
@@ -365,6 +535,7 @@ void BotOp::setCompliance(const arr& J, double compliance){
   if(!J.N || !compliance){
     LOG(0) <<"clearing compliance";
     cmd.set()->P_compliance.clear();
+    publishCmd();
     return;
   }
 
@@ -378,6 +549,11 @@ void BotOp::setCompliance(const arr& J, double compliance){
   P -= compliance * (V*~V);
 
   cmd.set()->P_compliance = P;
+  publishCmd();
+}
+
+void BotOp::publishCmd(){
+  if(channel) channel->publishCmd(cmd.get()());
 }
 
 void BotOp::gripperMove(rai::ArgWord leftRight, double width, double speed){
@@ -429,10 +605,45 @@ arr BotOp::getCameraFxycxy(const char* sensor){
   return cam->getFxycxy();
 }
 
+bool BotOp::getFrame(rai::CameraFrame& frame, const char* sensor, uint64_t after, double timeout){
+  auto src = dynamic_cast<rai::FrameSource*>(getCamera(sensor).get());
+  CHECK(src, "camera '" <<sensor <<"' has no timestamped frames");
+  if(timeout<0.) return src->getLatest(frame, after);
+  return src->waitNext(frame, after, timeout);
+}
+
+rai::CameraFrameStats BotOp::getFrameStats(const char* sensor){
+  auto src = dynamic_cast<rai::FrameSource*>(getCamera(sensor).get());
+  CHECK(src, "camera '" <<sensor <<"' has no timestamped frames");
+  return src->getFrameStats();
+}
+
+const rai::RayTable& BotOp::getRayTable(rai::CameraAbstraction& cam, const floatA& depth){
+  rai::RayTable& table = rayTables[cam.name.p];
+  rai::CameraIntrinsics I;
+  auto src = dynamic_cast<rai::IntrinsicsSource*>(&cam);
+  if(src) I = src->getIntrinsics();
+  if(!src || I.width!=depth.d1 || I.height!=depth.d0) I = rai::CameraIntrinsics(cam.getFxycxy(), depth.d1, depth.d0); //pinhole
+  table.set(I);
+  return table;
+}
+
 void BotOp::getImageDepthPcl(byteA& image, floatA& depth, arr& points, const char* sensor, bool globalCoordinates){
   auto cam = getCamera(sensor);
   cam->getImageAndDepth(image, depth);
-  depthData2pointCloud(points, depth, cam->getFxycxy());
+  getRayTable(*cam, depth).backProject(points, depth);
+  if(globalCoordinates){
+    rai::Transformation pose=cam->getPose();
+    if(!pose.isZero()) pose.applyOnPointArray(points);
+  }
+}
+
+void BotOp::getPointCloud(arr& points, byteA& colors, const char* sensor, bool globalCoordinates, const uintA& roi, uint stride){
+  auto cam = getCamera(sensor);
+  byteA image;
+  floatA depth;
+  cam->getImageAndDepth(image, depth);
+  getRayTable(*cam, depth).backProject(points, depth, roi, stride, &colors, image);
   if(globalCoordinates){
     rai::Transformation pose=cam->getPose();
     if(!pose.isZero()) pose.applyOnPointArray(points);
@@ -440,13 +651,15 @@ void BotOp::getImageDepthPcl(byteA& image, floatA& depth, arr& points, const cha
 }
 
 void BotOp::home(rai::Configuration& C){
-  C.get_viewer()->raiseWindow();
+  if(viewer) viewer->raiseWindow();
+  else if(!headless) C.get_viewer()->raiseWindow();
   moveTo(qHome, 1., true);
   wait(C);
 }
 
 void BotOp::stop(rai::Configuration& C){
-  C.get_viewer()->raiseWindow();
+  if(viewer) viewer->raiseWindow();
+  else if(!headless) C.get_viewer()->raiseWindow();
   moveTo(get_q(), .01, true);
   wait(C);
 }
@@ -481,21 +694,22 @@ void BotOp::sound(int noteRelToC, float a, float decay){
 //===========================================================================
 
 void ZeroReference::getReference(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q_real, const arr& qDot_real, double ctrlTime){
+  //called within the control loops: assign into the given buffers instead of creating temporaries
   {
-    arr pos = position_ref.get()();
-    if(pos.N) q_ref = pos;
+    auto pos = position_ref.get();
+    if(pos->N) q_ref = pos();
     else q_ref.clear(); // = q_real;  //->no position gains at all
   }
   {
-    arr vel = velocity_ref.get()();
-    if(vel.N==1){
-      double a = vel.scalar();
+    auto vel = velocity_ref.get();
+    if(vel->N==1){
+      double a = vel->scalar();
       CHECK(a>=0. && a<=1., "");
-      qDot_ref = a * qDot_real; //[0] -> zero vel reference -> damping
+      qDot_ref = qDot_real; //[0] -> zero vel reference -> damping
+      qDot_ref *= a;
     }
-    else if(vel.N) qDot_ref = vel;
+    else if(vel->N) qDot_ref = vel();
     else qDot_ref.clear(); //.clear();  //[] -> no damping at all! (and also no friction compensation based on reference qDot)
   }
   qDDot_ref.clear(); //[] -> no acc at all
 }
-
@@ -2,6 +2,11 @@
 
 #include <Kin/kin.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/loopStats.h>
+#include <Utils/cameraFrames.h>
+#include <Utils/rayTable.h>
+#include "deviceStartup.h"
+#include "timeOptimal.h"
 
 //fwd declarations
 namespace rai{
@@ -11,26 +16,33 @@ namespace rai{
   struct Sound;
 }
 struct BotThreadedSim;
+struct AsyncViewer;
+namespace rai{ struct CtrlChannel; struct BotEvents; struct TickCachedReference; }
 
 //===========================================================================
 
 struct BotOp{
   Var<rai::CtrlCmdMsg> cmd;
   Var<rai::CtrlStateMsg> state;
+  std::shared_ptr<rai::BotEvents> events; //notifications for wait (declared first: outlives all threads that signal it)
   //since each of the following interfaces is already pimpl, we don't have to hide them again
   std::shared_ptr<rai::RobotAbstraction> robotL;
   std::shared_ptr<rai::RobotAbstraction> robotR;
   std::shared_ptr<rai::GripperAbstraction> gripperL;
   std::shared_ptr<rai::GripperAbstraction> gripperR;
   std::shared_ptr<rai::ReferenceFeed> ref;
+  std::shared_ptr<rai::TickCachedReference> refCache; //per-tick evaluation shared by both arms' control threads (bot/shareReference)
   std::shared_ptr<rai::OptiTrack> optitrack;
   std::shared_ptr<rai::ViveController> vivecontroller;
   std::shared_ptr<rai::Sound> audio;
   std::shared_ptr<BotThreadedSim> simthread;
+  std::shared_ptr<rai::CtrlChannel> channel; //wait-free state/cmd exchange with the control threads (bot/waitFree)
+  std::shared_ptr<AsyncViewer> viewer; //render thread (bot/viewer: async)
   rai::Array<std::shared_ptr<rai::CameraAbstraction>> cameras;
 
   arr qHome;
   int keypressed=0;
+  rai::Array<BotStartupTiming> startupTimings; //per-device bring-up time (bot/startupTimeout, bot/cameras)
 
   BotOp(rai::Configuration& C, bool useRealRobot);
   ~BotOp();
@@ -46,11 +58,12 @@ struct BotOp{
   arr getEndPoint(); //negative, if motion spline is done
   arr get_tauExternal();
   int getKeyPressed(){ return keypressed; }
+  rai::Array<rai::LoopStats::Report> getLoopStats(bool reset=false); //timing histograms of the control threads (reset: start a new window)
 
   //-- motion commands
   void move(const arr& path, const arr& times, bool overwrite=false, double overwriteCtrlTime=-1.);
   void move_oldCubic(const arr& path, const arr& times, bool overwrite=false, double overwriteCtrlTime=-1.);
-  void moveAutoTimed(const arr& path, double maxVel=1., double maxAcc=1.); //double timeCost);
+  PathTiming moveAutoTimed(const arr& path, double maxVel=1., double maxAcc=1., double maxJerk=-1.); //time-optimal (bot/autoTiming), returns the knot times and saving
   void moveTo(const arr& q_target, double timeCost=1., bool overwrite=false);
   void setControllerWriteData(int _writeData);
   void setCompliance(const arr& J, double compliance=.5);
@@ -65,12 +78,19 @@ struct BotOp{
   //-- camera commands
   void getImageAndDepth(byteA& image, floatA& depth, const char* sensor);
   void getImageDepthPcl(byteA& image, floatA& depth, arr& points, const char* sensor, bool globalCoordinates=false);
+  void getPointCloud(arr& points, byteA& colors, const char* sensor, bool globalCoordinates=false, const uintA& roi={}, uint stride=1); //roi={u0, v0, u1, v1}: points (and colors) rows x cols x 3 of every stride-th pixel
   arr  getCameraFxycxy(const char* sensor);
+  bool getFrame(rai::CameraFrame& frame, const char* sensor, uint64_t after=0, double timeout=-1.); //timeout<0: non-blocking, only frames newer than 'after'
+  rai::CameraFrameStats getFrameStats(const char* sensor);
 
   //-- sync the user's C with the robot, update the display, return pressed key
   int sync(rai::Configuration& C, double waitTime=.1, rai::String viewMsg={});
   int wait(rai::Configuration& C, bool forKeyPressed=true, bool forTimeToEnd=true, bool forGripper=false);
 
+  //-- lockstep simulation (botsim/lockstep): time only advances in step and wait -- otherwise step just sleeps for dt
+  bool isLockstep();
+  void step(double dt);
+
   //-- motion macros
   void home(rai::Configuration& C);
   void stop(rai::Configuration& C);
@@ -81,9 +101,17 @@ struct BotOp{
 
 private:
   std::shared_ptr<rai::CameraAbstraction>& getCamera(const char* sensor);
+  const rai::RayTable& getRayTable(rai::CameraAbstraction& cam, const floatA& depth);
   template<class T> BotOp& setReference();
+  std::shared_ptr<rai::ReferenceFeed> ctrlRef(const std::shared_ptr<rai::ReferenceFeed>& _ref);
   std::shared_ptr<rai::BSplineCtrlReference> getSplineRef();
+  void publishCmd();
   double startRealTime;
+  std::vector<std::shared_ptr<void>> startupPending; //device startups that timed out (joined in the destructor)
+  bool headless=false;    //bot/viewer: none -- sync never renders
+  bool raiseWindow=false; //bot/raiseWindow
+  bool shareReference=false; //bot/shareReference, and more than one control thread
+  std::map<std::string, rai::RayTable> rayTables; //per camera: back-projection rays, rebuilt when the intrinsics change
 };
 
 //===========================================================================
@@ -104,7 +132,8 @@ struct ZeroReference : rai::ReferenceFeed {
 template<class T> BotOp& BotOp::setReference(){
   //comment the next line to only get gravity compensation instead of 'zero reference following' (which includes damping)
   ref = make_shared<T>();
-  cmd.set()->ref = ref;
+  cmd.set()->ref = ctrlRef(ref);
+  publishCmd();
 //  ref->setPositionReference(q_now);
 //ref->setVelocityReference({.0,.0,.2,0,0,0,0});
   return *this;
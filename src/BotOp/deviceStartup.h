@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Core/util.h>
+
+#include <future>
+#include <functional>
+#include <atomic>
+
+//===========================================================================
+
+/// startup timing of one device, as reported by BotOp
+struct BotStartupTiming {
+  rai::String device;
+  double seconds=0.;
+  bool ok=true;
+  rai::String error;
+  bool required=false; ///< BotOp can't run without it: a failure or timeout fails the constructor
+};
+
+//===========================================================================
+
+/// brings up one device in its own thread; collect() waits until its timeout (counted from its own start) and reports
+/// timing, timeout or error
+template<class T> struct DeviceStartup {
+  rai::String name;
+  double startTime, timeout;
+  bool required;
+  std::shared_ptr<std::atomic<double>> duration;
+  std::shared_ptr<std::atomic<bool>> claimed; //set by whoever decides first: the startup finishing, or collect() giving up
+  std::future<std::shared_ptr<T>> future;
+
+  DeviceStartup(const char* _name, double _timeout, bool _required, const std::function<std::shared_ptr<T>()>& create)
+    : name(_name), startTime(rai::realTime()), timeout(_timeout), required(_required),
+      duration(make_shared<std::atomic<double>>(-1.)), claimed(make_shared<std::atomic<bool>>(false)){
+    auto dur = duration;
+    auto claim = claimed;
+    rai::String devName = name;
+    future = std::async(std::launch::async, [create, dur, claim, devName](){
+      double t0 = rai::realTime();
+      std::shared_ptr<T> dev;
+      try{
+        dev = create();
+      }catch(...){
+        dur->store(rai::realTime()-t0);
+        throw;
+      }
+      dur->store(rai::realTime()-t0);
+      if(claim->exchange(true)){ //collect() gave up on this device: a late device must not keep running (e.g. controlling the arm)
+        LOG(-1) <<"Starting " <<devName <<" finished after the timeout (" <<dur->load() <<"sec) -- stopping it";
+        dev.reset();
+      }
+      return dev;
+    });
+  }
+
+  /// the device, or null on error or timeout; a timed-out startup is abandoned: the device is destroyed (stopped) as soon
+  /// as its creation returns; the startup thread is moved into 'pending' -- whoever owns 'pending' joins it on destruction
+  std::shared_ptr<T> collect(rai::Array<BotStartupTiming>& timings, std::vector<std::shared_ptr<void>>& pending){
+    timings.append(BotStartupTiming());
+    BotStartupTiming& timing = timings.last();
+    timing.device = name;
+    timing.required = required;
+    std::shared_ptr<T> dev;
+    double remaining = startTime + timeout - rai::realTime();
+    if(future.wait_for(std::chrono::duration<double>(remaining>0. ? remaining : 0.)) != std::future_status::ready
+       && !claimed->exchange(true)){ //(if the startup claimed first, it finished just now and the future is about to be ready)
+      timing.ok = false;
+      timing.error = "timeout";
+      timing.seconds = -1.;
+      LOG(-1) <<"Starting " <<name <<" timed out after " <<timeout <<"sec" <<(required ? "" : " -- continuing without it")
+              <<" (it is stopped should it still come up)";
+      pending.push_back(make_shared<std::future<std::shared_ptr<T>>>(std::move(future)));
+      return dev;
+    }
+    try{
+      dev = future.get();
+    }catch(const std::exception& ex){
+      timing.ok = false;
+      timing.error = ex.what();
+    }catch(...){
+      timing.ok = false;
+      timing.error = rai::errString();
+    }
+    timing.seconds = duration->load();
+    if(!timing.ok) LOG(-1) <<"Starting " <<name <<" failed! Error msg: " <<timing.error <<(required ? "" : " -- continuing without it");
+    return dev;
+  }
+};
+
+//===========================================================================
@@ -13,6 +13,10 @@
 #include <ry/types.h>
 
 #include "bot.h"
+#include "batchSim.h"
+
+#include <Utils/dataLogger.h>
+#include <Utils/depthConvert.h>
 
 #include <KOMO/pathTools.h>
 
@@ -64,11 +68,21 @@ void init_BotOp(pybind11::module& m) {
        pybind11::arg("overwrite") = false,
        pybind11::arg("overwriteCtrlTime") = -1.)
 
-  .def("moveAutoTimed", &BotOp::moveAutoTimed,
-       "helper to execute a path (typically fine resolution, from KOMO or RRT) with equal time spacing chosen for given max vel/acc",
+  .def("moveAutoTimed", [](std::shared_ptr<BotOp>& self, const arr& path, double maxVel, double maxAcc, double maxJerk){
+         PathTiming timing = self->moveAutoTimed(path, maxVel, maxAcc, maxJerk);
+         pybind11::dict D;
+         D["times"] = Array2numpy<double>(timing.times);
+         D["duration"] = timing.duration;
+         D["uniformDuration"] = timing.uniformDuration;
+         D["saving"] = timing.saving();
+         return D;
+       },
+       "helper to execute a path (typically fine resolution, from KOMO or RRT) with time-optimal (non-uniform) knot times for given max vel/acc "
+       "(and optionally jerk, if >0); returns the knot times, the duration and the saving relative to equal time spacing (see bot/autoTiming)",
        pybind11::arg("path"),
        pybind11::arg("maxVel") =  1.,
-       pybind11::arg("maxAcc") =  1.)
+       pybind11::arg("maxAcc") =  1.,
+       pybind11::arg("maxJerk") =  -1.)
 
   .def("moveTo", &BotOp::moveTo,
        "helper to move to a single joint vector target, where timing is chosen optimally based on the given timing cost"
@@ -82,8 +96,51 @@ void init_BotOp(pybind11::module& m) {
        pybind11::arg("J"),
        pybind11::arg("compliance") = .5)
 
+  .def("getLoopStats", [](std::shared_ptr<BotOp>& self, bool reset){
+         auto summary = [](const rai::LoopStats::Summary& S){
+           pybind11::dict D;
+           D["count"] = S.count;
+           D["mean"] = S.mean;
+           D["p50"] = S.p50;
+           D["p90"] = S.p90;
+           D["p99"] = S.p99;
+           D["p999"] = S.p999;
+           D["max"] = S.max;
+           return D;
+         };
+         pybind11::dict D;
+         for(const rai::LoopStats::Report& R:self->getLoopStats(reset)){
+           pybind11::dict L;
+           L["period"] = R.period;
+           L["ticks"] = R.ticks;
+           L["overruns"] = R.overruns;
+           L["late"] = R.late;
+           L["stalls"] = R.stalls;
+           L["interval"] = summary(R.interval);
+           L["compute"] = summary(R.compute);
+           L["refEval"] = summary(R.refEval);
+           D[R.name.p] = L;
+         }
+         return D;
+       },
+       "timing of the control threads since start (or last reset): per thread a dict with tick interval, compute time and reference evaluation time [sec] (count, mean, p50, p90, p99, p999, max), and counters of overruns (compute > period), late ticks (interval > 1.5 period) and stalls",
+       pybind11::arg("reset") = false)
+
+  .def("getStartupTimings", [](std::shared_ptr<BotOp>& self){
+         pybind11::dict D;
+         for(const BotStartupTiming& t:self->startupTimings){
+           pybind11::dict T;
+           T["seconds"] = t.seconds;
+           T["ok"] = t.ok;
+           T["error"] = t.error.p;
+           D[t.device.p] = T;
+         }
+         return D;
+       },
+       "per-device bring-up time of the constructor (devices start concurrently; see bot/startupTimeout and bot/cameras)")
+
   .def("setControllerWriteData", &BotOp::setControllerWriteData,
-       "[for internal debugging only] triggers writing control data into a file")
+       "[for internal debugging only] triggers writing control data into binary files z.<robot>.log (1: ctrlTime, q, q_ref; 2: + velocities, torques, dynamics; 3: + mass matrix) -- read them with loadDataLog")
 
   .def("gripperMove", &BotOp::gripperMove,
        "move the gripper to width (default: open)",
@@ -127,6 +184,50 @@ void init_BotOp(pybind11::module& m) {
        "returns image and depth from a camera sensor",
        pybind11::arg("sensorName"))
 
+  .def("getFrame",  [](std::shared_ptr<BotOp>& self, const char* sensorName, uint64_t after, double timeout) -> pybind11::object {
+         rai::CameraFrame F;
+         if(!self->getFrame(F, sensorName, after, timeout)) return pybind11::none();
+         floatA depth;
+         if(F.depth) depth = *F.depth;
+         else if(F.depthRaw){ depth.resize(F.depthRaw->d0, F.depthRaw->d1); rai::convertZ16ToMeters(depth.p, F.depthRaw->p, depth.N, F.depthScale); }
+         pybind11::dict D;
+         D["count"] = F.count;
+         D["deviceTime"] = F.deviceTime;
+         D["hostTime"] = F.hostTime;
+         D["deviceTimeIsHost"] = F.deviceTimeIsHost;
+         D["image"] = F.image ? Array2numpy<byte>(*F.image) : Array2numpy<byte>(byteA());
+         D["depth"] = Array2numpy<float>(depth);
+         if(F.segmentation) D["segmentation"] = Array2numpy<uint>(*F.segmentation);
+         return std::move(D); },
+       "timestamped frame from a camera sensor as dict (count, deviceTime, hostTime, deviceTimeIsHost, image, depth, and segmentation -- frame IDs -- in simulation with botsim/segmentation), or None: only frames with count > after; timeout<0 returns immediately, otherwise waits up to timeout [sec] for the next frame",
+       pybind11::arg("sensorName"),
+       pybind11::arg("after") = 0,
+       pybind11::arg("timeout") = -1.)
+
+  .def("getFrameStats",  [](std::shared_ptr<BotOp>& self, const char* sensorName) {
+         auto summary = [](const rai::LoopStats::Summary& S){
+           pybind11::dict L;
+           L["count"] = S.count;
+           L["mean"] = S.mean;
+           L["p50"] = S.p50;
+           L["p90"] = S.p90;
+           L["p99"] = S.p99;
+           L["max"] = S.max;
+           return L;
+         };
+         rai::CameraFrameStats S = self->getFrameStats(sensorName);
+         pybind11::dict D;
+         D["frames"] = S.frames;
+         D["dropped"] = S.dropped;
+         D["skipped"] = S.skipped;
+         D["stale"] = S.stale;
+         D["latency"] = summary(S.latency);
+         D["render"] = summary(S.render);
+         D["stateAge"] = summary(S.stateAge);
+         return D; },
+       "frame counters of a camera sensor: frames published, dropped by the device, skipped and stale reads by consumers, capture-to-host latency, and (simulation) render time and age of the rendered state [sec]",
+       pybind11::arg("sensorName"))
+
   .def("getImageDepthPcl",  [](std::shared_ptr<BotOp>& self, const char* sensorName, bool globalCoordinates) {
          byteA img;
          floatA depth;
@@ -139,6 +240,20 @@ void init_BotOp(pybind11::module& m) {
        pybind11::arg("sensorName"),
        pybind11::arg("globalCoordinates") = false)
 
+  .def("getPointCloud",  [](std::shared_ptr<BotOp>& self, const char* sensorName, bool globalCoordinates, const std::vector<uint>& roi, uint stride) {
+         uintA box;
+         for(uint i:roi) box.append(i);
+         arr pts;
+         byteA colors;
+         self->getPointCloud(pts, colors, sensorName, globalCoordinates, box, stride);
+         return pybind11::make_tuple(Array2numpy<double>(pts),
+                                     Array2numpy<byte>(colors)); },
+       "returns the point cloud and its colors (rows x cols x 3 each) of the region roi=[u0, v0, u1, v1] (empty: whole image), every stride-th pixel -- back-projected with the camera's full intrinsics (incl. distortion) where known",
+       pybind11::arg("sensorName"),
+       pybind11::arg("globalCoordinates") = false,
+       pybind11::arg("roi") = std::vector<uint>(),
+       pybind11::arg("stride") = 1)
+
   .def("sync", &BotOp::sync,
        "sync your workspace configuration C with the robot state",
        pybind11::arg("C"),
@@ -152,6 +267,13 @@ void init_BotOp(pybind11::module& m) {
        pybind11::arg("forTimeToEnd") = true,
        pybind11::arg("forGripper") = false)
 
+  .def("step", &BotOp::step,
+       "lockstep simulation (botsim/lockstep): advance the simulation by dt (in multiples of botsim/tau) -- otherwise: sleep for dt",
+       pybind11::arg("dt"))
+
+  .def("isLockstep", &BotOp::isLockstep,
+       "true if this is a lockstep simulation (time advances only with step and wait)")
+
   .def("home", &BotOp::home,
        "immediately drive the robot home (see get_qHome); keeps argument C synced; same as moveTo(qHome, 1., True); wait(C);",
        pybind11::arg("C"))
@@ -166,6 +288,84 @@ void init_BotOp(pybind11::module& m) {
        pybind11::arg("damping") = true)
   ;
 
+  //-- numpy views onto BatchSim's state buffers (no copy; valid until the next step)
+  auto batchView = [](arr& x, pybind11::handle base){
+    return pybind11::array_t<double>({x.d0, x.d1}, {x.d1*sizeof(double), sizeof(double)}, x.p, base);
+  };
+  typedef pybind11::array_t<double, pybind11::array::c_style | pybind11::array::forcecast> BatchArray;
+  auto batchArg = [](const BatchArray& x, uint d0, uint d1){ //refers to x's buffer -- x needs to outlive the returned arr
+    CHECK(x, "argument is not convertible to a float64 array");
+    CHECK(x.ndim()==2 && (uint)x.shape(0)==d0 && (uint)x.shape(1)==d1, "argument needs to be (N x dof) = (" <<d0 <<" x " <<d1 <<")");
+    arr y;
+    y.referTo(x.data(), x.size());
+    y.reshape(d0, d1);
+    return y;
+  };
+
+  pybind11::class_<BatchSim, shared_ptr<BatchSim>>(m, "BatchSim", "N independent simulations of a configuration, stepped in lockstep on a worker pool without wall-clock pacing")
+
+  .def(pybind11::init<const rai::Configuration&, uint, double, uint, const char*>(),
+       "constructor",
+       pybind11::arg("C"),
+       pybind11::arg("N"),
+       pybind11::arg("tau") = -1.,
+       pybind11::arg("threads") = 0,
+       pybind11::arg("engine") = nullptr)
+
+  .def("step", [batchView, batchArg](std::shared_ptr<BatchSim>& self, pybind11::object q_ref, pybind11::object qDot_ref){
+         pybind11::handle base = pybind11::cast(self);
+         if(q_ref.is_none()){
+           pybind11::gil_scoped_release release;
+           self->step();
+         }else{
+           BatchArray q_buf = BatchArray::ensure(q_ref), qDot_buf = BatchArray::ensure(qDot_ref);
+           arr q = batchArg(q_buf, self->N, self->dof);
+           arr qDot = batchArg(qDot_buf, self->N, self->dof);
+           pybind11::gil_scoped_release release;
+           self->step(q, qDot);
+         }
+         return pybind11::make_tuple(batchView(self->q, base), batchView(self->qDot, base));
+       },
+       "step all instances with (N x dof) position and velocity references (or uncontrolled if None); returns (q, qDot) as (N x dof) views onto internal buffers that the next step overwrites",
+       pybind11::arg("q_ref") = pybind11::none(),
+       pybind11::arg("qDot_ref") = pybind11::none())
+
+  .def("get_q", [batchView](std::shared_ptr<BatchSim>& self){ return batchView(self->q, pybind11::cast(self)); },
+       "(N x dof) joint states (view, no copy)")
+
+  .def("get_qDot", [batchView](std::shared_ptr<BatchSim>& self){ return batchView(self->qDot, pybind11::cast(self)); },
+       "(N x dof) joint velocities (view, no copy)")
+
+  .def("setJointStates", &BatchSim::setJointStates,
+       "set the (N x dof) joint states of all instances",
+       pybind11::arg("q"))
+
+  .def("reset", &BatchSim::reset,
+       "reset all instances to the initial configuration")
+
+  .def("get_t", [](std::shared_ptr<BatchSim>& self){ return self->time; },
+       "simulated time")
+
+  .def("numThreads", &BatchSim::numThreads)
+  ;
+
+  m.def("loadDataLog", [](const char* filename){
+          StringA names;
+          uintA dims;
+          arr data;
+          rai::readDataLog(filename, names, dims, data);
+          pybind11::dict D;
+          uint col=0;
+          for(uint k=0;k<names.N;k++){
+            arr x(data.d0, dims(k));
+            for(uint t=0;t<data.d0;t++) for(uint i=0;i<dims(k);i++) x(t,i) = data(t, col+i);
+            col += dims(k);
+            D[names(k).p] = Array2numpy<double>(x);
+          }
+          return D;
+        },
+        "load a control data log (written with setControllerWriteData) as dict of field name -> [T, dim] arrays",
+        pybind11::arg("filename"));
 }
 
 #endif
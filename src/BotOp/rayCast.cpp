@@ -0,0 +1,350 @@
+#include "rayCast.h"
+
+#include <Kin/kin.h>
+#include <Kin/frame.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rai {
+
+//-- row-major rotation of a quaternion (w, x, y, z)
+static void quatToMatrix(float* R, const double* q){
+  double w=q[0], x=q[1], y=q[2], z=q[3];
+  double n = w*w + x*x + y*y + z*z;
+  double s = n>0. ? 2./n : 0.;
+  R[0] = 1.-s*(y*y+z*z);  R[1] = s*(x*y-w*z);     R[2] = s*(x*z+w*y);
+  R[3] = s*(x*y+w*z);     R[4] = 1.-s*(x*x+z*z);  R[5] = s*(y*z-w*x);
+  R[6] = s*(x*z-w*y);     R[7] = s*(y*z+w*x);     R[8] = 1.-s*(x*x+y*y);
+}
+
+static inline void cross(float* c, const float* a, const float* b){
+  c[0] = a[1]*b[2]-a[2]*b[1];
+  c[1] = a[2]*b[0]-a[0]*b[2];
+  c[2] = a[0]*b[1]-a[1]*b[0];
+}
+
+static inline float dot(const float* a, const float* b){ return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+
+static uint rayCastThreads(uint nThreads){
+  if(!nThreads) nThreads = rai::getParameter<int>("botsim/rayCastThreads", 0);
+  if(!nThreads) nThreads = std::thread::hardware_concurrency();
+  return nThreads;
+}
+
+RayCastRenderer::RayCastRenderer(uint nThreads)
+  : pool(rayCastThreads(nThreads)){
+}
+
+//===========================================================================
+
+void RayCastRenderer::clear(){
+  meshes.clear();
+  instances.clear();
+}
+
+void RayCastRenderer::setScene(const rai::Configuration& C){
+  clear();
+  for(rai::Frame *f:C.frames){
+    if(!f->shape || f->shape->type()==rai::ST_marker) continue;
+    rai::Mesh& M = f->shape->mesh();
+    if(!M.T.N) continue;
+    addMesh(f->ID, M.V, M.T, M.C);
+    const rai::Transformation& X = f->ensure_X();
+    double x[7] = {X.pos.x, X.pos.y, X.pos.z, X.rot.w, X.rot.x, X.rot.y, X.rot.z};
+    Instance& inst = instances.back();
+    quatToMatrix(inst.R, x+3);
+    for(uint i=0;i<3;i++) inst.t[i] = x[i];
+  }
+}
+
+void RayCastRenderer::addMesh(uint frameID, const arr& V, const uintA& T, const arr& color){
+  CHECK(V.nd==2 && V.d1==3 && T.nd==2 && T.d1==3, "mesh needs vertices (n x 3) and triangles (m x 3)");
+  meshes.emplace_back();
+  Mesh& M = meshes.back();
+  M.tris.resize(T.d0, 12);
+  float *t = M.tris.p;
+  for(uint i=0;i<T.d0;i++, t+=12){
+    const double *a = V.p+3*T(i, 0), *b = V.p+3*T(i, 1), *c = V.p+3*T(i, 2);
+    for(uint j=0;j<3;j++){ t[j] = a[j];  t[3+j] = b[j]-a[j];  t[6+j] = c[j]-a[j]; }
+    cross(t+9, t+3, t+6);
+    float n = sqrt(dot(t+9, t+9));
+    if(n>0.f) for(uint j=0;j<3;j++) t[9+j] /= n;
+  }
+  buildBVH(M);
+
+  Instance inst;
+  inst.frame = frameID;
+  inst.mesh = meshes.size()-1;
+  for(uint i=0;i<3;i++) inst.color[i] = .8f; //as rai's default shape color
+  if(color.N>=3) for(uint i=0;i<3;i++) inst.color[i] = color.p[i]; //uniform (or the first vertex's) color
+  for(uint i=0;i<9;i++) inst.R[i] = (i%4==0);
+  for(uint i=0;i<3;i++){ inst.t[i] = 0.f;  inst.lo[i] = M.lo[i];  inst.hi[i] = M.hi[i]; }
+  instances.push_back(inst);
+}
+
+uint RayCastRenderer::numTriangles() const{
+  uint n=0;
+  for(const Instance& inst:instances) n += meshes[inst.mesh].tris.d0;
+  return n;
+}
+
+void RayCastRenderer::setFrameState(const arr& X){
+  for(Instance& inst:instances){
+    CHECK(X.nd==2 && X.d1==7 && inst.frame<X.d0, "frame state does not match the scene");
+    const double *x = X.p+7*inst.frame;
+    quatToMatrix(inst.R, x+3);
+    for(uint i=0;i<3;i++) inst.t[i] = x[i];
+  }
+}
+
+//===========================================================================
+
+void RayCastRenderer::buildBVH(Mesh& M){
+  //-- binned SAH over triangle centroids, at most 4 triangles per leaf
+  const uint n = M.tris.d0, bins=12, leafSize=4;
+  floatA box(n, 6); //per triangle: lo, hi
+  std::vector<uint> idx(n);
+  for(uint i=0;i<n;i++){
+    idx[i] = i;
+    const float *t = M.tris.p+12*i;
+    for(uint j=0;j<3;j++){
+      float a=t[j], b=t[j]+t[3+j], c=t[j]+t[6+j];
+      box(i, j) = std::min(a, std::min(b, c));
+      box(i, 3+j) = std::max(a, std::max(b, c));
+    }
+  }
+  auto bounds = [&](float* lo, float* hi, uint first, uint count){
+    for(uint j=0;j<3;j++){ lo[j]=1e30f; hi[j]=-1e30f; }
+    for(uint i=first;i<first+count;i++) for(uint j=0;j<3;j++){
+      lo[j] = std::min(lo[j], box(idx[i], j));
+      hi[j] = std::max(hi[j], box(idx[i], 3+j));
+    }
+  };
+  auto area = [](const float* lo, const float* hi){
+    float a=hi[0]-lo[0], b=hi[1]-lo[1], c=hi[2]-lo[2];
+    return a<0.f ? 0.f : a*b + b*c + c*a;
+  };
+
+  M.nodes.clear();
+  M.nodes.reserve(2*n/leafSize+1);
+  M.nodes.push_back(Node{{}, {}, 0, n});
+  bounds(M.nodes[0].lo, M.nodes[0].hi, 0, n);
+  for(uint j=0;j<3;j++){ M.lo[j] = n ? M.nodes[0].lo[j] : 0.f;  M.hi[j] = n ? M.nodes[0].hi[j] : 0.f; }
+  std::vector<std::pair<uint, uint>> stack = {{0, 0}}; //node, depth
+  while(stack.size()){
+    uint k = stack.back().first, depth = stack.back().second;
+    stack.pop_back();
+    uint first = M.nodes[k].first, count = M.nodes[k].count;
+    if(count<=leafSize || depth>=maxDepth) continue; //(a degenerate mesh can't exceed the traversal stack)
+
+    //-- centroid bounds, split axis
+    float clo[3]={1e30f, 1e30f, 1e30f}, chi[3]={-1e30f, -1e30f, -1e30f};
+    for(uint i=first;i<first+count;i++) for(uint j=0;j<3;j++){
+      float c = box(idx[i], j) + box(idx[i], 3+j);
+      clo[j] = std::min(clo[j], c);
+      chi[j] = std::max(chi[j], c);
+    }
+    uint axis=0;
+    for(uint j=1;j<3;j++) if(chi[j]-clo[j] > chi[axis]-clo[axis]) axis=j;
+    float extent = chi[axis]-clo[axis];
+    if(extent<=0.f) continue; //all centroids coincide: leaf
+
+    //-- bins along the axis, best split by surface area
+    struct Bin { float lo[3]={1e30f, 1e30f, 1e30f}, hi[3]={-1e30f, -1e30f, -1e30f}; uint count=0; } bin[bins];
+    auto binOf = [&](uint i){ return std::min(bins-1, uint(bins*(box(i, axis)+box(i, 3+axis)-clo[axis])/extent)); };
+    for(uint i=first;i<first+count;i++){
+      Bin& b = bin[binOf(idx[i])];
+      b.count++;
+      for(uint j=0;j<3;j++){ b.lo[j] = std::min(b.lo[j], box(idx[i], j));  b.hi[j] = std::max(b.hi[j], box(idx[i], 3+j)); }
+    }
+    float costRight[bins];
+    {
+      float lo[3]={1e30f, 1e30f, 1e30f}, hi[3]={-1e30f, -1e30f, -1e30f};
+      uint c=0;
+      for(uint s=bins-1;s>0;s--){
+        for(uint j=0;j<3;j++){ lo[j] = std::min(lo[j], bin[s].lo[j]);  hi[j] = std::max(hi[j], bin[s].hi[j]); }
+        c += bin[s].count;
+        costRight[s] = c*area(lo, hi);
+      }
+    }
+    float lo[3]={1e30f, 1e30f, 1e30f}, hi[3]={-1e30f, -1e30f, -1e30f};
+    uint c=0, split=0;
+    float best = count*area(M.nodes[k].lo, M.nodes[k].hi); //cost of a leaf
+    for(uint s=1;s<bins;s++){
+      for(uint j=0;j<3;j++){ lo[j] = std::min(lo[j], bin[s-1].lo[j]);  hi[j] = std::max(hi[j], bin[s-1].hi[j]); }
+      c += bin[s-1].count;
+      float cost = c*area(lo, hi) + costRight[s];
+      if(cost<best){ best=cost; split=s; }
+    }
+    if(!split) continue; //leaf
+
+    uint mid = std::partition(idx.begin()+first, idx.begin()+first+count, [&](uint i){ return binOf(i)<split; }) - idx.begin();
+    uint left = M.nodes.size();
+    M.nodes.push_back(Node{{}, {}, first, mid-first});
+    M.nodes.push_back(Node{{}, {}, mid, first+count-mid});
+    bounds(M.nodes[left].lo, M.nodes[left].hi, first, mid-first);
+    bounds(M.nodes[left+1].lo, M.nodes[left+1].hi, mid, first+count-mid);
+    M.nodes[k].first = left;
+    M.nodes[k].count = 0;
+    stack.push_back({left, depth+1});
+    stack.push_back({left+1, depth+1});
+  }
+
+  //-- triangles in leaf order
+  floatA tris(n, 12);
+  for(uint i=0;i<n;i++) memcpy(tris.p+12*i, M.tris.p+12*idx[i], 12*sizeof(float));
+  M.tris = tris;
+}
+
+//-- entry distance of a ray (origin o, inverse direction id) into a box, or a miss
+static inline bool hitBox(float& tEnter, const float* lo, const float* hi, const float* o, const float* id, float tMin, float tMax){
+  for(uint j=0;j<3;j++){
+    float t0 = (lo[j]-o[j])*id[j], t1 = (hi[j]-o[j])*id[j];
+    if(t0>t1) std::swap(t0, t1);
+    if(t0>tMin) tMin=t0;
+    if(t1<tMax) tMax=t1;
+    if(tMin>tMax) return false;
+  }
+  tEnter = tMin;
+  return true;
+}
+
+bool RayCastRenderer::castInstance(const Instance& inst, const float* o, const float* d, float tMin, float& tBest, float& shade) const{
+  const Mesh& M = meshes[inst.mesh];
+  if(!M.nodes.size()) return false;
+  //-- the ray in the frame's coordinates (same parameter t)
+  float ol[3], dl[3], id[3], p[3];
+  for(uint j=0;j<3;j++) p[j] = o[j]-inst.t[j];
+  for(uint j=0;j<3;j++){
+    ol[j] = inst.R[j]*p[0] + inst.R[3+j]*p[1] + inst.R[6+j]*p[2];
+    dl[j] = inst.R[j]*d[0] + inst.R[3+j]*d[1] + inst.R[6+j]*d[2];
+    id[j] = 1.f/dl[j];
+  }
+  bool hit=false;
+  const float *hitNormal=0;
+  uint stack[maxDepth+1], top=0; //(per level above at most one pending sibling, plus the two children)
+  float tEnter;
+  if(!hitBox(tEnter, M.nodes[0].lo, M.nodes[0].hi, ol, id, tMin, tBest)) return false;
+  stack[top++] = 0;
+  while(top){
+    const Node& N = M.nodes[stack[--top]];
+    if(N.count){
+      const float *t = M.tris.p+12*N.first;
+      for(uint i=0;i<N.count;i++, t+=12){ //Moeller-Trumbore, both sides
+        float q[3], s[3], r[3];
+        cross(q, dl, t+6);
+        float det = dot(t+3, q);
+        if(fabsf(det)<1e-12f) continue;
+        float inv = 1.f/det;
+        for(uint j=0;j<3;j++) s[j] = ol[j]-t[j];
+        float u = dot(s, q)*inv;
+        if(u<0.f || u>1.f) continue;
+        cross(r, s, t+3);
+        float v = dot(dl, r)*inv;
+        if(v<0.f || u+v>1.f) continue;
+        float tt = dot(t+6, r)*inv;
+        if(tt<tMin || tt>=tBest) continue;
+        tBest = tt;
+        hitNormal = t+9;
+        hit = true;
+      }
+      continue;
+    }
+    //-- children: the nearer one first
+    const Node &A = M.nodes[N.first], &B = M.nodes[N.first+1];
+    float ta, tb;
+    bool ha = hitBox(ta, A.lo, A.hi, ol, id, tMin, tBest);
+    bool hb = hitBox(tb, B.lo, B.hi, ol, id, tMin, tBest);
+    if(ha && hb){
+      if(ta<=tb){ stack[top++] = N.first+1;  stack[top++] = N.first; }
+      else{ stack[top++] = N.first;  stack[top++] = N.first+1; }
+    }else if(ha) stack[top++] = N.first;
+    else if(hb) stack[top++] = N.first+1;
+  }
+  if(hit) shade = .25f + .75f*fabsf(dot(hitNormal, dl))/sqrtf(dot(dl, dl));
+  return hit;
+}
+
+//===========================================================================
+
+void RayCastRenderer::render(floatA& depth, const Camera& cam, const double* pose, uintA* segmentation, byteA* image){
+  const int W=cam.I.width, H=cam.I.height;
+  const float fx=cam.I.fx, fy=cam.I.fy, cx=cam.I.cx, cy=cam.I.cy;
+  depth.resize(H, W);
+  if(segmentation) segmentation->resize(H, W);
+  if(image) image->resize(H, W, 3);
+  float Rc[9], pc[3];
+  quatToMatrix(Rc, pose+3);
+  for(uint j=0;j<3;j++) pc[j] = pose[j];
+
+  //-- candidate instances per tile: the image rectangle of each instance's box (all of it if the box reaches the near plane)
+  const int tilesX = (W+tileSize-1)/tileSize, tilesY = (H+tileSize-1)/tileSize;
+  tiles.resize(tilesX*tilesY);
+  for(auto& t:tiles) t.clear();
+  for(uint k=0;k<instances.size();k++){
+    const Instance& inst = instances[k];
+    float u0=1e30f, v0=1e30f, u1=-1e30f, v1=-1e30f;
+    bool full=false, beyond=true;
+    for(uint c=0;c<8;c++){
+      float l[3] = {c&1 ? inst.hi[0] : inst.lo[0], c&2 ? inst.hi[1] : inst.lo[1], c&4 ? inst.hi[2] : inst.lo[2]}, w[3], p[3];
+      for(uint j=0;j<3;j++) w[j] = inst.R[3*j]*l[0] + inst.R[3*j+1]*l[1] + inst.R[3*j+2]*l[2] + inst.t[j] - pc[j];
+      for(uint j=0;j<3;j++) p[j] = Rc[j]*w[0] + Rc[3+j]*w[1] + Rc[6+j]*w[2]; //camera coordinates
+      if(-p[2]<=cam.zFar) beyond=false;
+      if(-p[2]<cam.zNear){ full=true; continue; }
+      float u = fx*p[0]/-p[2] + cx, v = fy*-p[1]/-p[2] + cy;
+      u0=std::min(u0, u);  u1=std::max(u1, u);
+      v0=std::min(v0, v);  v1=std::max(v1, v);
+    }
+    if(beyond) continue;
+    int tx0=0, ty0=0, tx1=tilesX-1, ty1=tilesY-1;
+    if(!full){
+      if(u1<-.5f || v1<-.5f || u0>W-.5f || v0>H-.5f) continue;
+      tx0 = std::max(0, int(u0+.5f)/tileSize);  tx1 = std::min(tilesX-1, int(u1+.5f)/tileSize);
+      ty0 = std::max(0, int(v0+.5f)/tileSize);  ty1 = std::min(tilesY-1, int(v1+.5f)/tileSize);
+    }
+    for(int ty=ty0; ty<=ty1; ty++) for(int tx=tx0; tx<=tx1; tx++) tiles[ty*tilesX+tx].push_back(k);
+  }
+
+  //-- cast the tiles (dynamically distributed: their costs differ a lot)
+  nextTile = 0;
+  pool.run([&](uint){
+    for(;;){
+      uint k = nextTile++;
+      if(k>=tiles.size()) break;
+      const std::vector<uint>& cand = tiles[k];
+      int x0 = (k%tilesX)*tileSize, y0 = (k/tilesX)*tileSize;
+      for(int v=y0; v<std::min(y0+tileSize, H); v++) for(int u=x0; u<std::min(x0+tileSize, W); u++){
+        float dc[3] = {(u-cx)/fx, -(v-cy)/fy, -1.f}, d[3]; //camera ray with unit depth: its parameter is the depth
+        for(uint j=0;j<3;j++) d[j] = Rc[3*j]*dc[0] + Rc[3*j+1]*dc[1] + Rc[3*j+2]*dc[2];
+        float tBest = cam.zFar, shade=0.f;
+        int hit=-1;
+        for(uint i:cand) if(castInstance(instances[i], pc, d, cam.zNear, tBest, shade)) hit=i;
+        uint p = v*W+u;
+        depth.p[p] = hit<0 ? 0.f : tBest;
+        if(segmentation) segmentation->p[p] = hit<0 ? uint(-1) : instances[hit].frame;
+        if(image){
+          byte *c = image->p+3*p;
+          if(hit<0){ c[0]=c[1]=c[2]=255; continue; } //white background
+          for(uint j=0;j<3;j++) c[j] = byte(255.f*std::min(1.f, instances[hit].color[j]*shade) + .5f);
+        }
+      }
+    }
+  });
+}
+
+RayCastRenderer::Camera RayCastRenderer::sensorCamera(const rai::Frame& f){
+  Camera cam;
+  double width=640., height=360., focalLength=1.;
+  rai::Node *at=0;
+  if(f.ats){
+    if((at=f.ats->getNode("focalLength"))) focalLength=at->as<double>();
+    if((at=f.ats->getNode("width"))) width=at->as<double>();
+    if((at=f.ats->getNode("height"))) height=at->as<double>();
+    if((at=f.ats->getNode("zRange"))){ arr z=at->as<arr>(); cam.zNear=z(0); cam.zFar=z(1); }
+  }
+  cam.I = CameraIntrinsics(arr{focalLength*height, focalLength*height, .5*(width-1.), .5*(height-1.)}, width, height);
+  return cam;
+}
+
+} //namespace
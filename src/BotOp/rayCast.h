@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Core/array.h>
+#include <Utils/rayTable.h>
+#include <Utils/workerPool.h>
+
+#include <atomic>
+
+namespace rai { struct Configuration; struct Frame; }
+
+namespace rai {
+
+//===========================================================================
+//
+// CPU ray-casting renderer for simulated cameras without GL context (botsim/cameraEngine: raycast): depth, segmentation
+// (frame IDs) and a shaded color image of a configuration's shapes. Two levels: a BVH per shape mesh in the shape's
+// frame, built once in setScene -- per frame state only the world boxes of the shapes change; they are projected into
+// the image to give each tile of pixels its short list of candidate shapes. Tiles are cast on a worker pool.
+//
+// rai.cfg:
+//   botsim/cameraEngine: gl   (raycast: this renderer)
+//   botsim/rayCastThreads: 0  (0: all cores)
+//
+
+struct RayCastRenderer {
+  /// a pinhole camera with its clipping range
+  struct Camera {
+    CameraIntrinsics I;
+    double zNear=.01, zFar=10.;
+  };
+
+  RayCastRenderer(uint nThreads=0); ///< 0: botsim/rayCastThreads
+
+  /// (re)build the scene: one instance per frame with a shape mesh (markers excluded)
+  void setScene(const rai::Configuration& C);
+  /// add a mesh (vertices n x 3, triangles m x 3, in the frame's coordinates) attached to frame 'frameID', color in [0,1]
+  void addMesh(uint frameID, const arr& V, const uintA& T, const arr& color={});
+  void clear();
+
+  /// poses of all frames (frames x 7: position, quaternion wxyz -- as Configuration::getFrameState)
+  void setFrameState(const arr& X);
+
+  /// render from a camera at pose (position, quaternion wxyz), looking along -z with y up (as rai cameras): depth along
+  /// the view axis (0: nothing hit), segmentation the frame ID of the hit (-1: none), image the shaded shape colors
+  void render(floatA& depth, const Camera& cam, const double* pose, uintA* segmentation=0, byteA* image=0);
+
+  /// the camera of a sensor frame from its attributes (width, height, focalLength, zRange -- as rai's camera views)
+  static Camera sensorCamera(const rai::Frame& f);
+
+  uint numThreads() const{ return pool.numThreads(); }
+  uint numTriangles() const;
+
+private:
+  struct Node { float lo[3], hi[3]; uint first, count; }; //leaf: count triangles from first; inner (count=0): children first, first+1
+  static const uint maxDepth=62; //of a BVH (deeper nodes are leaves): the traversal stack holds at most maxDepth+1 nodes
+  struct Mesh {
+    floatA tris; //per triangle 12 floats: v0, v1-v0, v2-v0, unit normal
+    std::vector<Node> nodes;
+    float lo[3], hi[3]; //local box
+  };
+  struct Instance {
+    uint frame, mesh;
+    float color[3];
+    float R[9], t[3];   //world pose of the frame (R row-major)
+    float lo[3], hi[3]; //corners of the local box (for the projection)
+  };
+  std::vector<Mesh> meshes;
+  std::vector<Instance> instances;
+
+  //-- per render: candidate instances of each tile of pixels
+  static const int tileSize=16;
+  std::vector<std::vector<uint>> tiles;
+  std::atomic<uint> nextTile{0};
+
+  void buildBVH(Mesh& M);
+  bool castInstance(const Instance& inst, const float* o, const float* d, float tMin, float& tBest, float& shade) const;
+
+  WorkerPool pool;
+};
+
+} //namespace
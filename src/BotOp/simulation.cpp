@@ -3,25 +3,37 @@
 #include <Kin/frame.h>
 #include <Kin/F_collisions.h>
 #include <Kin/viewer.h>
+#include <Kin/cameraview.h>
+#include <Utils/configSignature.h>
 
 void naturalGains(double& Kp, double& Kd, double decayTime, double dampingRatio);
 
 BotThreadedSim::BotThreadedSim(const rai::Configuration& C,
                                const Var<rai::CtrlCmdMsg>& _cmd, const Var<rai::CtrlStateMsg>& _state,
                                const StringA& joints,
-                               double _tau, double hyperSpeed)
+                               double _tau, double hyperSpeed,
+                               const std::shared_ptr<rai::CtrlChannel>& _channel,
+                               int _lockstep)
   : RobotAbstraction(_cmd, _state),
     Thread("FrankaThread_Emulated"),
     simConfig(C),
-    tau(_tau){
+    tau(_tau),
+    channel(_channel),
+    jointNames(joints){
 
   //create a rai Simulator!
   int verbose = rai::getParameter<int>("botsim/verbose", 1);
   if(tau<0.) tau = rai::getParameter<double>("botsim/tau", .01);
   if(hyperSpeed<0.) hyperSpeed = rai::getParameter<double>("botsim/hyperSpeed", 1.);
+  lockstep = _lockstep<0 ? rai::getParameter<bool>("botsim/lockstep", false) : _lockstep>0;
   Thread::metronome.reset(tau/hyperSpeed);
+  loopStats.init("BotThreadedSim", tau/hyperSpeed); //wall-clock period
   rai::String engine = rai::getParameter<rai::String>("botsim/engine", "physx");
-  sim=make_shared<rai::Simulation>(simConfig, rai::Enum<rai::Simulation::Engine>(engine), verbose);
+  if(engine=="fastKinematic"){
+    if(verbose>0) LOG(0) <<"fast kinematic engine: references are tracked exactly, no collisions";
+  }else{
+    sim=make_shared<rai::Simulation>(simConfig, rai::Enum<rai::Simulation::Engine>(engine), verbose);
+  }
 
   {
     q_real = C.getJointState();
@@ -47,10 +59,24 @@ BotThreadedSim::BotThreadedSim(const rai::Configuration& C,
   }
   state.set()->q = q_real;
   state.set()->qDot = qDot_real;
+  if(channel){
+    channel->initWriter(0, q_indices);
+    channel->publishJoints(0, 0., q_indices, q_real, qDot_real);
+    cmdBuffer = make_shared<rai::CtrlChannel::CmdSlot>();
+  }
   //emuConfig.watch(false, STRING("EMULATION - initialization"));
   //emuConfig.gl()->update(0, true);
+  if(lockstep){
+    auto mux = stepMutex(RAI_HERE);
+    step(); //first tick publishes the state; then only stepLockstep advances the simulation
+    return;
+  }
   threadLoop();
-  state.waitForNextRevision(); //this is enough to ensure the ctrl loop is running
+  if(channel){
+    while(Thread::step_count<1) rai::wait(.001); //the state Var is not touched in wait-free mode
+  }else{
+    state.waitForNextRevision(); //this is enough to ensure the ctrl loop is running
+  }
 }
 
 BotThreadedSim::~BotThreadedSim(){
@@ -60,6 +86,163 @@ BotThreadedSim::~BotThreadedSim(){
   simConfig.view_close();
 }
 
+uint BotThreadedSim::stepLockstep(double dt){
+  CHECK(lockstep, "stepLockstep requires botsim/lockstep");
+  lockstepRemainder += dt;
+  uint n = uint(floor(lockstepRemainder/tau + 1e-6));
+  lockstepRemainder -= n*tau;
+  if(lockstepRemainder<0.) lockstepRemainder=0.;
+  auto mux = stepMutex(RAI_HERE);
+  for(uint i=0;i<n;i++) step();
+  return n;
+}
+
+void BotThreadedSim::subscribeSnapshots(bool on){
+  auto mux = stepMutex(RAI_HERE);
+  if(!on){ snapshotSubscribers--; return; }
+  if(!snapshotSubscribers++) publishSnapshot();
+}
+
+void BotThreadedSim::publishSnapshot(){
+  //-- the frame state, written into a pooled buffer (no allocation per step)
+  auto X = snapshotPool.acquire();
+  X->resize(simConfig.frames.N, 7);
+  double *x = X->p;
+  for(rai::Frame *f:simConfig.frames){
+    const rai::Transformation& T = f->ensure_X();
+    x[0]=T.pos.x;  x[1]=T.pos.y;  x[2]=T.pos.z;
+    x[3]=T.rot.w;  x[4]=T.rot.x;  x[5]=T.rot.y;  x[6]=T.rot.z;
+    x += 7;
+  }
+  Snapshot S;
+  S.ctrlTime = ctrlTime;
+  S.hostTime = rai::FrameSource::hostNow();
+  S.X = X;
+  S.structure = rai::structureSignature(simConfig);
+  std::lock_guard<std::mutex> lock(snapshotMux);
+  lastSnapshot = S;
+}
+
+std::shared_ptr<BotThreadedSim::State> BotThreadedSim::snapshot(){
+  auto mux = stepMutex(RAI_HERE);
+  auto S = make_shared<State>();
+  S->ctrlTime = ctrlTime;
+  S->q_real = q_real;
+  S->qDot_real = qDot_real;
+  if(sim) sim->getState(S->X, S->q, S->V, S->qDot);
+  else S->X = simConfig.getFrameState();
+  S->parents.resize(simConfig.frames.N);
+  for(rai::Frame *f:simConfig.frames) S->parents(f->ID) = f->parent ? int(f->parent->ID) : -1;
+  S->structure = rai::structureSignature(simConfig, false);
+  S->qInactive = simConfig.qInactive;
+  S->movingGrippers = movingGrippers;
+  for(const KinematicGripper& g:kinematicGrippers){
+    S->grippers.push_back({g.name, g.width, g.target, g.speed,
+                           g.grasped ? int(g.grasped->ID) : -1, g.graspedParent ? int(g.graspedParent->ID) : -1});
+  }
+  return S;
+}
+
+void BotThreadedSim::restore(const State& S){
+  auto mux = stepMutex(RAI_HERE);
+  CHECK_EQ(S.X.d0, simConfig.frames.N, "the state is of a different configuration");
+  CHECK_EQ(S.q_real.N, q_real.N, "the state is of a different configuration");
+  ctrlTime = S.ctrlTime;
+  q_real = S.q_real;
+  qDot_real = S.qDot_real;
+  lockstepRemainder = 0.;
+  movingGrippers = S.movingGrippers;
+  if(sim){
+    sim->setState(S.X, S.q, S.V, S.qDot);
+  }else{
+    //-- the kinematic tree as in the state (grasps are attaches): re-parent every frame whose parent differs -- also those
+    //   attached by earlier rollouts of this instance, or by the simulation it was copied from
+    CHECK_EQ(S.parents.N, simConfig.frames.N, "the state is of a different configuration");
+    FrameL moved;
+    for(rai::Frame *f:simConfig.frames){
+      int p = f->parent ? int(f->parent->ID) : -1;
+      if(p!=S.parents(f->ID)){ f->unLink(); moved.append(f); }
+    }
+    for(rai::Frame *f:moved) if(S.parents(f->ID)>=0) simConfig.attach(simConfig.frames(S.parents(f->ID))->name, f->name);
+    CHECK_EQ(simConfig.getJointStateDimension(), q_real.N, "restoring the kinematic tree changed the joint dimension");
+
+    //-- every gripper as in the state: listed ones with their motion and grasp, all others at rest
+    simConfig.qInactive = S.qInactive;
+    for(KinematicGripper& g:kinematicGrippers){
+      g.width = g.target = 2.*simConfig.qInactive(g.fingers(0)->joint->qIndex);
+      g.speed = 0.;
+      g.grasped = g.graspedParent = 0;
+    }
+    for(const State::Gripper& s:S.grippers){
+      KinematicGripper& g = kinematicGripper(s.name);
+      g.width = s.width;
+      g.target = s.target;
+      g.speed = s.speed;
+      g.grasped = s.grasped>=0 ? simConfig.frames(s.grasped) : 0;
+      g.graspedParent = s.graspedParent>=0 ? simConfig.frames(s.graspedParent) : 0;
+    }
+    for(KinematicGripper& g:kinematicGrippers) setFingers(g);
+
+    //-- then the exact poses
+    simConfig.setFrameState(S.X);
+    simConfig.setJointState(q_real);
+  }
+  if(snapshotSubscribers) publishSnapshot();
+}
+
+std::shared_ptr<BotThreadedSim> BotThreadedSim::fork(){
+  std::shared_ptr<State> S = snapshot(); //(taken under the stepMutex: also the structure the pool instance must match)
+  std::shared_ptr<BotThreadedSim> F;
+  {
+    std::lock_guard<std::mutex> lock(forkMux);
+    for(uint i=forkPool.size();i--;){
+      if(forkPool[i].use_count()>1) continue;
+      if(forkPool[i]->engineGripperCommanded.load(std::memory_order_acquire)){ forkPool.erase(forkPool.begin()+i); continue; } //(see restore)
+      if(forkPool[i]->forkStructure!=S->structure){ forkPool.erase(forkPool.begin()+i); continue; } //frames or shapes changed since
+      F = forkPool[i];
+      break;
+    }
+  }
+  if(!F){
+    F = buildFork();
+    std::lock_guard<std::mutex> lock(forkMux);
+    forkPool.push_back(F);
+  }
+  if(F->forkStructure!=S->structure) S = snapshot(); //(built after a change: the state of the structure it was built from)
+  F->restore(*S);
+  //-- the current command (a shared reference feed keeps its state shared)
+  rai::CtrlCmdMsg c;
+  {
+    auto mux = stepMutex(RAI_HERE);
+    if(channel) c = cmdLocal;
+    else c = cmd.get()();
+  }
+  F->cmd.set()() = c;
+  return F;
+}
+
+void BotThreadedSim::prepareForks(uint n){
+  for(uint i=0;i<n;i++){
+    auto F = buildFork();
+    std::lock_guard<std::mutex> lock(forkMux);
+    forkPool.push_back(F);
+  }
+}
+
+std::shared_ptr<BotThreadedSim> BotThreadedSim::buildFork(){
+  rai::Configuration C;
+  uint64_t structure;
+  {
+    auto mux = stepMutex(RAI_HERE);
+    C.copy(simConfig);
+    structure = rai::structureSignature(simConfig, false);
+  }
+  //the engine set-up runs without the stepMutex: the simulation keeps stepping meanwhile
+  auto F = make_shared<BotThreadedSim>(C, Var<rai::CtrlCmdMsg>(), Var<rai::CtrlStateMsg>(), jointNames, tau, -1., std::shared_ptr<rai::CtrlChannel>(), 1);
+  F->forkStructure = structure;
+  return F;
+}
+
 void BotThreadedSim::pullDynamicStates(rai::Configuration& C){
   auto mux = stepMutex(RAI_HERE);
   for(rai::Frame *f:C.frames){
@@ -73,13 +256,32 @@ void BotThreadedSim::pullDynamicStates(rai::Configuration& C){
   }
 }
 
+void BotThreadedSim::setDataLogLevel(int level){
+  writeData = level;
+  if(level<=0){ dataLog.pause(); return; } //(a later call with the same level continues the file)
+  if(dataLog.resume(level)) return;
+  uint n = q_real.N;
+  StringA names = {"ctrlTime", "q", "q_ref"};
+  uintA dims = {1, n, n};
+  if(level>1){ names.append(StringA{"qDot", "qDot_ref"}); dims.append(uintA{n, n}); }
+  dataLog.set(0); //close the previous log (and its file) before opening the same file again
+  auto log = make_shared<rai::DataLogger>("z.panda.log", names, dims);
+  log->level = level;
+  dataLog.set(log);
+}
+
 void BotThreadedSim::step(){
+  loopStats.tickBegin();
+
   //-- get real time
   ctrlTime += tau;
   //  ctrlTime = rai::realTime();
 
   //-- publish state
-  {
+  if(channel){ //wait-free: no lock shared with user threads
+    channel->ctrlTime.store(ctrlTime);
+    channel->publishJoints(0, ctrlTime, q_indices, q_real, qDot_real);
+  }else{
     arr tauExternal;
     tauExternal = zeros(q_real.N);
     auto stateSet = state.set();
@@ -94,6 +296,8 @@ void BotThreadedSim::step(){
     }
   }
 
+  tickEvents(ctrlTime); //wakes BotOp::wait when the motion ends
+
   //-- publish to sim_config
 //  {
 //    sim_config.set()->setJointState(q);
@@ -101,31 +305,56 @@ void BotThreadedSim::step(){
 
   //-- get current ctrl
   arr cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, KpRef, KdRef, P_compliance; // TODO Kp, Kd, u_b and also read out the correct indices
-  {
-    auto cmdGet = cmd.get();
-
-    if(!cmdGet->ref){
+  auto getCmd = [&](const rai::CtrlCmdMsg& c){
+    if(!c.ref){
       cmd_q_ref = q_real;
       cmd_qDot_ref.resize(q_real.N).setZero();
       cmd_qDDot_ref.resize(q_real.N).setZero();
     }else{
       //get the reference from the callback (e.g., sampling a spline reference)
-      cmdGet->ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, q_real, qDot_real, ctrlTime);
+      loopStats.refBegin();
+      c.ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, q_real, qDot_real, ctrlTime);
+      loopStats.refEnd();
     }
 
-    KpRef = cmdGet->Kp;
-    KdRef = cmdGet->Kd;
-    P_compliance = cmdGet->P_compliance;
+    KpRef = c.Kp;
+    KdRef = c.Kd;
+    P_compliance = c.P_compliance;
+  };
+  if(channel){
+    channel->pullCmd(cmdLocal, cmdRevision, *cmdBuffer); //copies only when the command changed
+    getCmd(cmdLocal);
+  }else{
+    auto cmdGet = cmd.get();
+    getCmd(cmdGet());
   }
 
-  if(cmd_q_ref.N && cmd_qDot_ref.N){
+  if(!sim){ //fast kinematic engine: the references directly, only the grippers move on their own
+    if(cmd_q_ref.N==q_real.N) q_real = cmd_q_ref;
+    for(KinematicGripper& g:kinematicGrippers) if(g.width!=g.target){
+      double dw = g.speed>0. ? g.speed*tau : fabs(g.target-g.width);
+      if(fabs(g.target-g.width)<=dw) g.width = g.target;
+      else g.width += g.target>g.width ? dw : -dw;
+      setFingers(g);
+    }
+    simConfig.setJointState(q_real);
+  }else if(cmd_q_ref.N && cmd_qDot_ref.N){
     sim->step((cmd_q_ref, cmd_qDot_ref), tau, sim->_posVel);
+    q_real = simConfig.getJointState();
   }else{
     sim->step({}, tau, sim->_none);
+    q_real = simConfig.getJointState();
   }
-  q_real = simConfig.getJointState();
   if(cmd_qDot_ref.N==qDot_real.N) qDot_real = cmd_qDot_ref;
 
+  //-- signal grippers that finished
+  for(uint i=movingGrippers.N;i--;){
+    if(gripperIsDone(movingGrippers(i))){
+      movingGrippers.remove(i);
+      notifyEvents();
+    }
+  }
+
   //-- add other crazy perturbations?
 //  if((step_count%1000)<100) q_real(0) = .1;
 
@@ -149,52 +378,295 @@ void BotThreadedSim::step(){
   }
 #endif
 
-  //-- data log?
-  if(writeData>0 && !(step_count%1)){
-    if(!dataFile.is_open()) dataFile.open("z.panda.dat");
-    dataFile <<ctrlTime <<' '; //single number
-    q_real.modRaw().write(dataFile); //7
-    cmd_q_ref.modRaw().write(dataFile); //7
-    if(writeData>1){
-      qDot_real.modRaw().write(dataFile); //7
-      cmd_qDot_ref.modRaw().write(dataFile); //7
-      //qDDot_des.modRaw().write(dataFile); //7
-      //cmd_qDDot_ref.modRaw().write(dataFile);
-    }
-    if(writeData>2){
+  //-- data log? (built by setDataLogLevel on the user thread, written asynchronously by the DataLogger thread)
+  {
+    rai::DataLogHandoff::Use log(dataLog);
+    if(log.log){
+      rai::DataLogger::Record rec(*log.log);
+      rec(ctrlTime)(q_real, q_real.N)(cmd_q_ref, q_real.N);
+      if(log.log->level>1) rec(qDot_real, q_real.N)(cmd_qDot_ref, q_real.N);
     }
-    dataFile <<endl;
   }
+
+  //-- snapshot for the camera render threads
+  if(snapshotSubscribers) publishSnapshot();
+
+  loopStats.tickEnd();
 }
 
+BotThreadedSim::KinematicGripper& BotThreadedSim::kinematicGripper(const char* name){
+  for(KinematicGripper& g:kinematicGrippers) if(g.name==name) return g;
+  rai::Frame *frame = simConfig.getFrame(name, false);
+  CHECK(frame, "gripper frame '" <<name <<"' does not exist in the simulation");
+  kinematicGrippers.emplace_back();
+  KinematicGripper& g = kinematicGrippers.back();
+  g.name = name;
+  g.frame = frame;
+  //the fingers: inactive 1D joints (as in pullDynamicStates) in the subtree of the gripper's nearest ancestor that has some
+  for(rai::Frame *f=frame; f && !g.fingers.N; f=f->parent){
+    FrameL subtree;
+    f->getSubtree(subtree);
+    for(rai::Frame *s:subtree) if(s->joint && !s->joint->active && s->joint->dim==1) g.fingers.append(s);
+  }
+  CHECK(g.fingers.N, "gripper '" <<name <<"' has no finger joints");
+  g.width = g.target = 2.*simConfig.qInactive(g.fingers(0)->joint->qIndex);
+  return g;
+}
+
+void BotThreadedSim::setFingers(KinematicGripper& g){
+  for(rai::Frame *f:g.fingers){
+    simConfig.qInactive(f->joint->qIndex) = .5*g.width;
+    f->joint->setDofs(simConfig.qInactive, f->joint->qIndex);
+  }
+}
+
+void BotThreadedSim::release(KinematicGripper& g){
+  if(!g.grasped) return;
+  if(g.graspedParent) simConfig.attach(g.graspedParent->name, g.grasped->name);
+  else{
+    rai::Transformation X = g.grasped->ensure_X();
+    g.grasped->unLink();
+    g.grasped->set_X() = X;
+  }
+  g.grasped = g.graspedParent = 0;
+}
+
+void BotThreadedSim::moveGripper(const char* gripper, double width, double speed, bool closing){
+  movingGrippers.setAppend(gripper);
+  if(sim){
+    engineGripperCommanded.store(true, std::memory_order_release);
+    if(closing) sim->closeGripper(gripper, width, speed);
+    else sim->moveGripper(gripper, width, speed);
+    return;
+  }
+  KinematicGripper& g = kinematicGripper(gripper);
+  if(!closing) release(g);
+  g.target = width;
+  g.speed = speed;
+}
+
+void BotThreadedSim::closeGripperGrasp(const char* gripper, const char* objName){
+  movingGrippers.setAppend(gripper);
+  if(sim){
+    engineGripperCommanded.store(true, std::memory_order_release);
+    sim->closeGripperGrasp(gripper, objName);
+    return;
+  }
+  KinematicGripper& g = kinematicGripper(gripper);
+  rai::Frame *obj = simConfig.getFrame(objName, false);
+  CHECK(obj, "object '" <<objName <<"' does not exist in the simulation");
+  obj = obj->getUpwardLink();
+  release(g);
+  g.graspedParent = obj->parent;
+  simConfig.attach(g.frame->name, obj->name);
+  CHECK_EQ(simConfig.getJointStateDimension(), q_real.N, "grasping '" <<objName <<"' changed the joint dimension (a free joint?)");
+  g.grasped = obj;
+  g.target = g.width; //the fingers stay at the object
+}
+
+double BotThreadedSim::getGripperWidth(const char* gripper){
+  if(sim) return sim->getGripperWidth(gripper);
+  return kinematicGripper(gripper).width;
+}
+
+bool BotThreadedSim::gripperIsDone(const char* gripper){
+  if(sim) return sim->gripperIsDone(gripper);
+  KinematicGripper& g = kinematicGripper(gripper);
+  return g.width==g.target;
+}
+
+//===========================================================================
+
 void GripperSim::open(double width, double speed) {
   auto mux = simthread->stepMutex(RAI_HERE);
-  simthread->sim->moveGripper(gripperName, width, speed);
+  simthread->moveGripper(gripperName, width, speed);
   q=width;
   isClosing=false; isOpening=true;
 }
 
 void GripperSim::close(double force, double width, double speed) {
   auto mux = simthread->stepMutex(RAI_HERE);
-  simthread->sim->closeGripper(gripperName, width, speed);
+  simthread->moveGripper(gripperName, width, speed, true);
   q=width;
   isOpening=false; isClosing=true;
 }
 
 void GripperSim::closeGrasp(const char* objName, double force, double width, double speed){
   auto mux = simthread->stepMutex(RAI_HERE);
-  simthread->sim->closeGripperGrasp(gripperName, objName);
-//  simthread->sim->attach(gripperName, objName);
+  simthread->closeGripperGrasp(gripperName, objName);
   q=width;
   isOpening=false; isClosing=true;
 }
 
 double GripperSim::pos(){
   auto mux = simthread->stepMutex(RAI_HERE);
-  return simthread->sim->getGripperWidth(gripperName);
+  return simthread->getGripperWidth(gripperName);
 }
 
 bool GripperSim::isDone(){
   auto mux = simthread->stepMutex(RAI_HERE);
-  return simthread->sim->gripperIsDone(gripperName);
+  return simthread->gripperIsDone(gripperName);
+}
+
+//===========================================================================
+
+SimRenderer::SimRenderer(BotThreadedSim& _sim)
+  : Thread("SimRenderer", 1./rai::getParameter<double>("botsim/cameraFps", 30.)),
+    sim(_sim){
+  segmentation = rai::getParameter<bool>("botsim/segmentation", false);
+  rai::String engine = rai::getParameter<rai::String>("botsim/cameraEngine", "gl");
+  if(engine=="raycast") rayCaster = make_shared<rai::RayCastRenderer>();
+  else CHECK(engine=="gl", "botsim/cameraEngine '" <<engine <<"' unknown (gl or raycast)");
+  {
+    auto mux = sim.stepMutex(RAI_HERE);
+    renderC.copy(sim.simConfig);
+    structure = rai::structureSignature(sim.simConfig);
+  }
+  createView();
+  sim.subscribeSnapshots(true);
+  threadLoop();
+}
+
+SimRenderer::~SimRenderer(){
+  threadClose();
+  sim.subscribeSnapshots(false);
+}
+
+uint SimRenderer::addSensor(const char* name, const Publish& publish, arr& fxycxy){
+  std::lock_guard<std::mutex> lock(renderMux);
+  sensors.emplace_back();
+  Sensor& s = sensors.back();
+  s.name = name;
+  s.publish = publish;
+  rai::Frame *f = renderC.getFrame(s.name, false);
+  CHECK(f, "camera frame '" <<s.name <<"' does not exist in the simulation");
+  s.frame = f->ID;
+  if(rayCaster){
+    s.camera = rai::RayCastRenderer::sensorCamera(*f);
+    fxycxy = arr{s.camera.I.fx, s.camera.I.fy, s.camera.I.cx, s.camera.I.cy};
+  }else{
+    view->addSensor(s.name);
+    view->selectSensor(s.name);
+    fxycxy = view->currentSensor->getFxycxy();
+  }
+  return sensors.size()-1;
+}
+
+void SimRenderer::removeSensor(uint id){
+  std::lock_guard<std::mutex> lock(renderMux);
+  sensors[id].publish = Publish();
+}
+
+void SimRenderer::step(){
+  //-- render only when the simulation advanced (or a sensor was added since)
+  BotThreadedSim::Snapshot S = sim.getSnapshot();
+  if(!S.X) return;
+  std::lock_guard<std::mutex> lock(renderMux);
+  bool due=false;
+  for(Sensor& s:sensors) if(s.publish && s.renderedTime<S.ctrlTime) due=true;
+  if(!due) return;
+  if(S.structure!=structure){ //frames were added, removed, re-parented or got new shapes -> fresh copy (the only time this thread locks the simulation)
+    {
+      auto mux = sim.stepMutex(RAI_HERE);
+      renderC.clear();
+      renderC.copy(sim.simConfig);
+      structure = rai::structureSignature(sim.simConfig);
+    }
+    createView();
+    if(S.structure!=structure) return; //the snapshot predates the change
+  }
+
+  //-- the scene once for all sensors
+  double t0 = rai::FrameSource::hostNow();
+  if(rayCaster) rayCaster->setFrameState(*S.X);
+  else{
+    renderC.setFrameState(*S.X);
+    view->updateConfiguration(renderC);
+  }
+
+  //-- each sensor draws it from its pose
+  for(Sensor& s:sensors){
+    if(!s.publish || s.renderedTime>=S.ctrlTime) continue;
+    auto image = s.imagePool.acquire();
+    auto depth = s.depthPool.acquire();
+    rai::CameraFrame F;
+    if(rayCaster){
+      std::shared_ptr<uintA> seg;
+      if(segmentation) seg = make_shared<uintA>();
+      rayCaster->render(*depth, s.camera, S.X->p+7*s.frame, seg.get(), image.get());
+      F.segmentation = seg;
+    }else{
+      view->selectSensor(s.name);
+      view->computeImageAndDepth(*image, *depth);
+      if(segmentation) F.segmentation = make_shared<uintA>(view->computeSegmentationID());
+    }
+    F.image = image;
+    F.depth = depth;
+    F.deviceTime = S.ctrlTime;
+    s.renderedTime = S.ctrlTime;
+    double t1 = rai::FrameSource::hostNow();
+    s.publish(F, t1-t0, t1-S.hostTime); //the first sensor's render time includes the scene update
+    t0 = t1;
+  }
+}
+
+void SimRenderer::createView(){
+  if(rayCaster){ rayCaster->setScene(renderC); return; }
+  view = make_shared<rai::CameraView>(renderC, true);
+  for(Sensor& s:sensors) if(s.publish) view->addSensor(s.name);
+}
+
+void SimRenderer::close(){
+  view.reset();
+  rayCaster.reset();
+}
+
+std::shared_ptr<SimRenderer> BotThreadedSim::getRenderer(){
+  std::lock_guard<std::mutex> lock(rendererMux);
+  std::shared_ptr<SimRenderer> r = renderer.lock();
+  if(!r){
+    r = make_shared<SimRenderer>(*this);
+    renderer = r;
+  }
+  return r;
+}
+
+//===========================================================================
+
+CameraSim::CameraSim(const std::shared_ptr<BotThreadedSim>& _sim, const char* sensorName)
+  : simthread(_sim){
+  CameraAbstraction::name = sensorName;
+  {
+    auto mux = simthread->stepMutex(RAI_HERE);
+    rai::Frame *f = simthread->simConfig.getFrame(CameraAbstraction::name, false);
+    CHECK(f, "camera frame '" <<CameraAbstraction::name <<"' does not exist in the simulation");
+    sensorFrame = f->ID;
+  }
+  renderer = simthread->getRenderer();
+  sensorID = renderer->addSensor(CameraAbstraction::name, [this](rai::CameraFrame& F, double renderTime, double stateAge){
+    recordRender(renderTime, stateAge);
+    publishFrame(F);
+  }, fxycxy);
+}
+
+CameraSim::~CameraSim(){
+  renderer->removeSensor(sensorID);
+}
+
+void CameraSim::getImageAndDepth(byteA& image, floatA& depth){
+  double t = simthread->getSnapshot().ctrlTime;
+  rai::CameraFrame F;
+  getLatest(F);
+  while(F.deviceTime<t){
+    if(!waitNext(F, F.count, 1.)){ LOG(-1) <<"camera '" <<CameraAbstraction::name <<"': no image rendered within 1 sec"; break; }
+  }
+  if(F.image) image = *F.image;
+  if(F.depth) depth = *F.depth;
+}
+
+rai::Transformation CameraSim::getPose(){
+  BotThreadedSim::Snapshot S = simthread->getSnapshot();
+  rai::Transformation X;
+  X.set((*S.X)[sensorFrame]);
+  return X;
 }
@@ -3,17 +3,78 @@
 #include <Core/thread.h>
 #include <Control/CtrlMsgs.h>
 #include <Kin/simulation.h>
+#include <Utils/ctrlChannel.h>
+#include <Utils/dataLogger.h>
+#include <Utils/loopStats.h>
+#include <Utils/botEvents.h>
+#include <Utils/cameraFrames.h>
+#include <Utils/framePool.h>
+#include "rayCast.h"
 
-struct BotThreadedSim : rai::RobotAbstraction, Thread {
+#include <deque>
+#include <functional>
+
+namespace rai { struct CameraView; }
+struct SimRenderer;
+
+struct BotThreadedSim : rai::RobotAbstraction, Thread, rai::LoopStatsProvider, rai::BotEventSource, rai::DataLogSource {
   BotThreadedSim(const rai::Configuration& _sim_config,
                 const Var<rai::CtrlCmdMsg>& _cmd={}, const Var<rai::CtrlStateMsg>& _state={},
                 const StringA& joints={},
                 double _tau=-1,
-                double hyperSpeed=-1.);
+                double hyperSpeed=-1.,
+                const std::shared_ptr<rai::CtrlChannel>& _channel={},
+                int _lockstep=-1); //-1: botsim/lockstep
 
   ~BotThreadedSim();
 
   void pullDynamicStates(rai::Configuration& C);
+  void setDataLogLevel(int level);
+
+  //-- lockstep mode (botsim/lockstep): no thread, no metronome -- the simulation only advances in stepLockstep
+  bool lockstep=false;
+  uint stepLockstep(double dt); //advance by dt (in multiples of tau; remainders carry over), returns number of steps
+  double getTau() const{ return tau; }
+
+  //-- frame-state snapshots for renderers (CameraSim): published after every step while subscribed -- reading one never
+  //   takes the stepMutex
+  struct Snapshot {
+    double ctrlTime=-1.;
+    double hostTime=0.;                 ///< when it was taken (system clock, as CameraFrame::hostTime)
+    std::shared_ptr<const arr> X;       ///< frame state of the simulation (as getFrameState)
+    uint64_t structure=0;               ///< rai::structureSignature of the simulation's configuration
+  };
+  Snapshot getSnapshot(){ std::lock_guard<std::mutex> lock(snapshotMux); return lastSnapshot; }
+  void subscribeSnapshots(bool on); //the first subscriber also publishes one right away
+
+  /// the batched renderer of all simulated cameras (created with the first, closed with the last camera)
+  std::shared_ptr<SimRenderer> getRenderer();
+
+  //-- full simulation state for what-if rollouts: snapshot/restore on this simulation, fork to branch off it
+  struct State {
+    double ctrlTime=0.;
+    arr q_real, qDot_real;
+    arr X, q, V, qDot;  ///< engine state (as rai::Simulation::getState: frame poses and velocities, joint state)
+    intA parents;       ///< parent frame ID of each frame (-1: root) -- the kinematic tree, including grasps
+    arr qInactive;      ///< gripper fingers
+    StringA movingGrippers;
+    struct Gripper { rai::String name; double width, target, speed; int grasped, graspedParent; }; //frame IDs, -1: none
+    std::vector<Gripper> grippers; //(fast kinematic engine; grippers not listed are at rest at their qInactive width)
+    uint64_t structure=0; ///< rai::structureSignature (without the tree) of the simulation it was taken from
+  };
+  /// the current state (poses and velocities of all frames -- contacts are rebuilt by the engine after a restore)
+  std::shared_ptr<State> snapshot();
+  /// reset to a state of this simulation or one with the same configuration -- this also rewinds ctrlTime (physx: grasps
+  /// and gripper motions held by the engine are not part of the state -- a gripper commanded before the restore keeps
+  /// moving to its target)
+  void restore(const State& S);
+  /// a lockstep copy of this simulation in its current state, continuing the current command: forks come from a pool of
+  /// instances built from this simulation (the engine set-up, e.g. physx mesh cooking, happens once per pool instance),
+  /// so after prepareForks, or once a fork was released, forking is just a restore. With physx, a released fork that
+  /// commanded a gripper is dropped from the pool instead (see restore); gripper motions of this simulation itself are
+  /// not carried over into the fork
+  std::shared_ptr<BotThreadedSim> fork();
+  void prepareForks(uint n); ///< build n pool instances ahead of time
 
 private:
   rai::Configuration simConfig;
@@ -21,10 +82,54 @@ private:
   double ctrlTime = 0.;
   arr q_real, qDot_real;
   uintA q_indices;
-  ofstream dataFile;
   FrameL collisionPairs;
 
-  //two options: trivial double integrator model, or physical simulation
+  //wait-free state/cmd exchange (optional; otherwise the Vars state/cmd are used)
+  std::shared_ptr<rai::CtrlChannel> channel;
+  std::shared_ptr<rai::CtrlChannel::CmdSlot> cmdBuffer;
+  rai::CtrlCmdMsg cmdLocal;
+  uint cmdRevision=-1;
+
+  double lockstepRemainder=0.;
+  StringA movingGrippers; //grippers that were commanded and are not done yet (guarded by stepMutex)
+
+  std::mutex snapshotMux;
+  Snapshot lastSnapshot;
+  std::atomic<int> snapshotSubscribers{0};
+  rai::FramePool<double> snapshotPool;
+  void publishSnapshot(); //caller holds the stepMutex
+
+  std::mutex rendererMux;
+  std::weak_ptr<SimRenderer> renderer;
+
+  StringA jointNames;
+  std::mutex forkMux;
+  std::vector<std::shared_ptr<BotThreadedSim>> forkPool; //idle when only the pool holds them
+  uint64_t forkStructure=0; //(pool instances) State::structure of the simulation they were built from
+  std::atomic<bool> engineGripperCommanded{false}; //(physx) a gripper was commanded: can't be restored, not reused as a fork
+  std::shared_ptr<BotThreadedSim> buildFork();
+
+  //-- fast kinematic engine (botsim/engine: fastKinematic): no rai::Simulation -- the references are tracked exactly, no
+  //   collisions or contacts; gripper fingers move at the commanded speed, a grasp attaches the object, opening detaches it
+  struct KinematicGripper {
+    rai::String name;
+    rai::Frame *frame=0;
+    FrameL fingers;     //frames of the finger joints (width = 2 x joint position)
+    double width=0., target=0., speed=0.;
+    rai::Frame *grasped=0, *graspedParent=0;
+  };
+  std::vector<KinematicGripper> kinematicGrippers;
+  KinematicGripper& kinematicGripper(const char* name); //set up from the configuration on first use
+  void setFingers(KinematicGripper& g);
+  void release(KinematicGripper& g);
+
+  //-- grippers of either engine (caller holds the stepMutex)
+  void moveGripper(const char* gripper, double width, double speed, bool closing=false);
+  void closeGripperGrasp(const char* gripper, const char* objName);
+  double getGripperWidth(const char* gripper);
+  bool gripperIsDone(const char* gripper);
+
+  //two options: physical simulation, or the fast kinematic engine (sim==0)
 protected:
   std::shared_ptr<rai::Simulation> sim;
 
@@ -32,6 +137,7 @@ protected:
 
   friend struct GripperSim;
   friend struct CameraSim;
+  friend struct SimRenderer;
 };
 
 struct GripperSim : rai::GripperAbstraction, Thread{
@@ -59,28 +165,66 @@ struct GripperSim : rai::GripperAbstraction, Thread{
 
 };
 
-struct CameraSim : rai::CameraAbstraction {
+/// renders all simulated cameras of a BotThreadedSim in one thread: one copy of the configuration and one offscreen view
+/// with every sensor registered -- per snapshot (at most botsim/cameraFps) the scene is updated once, then each sensor only
+/// re-draws it from its own pose. Color and depth, plus per-pixel frame IDs with botsim/segmentation. With
+/// botsim/cameraEngine: raycast the CPU RayCastRenderer replaces the view (no GL context needed). Obtain it with
+/// BotThreadedSim::getRenderer (shared by all CameraSims of that simulation)
+struct SimRenderer : Thread {
+  /// called on the render thread with each frame rendered for a sensor, its render time and the age of its state
+  typedef std::function<void(rai::CameraFrame& F, double renderTime, double stateAge)> Publish;
+
+  SimRenderer(BotThreadedSim& _sim);
+  ~SimRenderer();
+
+  /// register a sensor (a frame of the simulation) -- returns its id and its fxycxy; renders with the next pass
+  uint addSensor(const char* name, const Publish& publish, arr& fxycxy);
+  /// no more frames for this sensor (its callback is not called after this returns)
+  void removeSensor(uint id);
+
+  void step();
+  void close();
+
+private:
+  BotThreadedSim& sim;
+  rai::Configuration renderC; //guarded by renderMux
+  uint64_t structure=0;       //rai::structureSignature of the simulation's configuration when renderC was copied
+  std::shared_ptr<rai::CameraView> view;
+  std::shared_ptr<rai::RayCastRenderer> rayCaster; //instead of the view (botsim/cameraEngine: raycast)
+  struct Sensor {
+    rai::String name;
+    uint frame;
+    rai::RayCastRenderer::Camera camera; //(raycast)
+    Publish publish; //empty: removed
+    double renderedTime=-1.; //ctrlTime of its last frame
+    rai::FramePool<byte> imagePool;
+    rai::FramePool<float> depthPool;
+  };
+  std::deque<Sensor> sensors; //ids are indices
+  std::mutex renderMux; //held for a whole render pass
+  bool segmentation;
+  void createView(); //renderer of renderC with all sensors
+};
+
+/// a simulated camera: a sensor of the simulation's SimRenderer -- reading images never takes the stepMutex, so perception
+/// does not stall the simulation, and all cameras of one simulation show the same state. Frames carry the sim ctrlTime of
+/// their state as deviceTime; getFrameStats reports render time and state age
+struct CameraSim : rai::CameraAbstraction, rai::FrameSource {
   std::shared_ptr<BotThreadedSim> simthread;
 
-  CameraSim(const std::shared_ptr<BotThreadedSim>& _sim, const char* sensorName) : simthread(_sim) {
-    auto mux = simthread->stepMutex(RAI_HERE);
-    name = sensorName;
-    simthread->sim->addSensor(name);
-  }
-
-  virtual void getImageAndDepth(byteA& image, floatA& depth){
-    auto mux = simthread->stepMutex(RAI_HERE);
-    simthread->sim->selectSensor(name);
-    simthread->sim->getImageAndDepth(image, depth);
-  }
-  virtual arr getFxycxy(){
-    auto mux = simthread->stepMutex(RAI_HERE);
-    simthread->sim->selectSensor(name);
-    return simthread->sim->cameraview().currentSensor->getFxycxy();
-  }
-  virtual rai::Transformation getPose(){
-    auto mux = simthread->stepMutex(RAI_HERE);
-    simthread->sim->selectSensor(name);
-    return simthread->sim->cameraview().currentSensor->pose();
-  }
+  CameraSim(const std::shared_ptr<BotThreadedSim>& _sim, const char* sensorName);
+  ~CameraSim();
+
+  /// waits for the first image of a state at least as new as the simulation at the time of the call -- several cameras
+  /// read within one control step get the frames of the same render pass
+  virtual void getImageAndDepth(byteA& image, floatA& depth);
+  virtual arr getFxycxy(){ return fxycxy; }
+  /// sensor pose in the latest snapshot
+  virtual rai::Transformation getPose();
+
+private:
+  std::shared_ptr<SimRenderer> renderer;
+  uint sensorID;
+  uint sensorFrame;
+  arr fxycxy;
 };
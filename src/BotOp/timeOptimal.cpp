@@ -0,0 +1,252 @@
+#include "timeOptimal.h"
+
+#include <math.h>
+#include <deque>
+
+//===========================================================================
+//
+// The path is parameterized by its arc length s in joint space; x = sDot^2 and u = sDDot are the state and control of each
+// grid stage (a knot), with x' = x + 2 ds u from knot to knot. Joint velocity and acceleration limits become
+//   x <= xCap (velocity),   -amax <= q'(s) u + q''(s) x <= amax (acceleration).
+// The backward pass computes the controllable set [lo, hi] of x at each knot (those from which the path end can still be
+// reached at rest), the forward pass then greedily takes the largest feasible u. Each stage only solves a 1D problem in x:
+// for fixed x the feasible u is an interval [uL(x), uU(x)] with uL convex and uU concave, so the feasible x form an
+// interval, found by bisection.
+//
+
+namespace {
+
+const double eps = 1e-9;
+
+arr jointLimits(const arr& lim, uint n, const char* name){
+  CHECK(lim.N==1 || lim.N==n, name <<" needs to be a scalar or have one entry per joint");
+  arr l(n);
+  for(uint j=0;j<n;j++){ l.p[j] = (lim.N==1 ? lim.p[0] : lim.p[j]); CHECK_GE(l.p[j], eps, name <<" needs to be positive"); }
+  return l;
+}
+
+struct Stage {
+  const double *a, *b; //q'(s), q''(s) at the knot
+  const double* amax;
+  uint n;
+  double xCap, ds;
+
+  /// feasible u at the knot for given x, such that the next knot is in [loNext, hiNext]
+  void controlBounds(double& uL, double& uU, double x, double loNext, double hiNext) const{
+    uL = (loNext-x)/(2.*ds);
+    uU = (hiNext-x)/(2.*ds);
+    for(uint j=0;j<n;j++){
+      if(fabs(a[j])<eps) continue; //only constrains x -- part of xCap
+      double l = (-amax[j]-b[j]*x)/a[j], u = (amax[j]-b[j]*x)/a[j];
+      if(a[j]<0.){ double tmp=l; l=u; u=tmp; }
+      if(l>uL) uL=l;
+      if(u<uU) uU=u;
+    }
+  }
+
+  double slack(double x, double loNext, double hiNext) const{
+    double uL, uU;
+    controlBounds(uL, uU, x, loNext, hiNext);
+    return uU-uL;
+  }
+
+  /// the interval of x from which [loNext, hiNext] is reachable -- false if empty
+  bool controllableSet(double& lo, double& hi, double loNext, double hiNext) const{
+    //-- a feasible x: usually 0 (at rest), otherwise maximize the concave slack
+    double xm=0.;
+    if(slack(0., loNext, hiNext)<0.){
+      double l=0., r=xCap;
+      for(uint k=0;k<100;k++){
+        double m1 = l+(r-l)/3., m2 = r-(r-l)/3.;
+        if(slack(m1, loNext, hiNext)<slack(m2, loNext, hiNext)) l=m1; else r=m2;
+      }
+      xm = .5*(l+r);
+      if(slack(xm, loNext, hiNext)<0.) return false;
+    }
+
+    //-- bisect for both ends of the interval
+    if(slack(xCap, loNext, hiNext)>=0.) hi=xCap;
+    else{
+      double l=xm, r=xCap;
+      for(uint k=0;k<60;k++){ double m=.5*(l+r); if(slack(m, loNext, hiNext)>=0.) l=m; else r=m; }
+      hi=l;
+    }
+    if(xm==0.) lo=0.;
+    else{
+      double l=0., r=xm;
+      for(uint k=0;k<60;k++){ double m=.5*(l+r); if(slack(m, loNext, hiNext)>=0.) r=m; else l=m; }
+      lo=r;
+    }
+    return true;
+  }
+};
+
+/// max over joints and segments of |jerk|/maxJerk, and per segment in 'ratio' -- finite differences over the knot times
+double jerkRatio(arr& ratio, const arr& Q, const arr& dt, const arr& maxJerk){
+  uint K=Q.d0, n=Q.d1;
+  arr V(K+1, n), A(K, n); //segment velocities (with rest before and after), knot accelerations
+  V.setZero();
+  for(uint i=0;i+1<K;i++) for(uint j=0;j<n;j++) V.p[(i+1)*n+j] = (Q.p[(i+1)*n+j]-Q.p[i*n+j])/dt.p[i];
+  for(uint i=0;i<K;i++){
+    double h = .5*((i>0 ? dt.p[i-1] : dt.p[i]) + (i+1<K ? dt.p[i] : dt.p[i-1]));
+    for(uint j=0;j<n;j++) A.p[i*n+j] = (V.p[(i+1)*n+j]-V.p[i*n+j])/h;
+  }
+  ratio.resize(K-1);
+  double rmax=0.;
+  for(uint i=0;i+1<K;i++){
+    double r=0.;
+    for(uint j=0;j<n;j++){
+      double jerk = fabs(A.p[(i+1)*n+j]-A.p[i*n+j])/dt.p[i];
+      if(jerk/maxJerk.p[j]>r) r=jerk/maxJerk.p[j];
+    }
+    ratio.p[i]=r;
+    if(r>rmax) rmax=r;
+  }
+  return rmax;
+}
+
+/// replace the speed v (at knot times t) by its sliding-window minimum, then by the sliding-window mean of that (both over
+/// [t-w, t+w]) -- the result stays below v everywhere and its slope changes gradually; linear time
+void smoothSpeed(arr& v, const arr& t, double w){
+  uint K=v.N;
+  arr e(K), P(K);
+  std::deque<uint> window; //indices of increasing v
+  for(uint i=0, j=0;i<K;i++){
+    for(;j<K && t.p[j]<=t.p[i]+w;j++){
+      while(window.size() && v.p[window.back()]>=v.p[j]) window.pop_back();
+      window.push_back(j);
+    }
+    while(t.p[window.front()]<t.p[i]-w) window.pop_front();
+    e.p[i] = v.p[window.front()];
+  }
+  P.p[0]=0.; //integral of e (trapezoid), evaluated in between knots by 'integral'
+  for(uint i=1;i<K;i++) P.p[i] = P.p[i-1] + .5*(e.p[i-1]+e.p[i])*(t.p[i]-t.p[i-1]);
+  auto integral = [&](uint k, double tau){ //tau in [t_k, t_k+1]
+    if(k+1>=K) return P.p[K-1];
+    double h = tau-t.p[k], slope = (e.p[k+1]-e.p[k])/(t.p[k+1]-t.p[k]);
+    return P.p[k] + h*(e.p[k] + .5*slope*h);
+  };
+  for(uint i=0, lo=0, hi=0;i<K;i++){
+    double a = t.p[i]-w, b = t.p[i]+w;
+    if(a<0.) a=0.;
+    if(b>t.p[K-1]) b=t.p[K-1];
+    while(lo+1<K && t.p[lo+1]<=a) lo++;
+    while(hi+1<K && t.p[hi+1]<=b) hi++;
+    v.p[i] = (b>a ? (integral(hi, b)-integral(lo, a))/(b-a) : e.p[i]);
+  }
+}
+
+} //namespace
+
+//===========================================================================
+
+PathTiming getTimeOptimalTiming(const arr& path, const arr& q0, const arr& maxVel, const arr& maxAcc, const arr& maxJerk){
+  CHECK_EQ(path.nd, 2, "path needs to be a (T x n) array");
+  CHECK(path.d0>0, "path needs at least one waypoint");
+  uint n = path.d1, K = path.d0+1; //knots: q0 and the path points
+  CHECK_EQ(q0.N, n, "start configuration has wrong dimension");
+  arr vmax = jointLimits(maxVel, n, "maxVel");
+  arr amax = jointLimits(maxAcc, n, "maxAcc");
+  arr jmax;
+  if(maxJerk.N) jmax = jointLimits(maxJerk, n, "maxJerk");
+
+  PathTiming timing;
+
+  //-- knots, segment lengths and directions
+  arr Q(K, n);
+  memcpy(Q.p, q0.p, n*sizeof(double));
+  memcpy(Q.p+n, path.p, path.N*sizeof(double));
+  arr ds(K-1), dir(K-1, n);
+  dir.setZero();
+  for(uint i=0;i+1<K;i++){
+    double d=0.;
+    for(uint j=0;j<n;j++){ double e=Q.p[(i+1)*n+j]-Q.p[i*n+j]; d+=e*e; }
+    ds.p[i] = sqrt(d);
+    if(ds.p[i]>eps) for(uint j=0;j<n;j++) dir.p[i*n+j] = (Q.p[(i+1)*n+j]-Q.p[i*n+j])/ds.p[i];
+    else ds.p[i]=eps; //duplicate waypoint
+  }
+
+  //-- path derivatives q'(s), q''(s) and velocity caps at the knots
+  arr qs(K, n), qss(K, n), xCap(K);
+  qss.setZero();
+  for(uint i=0;i<K;i++){
+    const double* prev = dir.p + (i>0 ? i-1 : 0)*n;
+    const double* next = dir.p + (i+1<K ? i : K-2)*n;
+    double cap=1e10;
+    for(uint j=0;j<n;j++){
+      qs.p[i*n+j] = .5*(prev[j]+next[j]);
+      if(i>0 && i+1<K) qss.p[i*n+j] = (next[j]-prev[j])/(.5*(ds.p[i-1]+ds.p[i]));
+      double v = fabs(prev[j])>fabs(next[j]) ? fabs(prev[j]) : fabs(next[j]); //both adjacent segments
+      if(v>eps){ double c=vmax.p[j]/v; c*=c; if(c<cap) cap=c; }
+      if(fabs(qs.p[i*n+j])<eps && fabs(qss.p[i*n+j])>eps){ double c=amax.p[j]/fabs(qss.p[i*n+j]); if(c<cap) cap=c; }
+    }
+    xCap.p[i]=cap;
+  }
+  auto stage = [&](uint i){ return Stage{qs.p+i*n, qss.p+i*n, amax.p, n, xCap.p[i], ds.p[i]}; };
+
+  //-- backward pass: controllable sets, ending at rest
+  arr lo(K), hi(K);
+  lo.p[K-1] = hi.p[K-1] = 0.;
+  for(uint i=K-1;i--;){
+    if(!stage(i).controllableSet(lo.p[i], hi.p[i], lo.p[i+1], hi.p[i+1])){
+      LOG(-1) <<"path not parameterizable at knot " <<i;
+      return timing;
+    }
+  }
+  if(lo.p[0]>0.){ LOG(-1) <<"path can't be started at rest"; return timing; }
+
+  //-- forward pass: greedily the largest feasible acceleration
+  arr x(K);
+  x.p[0]=0.;
+  for(uint i=0;i+1<K;i++){
+    double uL, uU;
+    stage(i).controlBounds(uL, uU, x.p[i], lo.p[i+1], hi.p[i+1]);
+    double xn = x.p[i] + 2.*ds.p[i]*uU;
+    if(xn>hi.p[i+1]) xn=hi.p[i+1];
+    if(xn<lo.p[i+1]) xn=lo.p[i+1];
+    x.p[i+1] = xn>0. ? xn : 0.;
+  }
+
+  //-- segment durations
+  arr dt(K-1);
+  for(uint i=0;i+1<K;i++){
+    double v = sqrt(x.p[i])+sqrt(x.p[i+1]);
+    dt.p[i] = v>eps ? 2.*ds.p[i]/v : 0.;
+    if(dt.p[i]<1e-6) dt.p[i]=1e-6;
+  }
+
+  //-- jerk limit: smooth the speed profile over the time an acceleration ramp needs (which spreads the switches of the
+  //   bang-bang profile), then scale the whole timing by whatever violation is left
+  if(jmax.N){
+    double ramp=1e10;
+    for(uint j=0;j<n;j++) if(amax.p[j]/jmax.p[j]<ramp) ramp=amax.p[j]/jmax.p[j];
+    arr v(K), t(K);
+    t.p[0]=0.;
+    for(uint i=0;i<K;i++){ v.p[i]=sqrt(x.p[i]); if(i) t.p[i]=t.p[i-1]+dt.p[i-1]; }
+    arr v0 = v;
+    smoothSpeed(v, t, ramp);
+    for(uint i=0;i<K;i++) if(v.p[i]>v0.p[i]) v.p[i]=v0.p[i]; //(trapezoid errors on coarse paths)
+    for(uint i=0;i+1<K;i++){
+      double vi = v.p[i]+v.p[i+1];
+      dt.p[i] = vi>eps ? 2.*ds.p[i]/vi : 1e-6;
+      if(dt.p[i]<1e-6) dt.p[i]=1e-6;
+    }
+    arr ratio;
+    double r = jerkRatio(ratio, Q, dt, jmax);
+    if(r>1.){
+      timing.jerkScaling = cbrt(r);
+      for(uint i=0;i+1<K;i++) dt.p[i] *= timing.jerkScaling;
+    }
+  }
+
+  //-- knot times of the path points (q0 is at time 0)
+  timing.times.resize(K-1);
+  double t=0.;
+  for(uint i=0;i+1<K;i++){
+    t += dt.p[i];
+    timing.times.p[i] = t;
+  }
+  timing.duration = t;
+
+  return timing;
+}
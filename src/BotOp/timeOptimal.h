@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Core/array.h>
+
+//===========================================================================
+
+/// knot times for a waypoint path, as computed by getTimeOptimalTiming
+struct PathTiming {
+  arr times;                 ///< absolute time of each path point (the start configuration is at time 0) -- pass to BotOp::move
+  double duration=0.;        ///< times.last()
+  double uniformDuration=0.; ///< duration of the equal time spacing of getMinDuration (bot/autoTiming: uniform) -- set by BotOp::moveAutoTimed
+  double jerkScaling=1.;     ///< global time stretch that was still needed to meet the jerk limit after smoothing
+
+  double saving() const{ return uniformDuration>0. ? 1.-duration/uniformDuration : 0.; }
+};
+
+/// time-optimal parameterization of a waypoint path (TOPP-RA style reachability analysis, linear in the path length):
+/// the path (T x n, e.g. from KOMO or RRT) starts at q0 and ends at rest; maxVel/maxAcc/maxJerk are per-joint or scalar
+/// limits -- maxJerk is optional and enforced afterwards by smoothing the speed profile. The waypoints are
+/// treated as a piecewise-linear path with curvature at the knots, which the reference spline follows closely for
+/// fine-resolution paths. Returns empty times if the path can't be parameterized.
+PathTiming getTimeOptimalTiming(const arr& path, const arr& q0, const arr& maxVel, const arr& maxAcc, const arr& maxJerk={});
+
+//===========================================================================
@@ -26,7 +26,7 @@ bool Move_IK::go(){
     if(askForOK && C.view(true, "Move_IK\ngo?")=='q') return false;
 
     bot.moveTo(qT, 2.);
-    for(;bot.getTimeToEnd()>0.;) bot.sync(C);
+    bot.wait(C, false, true);
   }
   return true;
 }
@@ -33,6 +33,7 @@ void FrankaGripper::homing(){
   {
     auto cmdSet = cmd.set();
     cmdSet->cmd = GripperCmdMsg::Command::_home;
+    cmdSet->seq = ++issued;
   }
   threadStep();
 }
@@ -43,6 +44,7 @@ void FrankaGripper::open(double width, double speed){
     cmdSet->cmd = GripperCmdMsg::Command::_open;
     cmdSet->width = width;
     cmdSet->speed = speed;
+    cmdSet->seq = ++issued;
   }
   threadStep();
 }
@@ -54,6 +56,7 @@ void FrankaGripper::close(double force, double width, double speed){
     cmdSet->force = force;
     cmdSet->width = width;
     cmdSet->speed = speed;
+    cmdSet->seq = ++issued;
   }
   threadStep();
 }
@@ -71,7 +74,7 @@ bool FrankaGripper::isGrasped(){
 void FrankaGripper::step() {
   GripperCmdMsg msg = cmd.set();
 
-  if(msg.cmd==msg._done) return;
+  if(msg.cmd==msg._done){ processed=msg.seq; return; }
 
   if(msg.width>maxWidth){
       LOG(-1) <<"width " <<msg.width <<" is too large (max:" <<maxWidth <<')';
@@ -97,6 +100,8 @@ void FrankaGripper::step() {
   //LOG(0) <<"gripper command " <<msg.cmd <<" SEND (" <<msg.width <<' ' <<msg.speed <<' ' <<msg.force  <<')' <<endl;
 
   msg.cmd = msg._done;
+  processed=msg.seq;
+  notifyEvents();
 }
 
 #else //RAI_FRANKA
@@ -3,6 +3,7 @@
 #include <Core/util.h>
 #include <Core/thread.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/botEvents.h>
 
 namespace franka{
   class Gripper;
@@ -15,9 +16,10 @@ struct GripperCmdMsg {
     double force=20;  //which is 2kg
     double width=.05; //which is 5cm
     double speed=.1;
+    uint seq=0;       //FrankaGripper::issued when this command was set
 };
 
-struct FrankaGripper : rai::GripperAbstraction, Thread{
+struct FrankaGripper : rai::GripperAbstraction, Thread, rai::BotEventSource{
   Var<GripperCmdMsg> cmd;
   double maxWidth;
 
@@ -35,7 +37,7 @@ struct FrankaGripper : rai::GripperAbstraction, Thread{
 
   double pos();
 
-  bool isDone(){ return Thread::isIdle(); }
+  bool isDone(){ return processed==issued; }
 
   bool isGrasped();
 
@@ -43,4 +45,7 @@ struct FrankaGripper : rai::GripperAbstraction, Thread{
 
 private:
   std::shared_ptr<franka::Gripper> frankaGripper;
+  //done when the step executed the last command issued -- a step still running an earlier command doesn't count
+  std::atomic<uint> issued{0};    //incremented (under the cmd lock) by each command
+  std::atomic<uint> processed{0}; //seq of the command the step executed last (then events are notified)
 };
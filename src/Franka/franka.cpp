@@ -6,6 +6,8 @@
 #include <franka/robot.h>
 #include <franka/exception.h>
 
+#include "torqueKernel.h"
+
 void naturalGains(double& Kp, double& Kd, double decayTime, double dampingRatio);
 
 const char *frankaIpAddresses[2] = {"172.16.0.2", "172.17.0.2"};
@@ -19,12 +21,53 @@ FrankaThread::~FrankaThread(){
 
 long c = 0;
 
+//===========================================================================
+//
+// debug counter for heap allocations inside the real-time callback:
+// compile with -DRAI_FRANKA_ALLOCCHECK to interpose malloc/calloc/realloc (glibc only) and count
+// calls made by the control thread between allocCheck_begin() and allocCheck_end()
+//
+
+#ifdef RAI_FRANKA_ALLOCCHECK
+
+extern "C" {
+  void* __libc_malloc(size_t);
+  void* __libc_calloc(size_t, size_t);
+  void* __libc_realloc(void*, size_t);
+}
+
+static __thread bool allocCheck_armed __attribute__((tls_model("initial-exec"))) = false;
+static __thread uint allocCheck_count __attribute__((tls_model("initial-exec"))) = 0;
+
+extern "C" void* malloc(size_t n){ if(allocCheck_armed) allocCheck_count++; return __libc_malloc(n); }
+extern "C" void* calloc(size_t n, size_t m){ if(allocCheck_armed) allocCheck_count++; return __libc_calloc(n, m); }
+extern "C" void* realloc(void* p, size_t n){ if(allocCheck_armed) allocCheck_count++; return __libc_realloc(p, n); }
+
+void FrankaThread::allocCheck_begin(){ allocCheck_count=0; allocCheck_armed=true; }
+
+void FrankaThread::allocCheck_end(){
+  allocCheck_armed=false;
+  if(allocCheck_count){
+    allocTicks++;
+    if(allocCheck_count>allocMaxPerTick) allocMaxPerTick=allocCheck_count;
+  }
+}
+
+#else
+
+void FrankaThread::allocCheck_begin(){}
+void FrankaThread::allocCheck_end(){}
+
+#endif
+
+
 void FrankaThread::init(uint _robotID, const uintA& _qIndices) {
   robotID=_robotID;
   qIndices=_qIndices;
 
   CHECK_EQ(qIndices.N, 7, "");
   qIndices_max = rai::max(qIndices);
+  loopStats.init(STRING("FrankaThread" <<robotID), .001); //HARD CODED: 1kHz
 
   //-- basic Kp Kd settings for reference control mode
   Kp_freq = rai::getParameter<arr>("Franka/Kp_freq", arr{20., 20., 20., 20., 10., 15., 10.}); //18., 18., 18., 13., 8., 8., 6.));
@@ -56,6 +99,26 @@ void FrankaThread::init(uint _robotID, const uintA& _qIndices) {
   }
 }
 
+void FrankaThread::setDataLogLevel(int level){
+  writeData = level;
+  if(level<=0){ dataLog.pause(); return; } //(a later call with the same level continues the file)
+  if(dataLog.resume(level)) return;
+  StringA names = {"ctrlTime", "q", "q_ref"};
+  uintA dims = {1, 7, 7};
+  if(level>1){
+    names.append(StringA{"qDot", "qDot_ref", "u", "tau_J", "G", "C", "qDDot_ref"});
+    dims.append(uintA{7, 7, 7, 7, 7, 7, 7});
+  }
+  if(level>2){
+    names.append(StringA{"M"});
+    dims.append(uintA{49});
+  }
+  dataLog.set(0); //close the previous log (and its file) before opening the same file again
+  auto log = make_shared<rai::DataLogger>(STRING("z.panda"<<robotID <<".log"), names, dims);
+  log->level = level;
+  dataLog.set(log);
+}
+
 void FrankaThread::step(){
   // connect to robot
   franka::Robot robot(ipAddress);
@@ -63,9 +126,15 @@ void FrankaThread::step(){
   // load the kinematics and dynamics model
   franka::Model model = robot.loadModel();
 
-  arr lastTorque = zeros(7);
-  arr qDotFilter = zeros(7);
+  //-- preallocated buffers: the callback below must not touch the heap
+  FrankaTorqueKernel kernel;
+  kernel.setGains(Kp_freq, Kd_ratio, friction);
+  Vec7 qDotFilter, lastTorque;
+  qDotFilter.setZero();
+  lastTorque.setZero();
   double qDotFilterAlpha = .7;
+  arr state_q_real, state_qDot_real;
+  arr cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref;
 
   // set collision behavior
   robot.setCollisionBehavior({{100.0, 100.0, 100.0, 100.0, 100.0, 100.0, 100.0}},
@@ -94,8 +163,50 @@ void FrankaThread::step(){
       stateSet->tauExternalIntegral.elem(qIndices(i)) = 0.;
       stateSet->tauExternalCount=0;
     }
+
+    //reserve full-dimensional buffers once
+    state_q_real = stateSet->q;
+    state_qDot_real = stateSet->qDot;
+    cmd_q_ref.resize(stateSet->q.N);
+    cmd_qDot_ref.resize(stateSet->q.N);
+    cmd_qDDot_ref.resize(stateSet->q.N);
+
+    if(channel){
+      channel->initWriter(robotID, qIndices);
+      channel->publishState(robotID, channel->ctrlTime.load(), qIndices, q_real.p, qDot_real.p, 0);
+      cmdBuffer = make_shared<rai::CtrlChannel::CmdSlot>();
+      channel->pullCmd(cmdLocal, cmdRevision, *cmdBuffer);
+    }
   }
 
+  //-- pick the command entries for this robot's qIndices into the kernel (called with the cmd lock held, or on the local copy)
+  auto pickCmd = [&](const rai::CtrlCmdMsg& c) -> rai::ControlType {
+    //get commanded reference from the reference callback (e.g., sampling a spline reference)
+    if(c.ref){
+      loopStats.refBegin();
+      c.ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, state_q_real, state_qDot_real, ctrlTime);
+      loopStats.refEnd();
+      CHECK(!cmd_q_ref.N || cmd_q_ref.N > qIndices_max, "");
+      CHECK(!cmd_qDot_ref.N || cmd_qDot_ref.N > qIndices_max, "");
+      CHECK(!cmd_qDDot_ref.N || cmd_qDDot_ref.N > qIndices_max, "");
+
+      //pick qIndices for this particular robot
+      if(cmd_q_ref.N){ kernel.q_ref.pick(cmd_q_ref, qIndices); kernel.has_q_ref=true; }
+      if(cmd_qDot_ref.N){ kernel.qDot_ref.pick(cmd_qDot_ref, qIndices); kernel.has_qDot_ref=true; }
+      if(cmd_qDDot_ref.N){ kernel.qDDot_ref.pick(cmd_qDDot_ref, qIndices); kernel.has_qDDot_ref=true; }
+    }
+    if(c.Kp.d0 >= 7 && c.Kp.d1 >=7 && c.Kp.d0 == c.Kp.d1){
+      kernel.Kp_ref.pick(c.Kp, qIndices); kernel.has_Kp_ref=true;
+    }
+    if(c.Kd.d0 >= 7 && c.Kd.d1 >=7 && c.Kd.d0 == c.Kd.d1){
+      kernel.Kd_ref.pick(c.Kd, qIndices); kernel.has_Kd_ref=true;
+    }
+    if(c.P_compliance.N) {
+      kernel.P_compliance.pick(c.P_compliance, qIndices); kernel.has_P_compliance=true;
+    }
+    return c.controlType;
+  };
+
 
   //-- define the callback for the torque control loop
   std::function<franka::Torques(const franka::RobotState&, franka::Duration)>
@@ -103,25 +214,33 @@ void FrankaThread::step(){
                                     franka::Duration /*duration*/) -> franka::Torques {
 
     steps++;
+    loopStats.tickBegin();
+    allocCheck_begin();
 
 //    if(stop) return franka::MotionFinished(franka::Torques( std::array<double, 7>{0., 0., 0., 0., 0., 0., 0.}));
 
     //-- get current state from libfranka
-    arr q_real(robot_state.q.begin(), robot_state.q.size(), false);
-    arr qDot_real(robot_state.dq.begin(), robot_state.dq.size(), false);
-    arr torquesExternal_real(robot_state.tau_ext_hat_filtered.begin(), robot_state.tau_ext_hat_filtered.size(), false);
-    arr torques_real(robot_state.tau_J.begin(), robot_state.tau_J.size(), false);
-
-    qDotFilter = qDotFilterAlpha * qDotFilter + (1.-qDotFilterAlpha) * qDot_real;
-    qDot_real = qDotFilter;
+    kernel.clearRefs();
+    kernel.q_real.setCarray(robot_state.q.data());
+    for(uint i=0;i<7;i++){
+      qDotFilter(i) = qDotFilterAlpha * qDotFilter(i) + (1.-qDotFilterAlpha) * robot_state.dq[i];
+    }
+    kernel.qDot_real = qDotFilter;
 
     //-- get real time
     //ctrlTime += .001; //HARD CODED: 1kHz
     //ctrlTime = rai::realTime();
 
     //-- publish state & INCREMENT CTRL TIME
-    arr state_q_real, state_qDot_real;
-    {
+    if(channel){ //wait-free: no lock shared with user threads
+      if(robotID==0) ctrlTime = channel->stepCtrlTime(.001); //HARD CODED: 1kHz
+      else ctrlTime = channel->ctrlTime.load();
+      channel->publishState(robotID, ctrlTime, qIndices, kernel.q_real.p, kernel.qDot_real.p, robot_state.tau_ext_hat_filtered.data());
+      for(uint i=0;i<7;i++){
+        state_q_real.elem(qIndices(i)) = kernel.q_real(i);
+        state_qDot_real.elem(qIndices(i)) = kernel.qDot_real(i);
+      }
+    }else{
       auto stateSet = state.set();
       if(robotID==0){ // if this is the lead robot, increment ctrlTime if no stall
         if(!stateSet->stall) stateSet->ctrlTime += .001; //HARD CODED: 1kHz
@@ -129,216 +248,86 @@ void FrankaThread::step(){
       }
       ctrlTime = stateSet->ctrlTime;
       for(uint i=0;i<7;i++){
-        stateSet->q.elem(qIndices(i)) = q_real.elem(i);
-        stateSet->qDot.elem(qIndices(i)) = qDot_real.elem(i);
-        stateSet->tauExternalIntegral.elem(qIndices(i)) += torquesExternal_real.elem(i);
+        stateSet->q.elem(qIndices(i)) = kernel.q_real(i);
+        stateSet->qDot.elem(qIndices(i)) = kernel.qDot_real(i);
+        stateSet->tauExternalIntegral.elem(qIndices(i)) += robot_state.tau_ext_hat_filtered[i];
       }
       stateSet->tauExternalCount++;
-      state_q_real = stateSet->q;
+      state_q_real = stateSet->q; //same size as reserved -> no realloc
       state_qDot_real = stateSet->qDot;
     }
+    if(robotID==0) tickEvents(ctrlTime); //wakes BotOp::wait when the motion ends
 
     //-- get current ctrl command
-    arr q_ref, qDot_ref, qDDot_ref, Kp_ref, Kd_ref, P_compliance; // TODO Kp, Kd and also read out the correct indices
     rai::ControlType controlType;
-    {
+    if(channel){
+      channel->pullCmd(cmdLocal, cmdRevision, *cmdBuffer); //copies only when the command changed
+      controlType = pickCmd(cmdLocal);
+    }else{
       auto cmdGet = cmd.get();
-
-      controlType = cmdGet->controlType;
-
-      //get commanded reference from the reference callback (e.g., sampling a spline reference)
-      arr cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref;
-      if(cmdGet->ref){
-        cmdGet->ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, state_q_real, state_qDot_real, ctrlTime);
-        CHECK(!cmd_q_ref.N || cmd_q_ref.N > qIndices_max, "");
-        CHECK(!cmd_qDot_ref.N || cmd_qDot_ref.N > qIndices_max, "");
-        CHECK(!cmd_qDDot_ref.N || cmd_qDDot_ref.N > qIndices_max, "");
-      }
-
-      //pick qIndices for this particular robot
-      if(cmd_q_ref.N){
-        q_ref.resize(7);
-        for(uint i=0; i<7; i++) q_ref.elem(i) = cmd_q_ref.elem(qIndices(i));
-      }
-      if(cmd_qDot_ref.N){
-        qDot_ref.resize(7);
-        for(uint i=0; i<7; i++) qDot_ref.elem(i) = cmd_qDot_ref.elem(qIndices(i));
-      }
-      if(cmd_qDDot_ref.N){
-        qDDot_ref.resize(7);
-        for(uint i=0; i<7; i++) qDDot_ref.elem(i) = cmd_qDDot_ref.elem(qIndices(i));
-      }
-      if(cmdGet->Kp.d0 >= 7 && cmdGet->Kp.d1 >=7 && cmdGet->Kp.d0 == cmdGet->Kp.d1){
-        Kp_ref.resize(7, 7);
-        for(uint i=0; i<7; i++) for(uint j=0; j<7; j++) Kp_ref(i, j) = cmdGet->Kp(qIndices(i), qIndices(j));
-      }
-      if(cmdGet->Kd.d0 >= 7 && cmdGet->Kd.d1 >=7 && cmdGet->Kd.d0 == cmdGet->Kd.d1){
-        Kd_ref.resize(7, 7);
-        for(uint i=0; i<7; i++) for(uint j=0; j<7; j++) Kd_ref(i, j) = cmdGet->Kd(qIndices(i), qIndices(j));
-      }
-      if(cmdGet->P_compliance.N) {
-        P_compliance.resize(7,7);
-        for(uint i=0; i<7; i++) for(uint j=0; j<7; j++) P_compliance(i,j) = cmdGet->P_compliance(qIndices(i), qIndices(j));
-      }
-
+      controlType = pickCmd(cmdGet());
     }
 
     requiresInitialization=false;
 
     //-- cap the reference difference
-    if(q_ref.N==7){
-      double err = length(q_ref - q_real);
-      if(P_compliance.N){
-        arr del = q_ref - q_real;
-        err = ::sqrt(scalarProduct(del, P_compliance*del));
-      }
+    if(kernel.has_q_ref){
+      double err = kernel.referenceError();
       if(err>.05){ //if(err>.02){ //stall!
-        state.set()->stall = 2; //no progress in reference time! for at least 2 iterations (to ensure continuous stall with multiple threads)
+        //no progress in reference time! for at least 2 iterations (to ensure continuous stall with multiple threads)
+        if(channel) channel->requestStall(2);
+        else state.set()->stall = 2;
+        loopStats.stall();
         cout <<"STALLING - step:" <<steps <<" err: " <<err <<endl;
       }
     }
 
     //-- grab dynamics
-    arr M_org(model.mass(robot_state).begin(), 49, false);
-    M_org.reshape(7,7);
-    arr C_org(model.coriolis(robot_state).begin(), 7, false);
-    arr G_org(model.gravity(robot_state).begin(), 7, false);
+    kernel.M.setCarray(model.mass(robot_state).data());
 
     //-- compute torques from control message depending on the control type
-    arr u;
-
     if(controlType == rai::ControlType::configRefs) { //default: PD for given references
-      //check for compliance objective
-      if(P_compliance.N){
-        if(!(P_compliance.nd==2 && P_compliance.d0==7 && P_compliance.d1==7)){
-          cerr << "FRANKA: inconsistent ctrl P_compliance message" << endl;
-          P_compliance.clear();
-        }
-      }
-
-      //-- compute desired torques
-      arr Kp(7), Kd(7);
-      CHECK_EQ(Kp_freq.N, 7,"");
-      CHECK_EQ(Kd_ratio.N, 7,"");
-      for(uint i=0;i<7;i++){
-        double freq = Kp_freq.elem(i);
-        Kp.elem(i) = freq*freq;
-        Kd.elem(i) = 2.*Kd_ratio.elem(i)*freq;
-      }
-
-      if(P_compliance.N){
-        Kp = P_compliance * (Kp % P_compliance);
-      }else{
-        Kp = diag(Kp);
-      }
-
-      //-- initialize zero torques
-      u.resize(7).setZero();
-
-      //-- add feedback term
-      if(q_ref.N==7){
-        u += Kp * (q_ref - q_real);
-      }
-      if(qDot_ref.N==7){
-        u += Kd % (qDot_ref - qDot_real);
-      }
-
-      //-- add feedforward term
-      if(qDDot_ref.N==7 && absMax(qDDot_ref)>0.){
-        arr M = M_org; // + diag(arr{0.4, 0.3, 0.3, 0.4, 0.4, 0.4, 0.2));
-        u += M*qDDot_ref;
-      }
-
-      //-- add friction term
-      if(friction.N==7 && qDot_ref.N==7){
-        double velThresh=1e-3;
-        for(uint i=0;i<7;i++){
-          double coeff = qDot_ref.elem(i)/velThresh;
-          if(coeff>1.) coeff=1.;
-          if(coeff<-1.) coeff=-1.;
-          u.elem(i) += coeff*friction.elem(i);
-//          if(qDot_ref.elem(i)>1e-4) u.elem(i) += friction.elem(i);
-//          if(qDot_ref.elem(i)<-1e-4) u.elem(i) -= friction.elem(i);
-        }
-      }
-
-      //-- project with compliance
-      if(P_compliance.N) u = P_compliance * u;
-
+      kernel.configRefs();
     } else if(controlType == rai::ControlType::projectedAcc) { // projected Kp, Kd and u_b term for projected operational space control
-      CHECK_EQ(Kp_ref.nd, 2, "")
-      CHECK_EQ(Kp_ref.d0, 7, "")
-      CHECK_EQ(Kp_ref.d1, 7, "")
-      CHECK_EQ(Kd_ref.nd, 2, "")
-      CHECK_EQ(Kd_ref.d0, 7, "")
-      CHECK_EQ(Kd_ref.d1, 7, "")
-      CHECK_EQ(qDDot_ref.N, 7, "")
-
-      arr M;
-      M.setCarray(model.mass(robot_state).begin(), 49);
-      M.reshape(7,7);
-
-#if 0
-      c++;
-      if(c%10 == 0) {
-        cout << M << endl << endl;
-      }
-#endif
-
-
-#if 0
-      M(4,4) = 0.2;
-      M(5,5) = 0.2;../04-trivialCtrl/retired.cpp
-      M(6,6) = 0.1;
-#else
-      arr MDiag = diag(arr{0.4, 0.3, 0.3, 0.4, 0.4, 0.4, 0.2});
-      M = M + MDiag;
-#endif
-
-      Kp_ref = M*Kp_ref;
-      Kd_ref = M*Kd_ref;
-      qDDot_ref = M*qDDot_ref;
-
-      u = qDDot_ref - Kp_ref*q_real - Kd_ref*qDot_real;
-
-      //u(5) *= 2.0;
-
-      //cout << u << endl;
-
-      //u *= 0.0; // useful for testing new stuff without braking the robot
+      kernel.projectedAcc();
+    } else {
+      kernel.u.setZero();
     }
 
     //-- filter torques
-    if(u.N==lastTorque.N){
-//      double alpha=.5;
-//      u = alpha*u + (1.-alpha)*lastTorque;
-      lastTorque = u;
-    }
+//    double alpha=.5;
+//    u = alpha*u + (1.-alpha)*lastTorque;
+    lastTorque = kernel.u;
 
-    //-- data log?
-    if(writeData>0 && !(steps%10)){
-      if(!dataFile.is_open()) dataFile.open(STRING("z.panda"<<robotID <<".dat"));
-      dataFile <<ctrlTime <<' '; //single number
-      q_real.modRaw().write(dataFile); //7
-      q_ref.modRaw().write(dataFile); //7
-      if(writeData>1){
-        qDot_real.modRaw().write(dataFile); //7
-        qDot_ref.modRaw().write(dataFile); //7
-        u.modRaw().write(dataFile); //7
-        torques_real.modRaw().write(dataFile); //7
-        G_org.modRaw().write(dataFile); //7-vector gravity
-        C_org.modRaw().write(dataFile); //7-vector coriolis
-        qDDot_ref.modRaw().write(dataFile);
-      }
-      if(writeData>2){
-        M_org.write(dataFile, " ", " ", "  "); //7x7 inertia matrix
+    allocCheck_end();
+
+    //-- data log? (built by setDataLogLevel on the user thread; the callback only copies into a lock-free ring)
+    {
+      rai::DataLogHandoff::Use log(dataLog);
+      if(log.log){
+        int logLevel = log.log->level;
+        rai::DataLogger::Record rec(*log.log);
+        rec(ctrlTime)(kernel.q_real.p, 7)(kernel.has_q_ref ? kernel.q_ref.p : 0, 7);
+        if(logLevel>1){
+          rec(kernel.qDot_real.p, 7)
+              (kernel.has_qDot_ref ? kernel.qDot_ref.p : 0, 7)
+              (kernel.u.p, 7)
+              (robot_state.tau_J.data(), 7)
+              (model.gravity(robot_state).data(), 7) //7-vector gravity
+              (model.coriolis(robot_state).data(), 7) //7-vector coriolis
+              (kernel.has_qDDot_ref ? kernel.qDDot_ref.p : 0, 7);
+        }
+        if(logLevel>2){
+          rec(model.mass(robot_state).data(), 49); //7x7 inertia matrix
+        }
       }
-      dataFile <<endl;
     }
 
+    loopStats.tickEnd();
+
     //-- send torques
-    std::array<double, 7> u_array = {0., 0., 0., 0., 0., 0., 0.};
-    for(uint i=0;i<7;i++) u_array[i]= u.elem(i);
+    std::array<double, 7> u_array;
+    for(uint i=0;i<7;i++) u_array[i]= kernel.u(i);
     if(stop){
       return franka::MotionFinished(franka::Torques(u_array));
     }
@@ -354,11 +343,15 @@ void FrankaThread::step(){
     std::cout << e.what() << std::endl;
   }
   LOG(0) <<"EXIT FRANKA CONTROL LOOP";
+#ifdef RAI_FRANKA_ALLOCCHECK
+  LOG(0) <<"FRANKA alloc check: " <<allocTicks <<" of " <<steps <<" ticks allocated (max " <<allocMaxPerTick <<" per tick)";
+#endif
 }
 
 #else //RAI_FRANKA
 
 FrankaThread::~FrankaThread(){ NICO }
+void FrankaThread::setDataLogLevel(int level){ NICO }
 void FrankaThread::init(uint _robotID, const uintA& _qIndices) { NICO }
 void FrankaThread::step(){ NICO }
 
@@ -4,13 +4,24 @@
 #include <Core/thread.h>
 #include <Control/ctrlMsg.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/ctrlChannel.h>
+#include <Utils/dataLogger.h>
+#include <Utils/loopStats.h>
+#include <Utils/botEvents.h>
 
 
-struct FrankaThread : rai::RobotAbstraction, Thread{
+struct FrankaThread : rai::RobotAbstraction, Thread, rai::LoopStatsProvider, rai::BotEventSource, rai::DataLogSource{
   FrankaThread(uint robotID=0, const uintA& _qIndices={0, 1, 2, 3, 4, 5, 6}) : Thread("FrankaThread"){ init(robotID, _qIndices); }
-  FrankaThread(uint robotID, const uintA& _qIndices, const Var<rai::CtrlCmdMsg>& _cmd, const Var<rai::CtrlStateMsg>& _state) : RobotAbstraction(_cmd, _state), Thread("FrankaThread"){ init(robotID, _qIndices); }
+  FrankaThread(uint robotID, const uintA& _qIndices, const Var<rai::CtrlCmdMsg>& _cmd, const Var<rai::CtrlStateMsg>& _state,
+               const std::shared_ptr<rai::CtrlChannel>& _channel={})
+    : RobotAbstraction(_cmd, _state), Thread("FrankaThread"), channel(_channel){ init(robotID, _qIndices); }
   ~FrankaThread();
 
+  void setDataLogLevel(int level);
+
+  //debug counters (only counting with -DRAI_FRANKA_ALLOCCHECK): number of ticks with heap allocations, max allocations per tick
+  uint allocTicks=0, allocMaxPerTick=0;
+
 private:
   bool stop=false; //send end to libfranka
   bool requiresInitialization=true;  //waits in constructor until first contact/initialization
@@ -23,10 +34,17 @@ private:
   uintA qIndices;
   uint qIndices_max=0;
 
+  //wait-free state/cmd exchange (optional; otherwise the Vars state/cmd are used)
+  std::shared_ptr<rai::CtrlChannel> channel;
+  std::shared_ptr<rai::CtrlChannel::CmdSlot> cmdBuffer;
+  rai::CtrlCmdMsg cmdLocal;
+  uint cmdRevision=-1;
+
   uint steps=0;
-  ofstream dataFile;
   double ctrlTime=0.;
 
   void init(uint _robotID, const uintA& _qIndices);
   void step();
+  void allocCheck_begin();
+  void allocCheck_end();
 };
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <Core/array.h>
+
+#include <math.h>
+
+//===========================================================================
+//
+// fixed-size 7-DoF types and the torque law of the FrankaThread callback
+// everything here lives on the stack or in preallocated members -> no heap allocation per tick
+//
+
+struct Vec7{
+  double p[7];
+
+  void setZero(){ for(uint i=0;i<7;i++) p[i]=0.; }
+  double& operator()(uint i){ return p[i]; }
+  double operator()(uint i) const{ return p[i]; }
+
+  void setCarray(const double* x){ for(uint i=0;i<7;i++) p[i]=x[i]; }
+  void pick(const arr& x, const uintA& idx){ for(uint i=0;i<7;i++) p[i]=x.elem(idx.elem(i)); }
+  void writeTo(arr& x) const{ x.resize(7); for(uint i=0;i<7;i++) x.elem(i)=p[i]; }
+};
+
+struct Mat7{
+  double p[49];
+
+  void setZero(){ for(uint i=0;i<49;i++) p[i]=0.; }
+  double& operator()(uint i, uint j){ return p[7*i+j]; }
+  double operator()(uint i, uint j) const{ return p[7*i+j]; }
+
+  void setCarray(const double* x){ for(uint i=0;i<49;i++) p[i]=x[i]; }
+  void pick(const arr& X, const uintA& idx){ for(uint i=0;i<7;i++) for(uint j=0;j<7;j++) p[7*i+j]=X(idx.elem(i), idx.elem(j)); }
+  void writeTo(arr& X) const{ X.resize(7,7); for(uint i=0;i<49;i++) X.elem(i)=p[i]; }
+};
+
+/// y = A*x
+inline void mul(Vec7& y, const Mat7& A, const Vec7& x){
+  for(uint i=0;i<7;i++){
+    double s=0.;
+    for(uint j=0;j<7;j++) s += A(i,j)*x(j);
+    y(i)=s;
+  }
+}
+
+/// y += A*x
+inline void mulAdd(Vec7& y, const Mat7& A, const Vec7& x){
+  for(uint i=0;i<7;i++){
+    double s=0.;
+    for(uint j=0;j<7;j++) s += A(i,j)*x(j);
+    y(i)+=s;
+  }
+}
+
+/// C = A*B (C must not alias A or B)
+inline void mul(Mat7& C, const Mat7& A, const Mat7& B){
+  for(uint i=0;i<7;i++) for(uint j=0;j<7;j++){
+    double s=0.;
+    for(uint k=0;k<7;k++) s += A(i,k)*B(k,j);
+    C(i,j)=s;
+  }
+}
+
+//===========================================================================
+
+/// the torque law of FrankaThread, written on fixed-size buffers: the callback fills the inputs, calls one of the
+/// control methods, and reads u -- same math as the original arr-based implementation
+struct FrankaTorqueKernel{
+  //-- parameters (set once)
+  Vec7 Kp_diag, Kd_diag, friction;
+  bool useFriction=false;
+
+  //-- inputs per tick
+  Vec7 q_real, qDot_real;
+  Vec7 q_ref, qDot_ref, qDDot_ref;
+  Mat7 Kp_ref, Kd_ref, P_compliance, M;
+  bool has_q_ref=false, has_qDot_ref=false, has_qDDot_ref=false;
+  bool has_Kp_ref=false, has_Kd_ref=false, has_P_compliance=false;
+
+  //-- output
+  Vec7 u;
+
+  //-- working buffers
+  Mat7 Kp, tmpM;
+  Vec7 del, tmp;
+
+  void setGains(const arr& Kp_freq, const arr& Kd_ratio, const arr& _friction){
+    CHECK_EQ(Kp_freq.N, 7,"");
+    CHECK_EQ(Kd_ratio.N, 7,"");
+    for(uint i=0;i<7;i++){
+      double freq = Kp_freq.elem(i);
+      Kp_diag(i) = freq*freq;
+      Kd_diag(i) = 2.*Kd_ratio.elem(i)*freq;
+    }
+    useFriction = (_friction.N==7);
+    if(useFriction) friction.setCarray(_friction.p); else friction.setZero();
+  }
+
+  void clearRefs(){ has_q_ref=has_qDot_ref=has_qDDot_ref=has_Kp_ref=has_Kd_ref=has_P_compliance=false; }
+
+  /// error between position reference and real, in the compliance metric if given (negative if no position ref)
+  double referenceError(){
+    if(!has_q_ref) return -1.;
+    for(uint i=0;i<7;i++) del(i) = q_ref(i) - q_real(i);
+    double err=0.;
+    if(has_P_compliance){
+      mul(tmp, P_compliance, del);
+      for(uint i=0;i<7;i++) err += del(i)*tmp(i);
+    }else{
+      for(uint i=0;i<7;i++) err += del(i)*del(i);
+    }
+    return ::sqrt(err);
+  }
+
+  /// default: PD for given references, plus feedforward, friction, and compliance projection
+  void configRefs(){
+    //-- stiffness matrix
+    if(has_P_compliance){
+      // Kp = P * diag(Kp) * P
+      for(uint i=0;i<7;i++) for(uint j=0;j<7;j++) tmpM(i,j) = Kp_diag(i)*P_compliance(i,j);
+      mul(Kp, P_compliance, tmpM);
+    }else{
+      Kp.setZero();
+      for(uint i=0;i<7;i++) Kp(i,i) = Kp_diag(i);
+    }
+
+    //-- initialize zero torques
+    u.setZero();
+
+    //-- add feedback term
+    if(has_q_ref){
+      for(uint i=0;i<7;i++) del(i) = q_ref(i) - q_real(i);
+      mulAdd(u, Kp, del);
+    }
+    if(has_qDot_ref){
+      for(uint i=0;i<7;i++) u(i) += Kd_diag(i) * (qDot_ref(i) - qDot_real(i));
+    }
+
+    //-- add feedforward term
+    if(has_qDDot_ref){
+      double m=0.;
+      for(uint i=0;i<7;i++) if(fabs(qDDot_ref(i))>m) m=fabs(qDDot_ref(i));
+      if(m>0.) mulAdd(u, M, qDDot_ref);
+    }
+
+    //-- add friction term
+    if(useFriction && has_qDot_ref){
+      double velThresh=1e-3;
+      for(uint i=0;i<7;i++){
+        double coeff = qDot_ref(i)/velThresh;
+        if(coeff>1.) coeff=1.;
+        if(coeff<-1.) coeff=-1.;
+        u(i) += coeff*friction(i);
+      }
+    }
+
+    //-- project with compliance
+    if(has_P_compliance){
+      tmp = u;
+      mul(u, P_compliance, tmp);
+    }
+  }
+
+  /// projected Kp, Kd and u_b term for projected operational space control
+  void projectedAcc(){
+    CHECK(has_Kp_ref, "projectedAcc requires a 7x7 Kp");
+    CHECK(has_Kd_ref, "projectedAcc requires a 7x7 Kd");
+    CHECK(has_qDDot_ref, "projectedAcc requires a 7-dim qDDot reference");
+
+    //M := M + diag(...)
+    const double MDiag[7] = {0.4, 0.3, 0.3, 0.4, 0.4, 0.4, 0.2};
+    for(uint i=0;i<7;i++) M(i,i) += MDiag[i];
+
+    // u = M*qDDot_ref - (M*Kp_ref)*q_real - (M*Kd_ref)*qDot_real
+    mul(u, M, qDDot_ref);
+    mul(tmpM, M, Kp_ref);
+    mul(tmp, tmpM, q_real);
+    for(uint i=0;i<7;i++) u(i) -= tmp(i);
+    mul(tmpM, M, Kd_ref);
+    mul(tmp, tmpM, qDot_real);
+    for(uint i=0;i<7;i++) u(i) -= tmp(i);
+  }
+};
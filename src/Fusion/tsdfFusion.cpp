@@ -0,0 +1,238 @@
+#include "tsdfFusion.h"
+
+#include <Kin/frame.h>
+
+#include <atomic>
+#include <algorithm>
+#include <unordered_set>
+
+//===========================================================================
+
+TSDFFusion::Block::Block(){
+  std::fill(tsdf, tsdf+B*B*B, 1.f);
+  std::fill(weight, weight+B*B*B, 0.f);
+  memset(color, 0, sizeof(color));
+}
+
+TSDFFusion::TSDFFusion(double _voxelSize, double _truncation, uint nThreads)
+  : voxelSize(_voxelSize), truncation(_truncation){
+  if(voxelSize<=0.) voxelSize = rai::getParameter<double>("fusion/voxelSize", .01);
+  if(truncation<=0.) truncation = rai::getParameter<double>("fusion/truncation", 4.*voxelSize);
+  maxDepth = rai::getParameter<double>("fusion/maxDepth", 3.);
+  maxWeight = rai::getParameter<double>("fusion/maxWeight", 64.);
+  allocStride = rai::getParameter<int>("fusion/allocStride", 4);
+  if(!allocStride) allocStride=1;
+
+  if(!nThreads) nThreads = rai::getParameter<int>("fusion/threads", std::thread::hardware_concurrency());
+  pool = std::make_unique<rai::WorkerPool>(nThreads);
+}
+
+//===========================================================================
+
+void TSDFFusion::integrate(rai::CameraAbstraction& cam){
+  byteA image;
+  floatA depth;
+  cam.getImageAndDepth(image, depth);
+  integrate(depth, image, cam.getFxycxy(), cam.getPose());
+}
+
+void TSDFFusion::integrate(const floatA& depth, const byteA& image, const arr& fxycxy, const rai::Transformation& camPose){
+  CHECK_EQ(depth.nd, 2, "depth image needs to be 2D");
+  CHECK_EQ(fxycxy.N, 4, "intrinsics need to be [fx, fy, cx, cy]");
+  bool hasColor = image.N && image.d0==depth.d0 && image.d1==depth.d1;
+  const uint H=depth.d0, W=depth.d1;
+  const double fx=fxycxy(0), fy=fxycxy(1), cx=fxycxy(2), cy=fxycxy(3);
+  double R[9], t[3] = {camPose.pos.x, camPose.pos.y, camPose.pos.z};
+  camPose.rot.getMatrix(R); //row-major: world = R*cam + t
+  const double blockEdge = B*voxelSize;
+  const uint nThreads = pool->numThreads();
+
+  //-- 1. blocks within the truncation band of every (strided) measurement: each worker collects the keys of its rows
+  double time = rai::realTime();
+  std::vector<std::vector<uint64_t>> keys(nThreads);
+  pool->run([&](uint k){
+    std::vector<uint64_t>& K = keys[k];
+    for(uint v=k*allocStride; v<H; v+=nThreads*allocStride) for(uint u=0; u<W; u+=allocStride){
+      double d = depth.p[v*W+u];
+      if(d<=0. || d>maxDepth) continue;
+      //ray direction in world coordinates, scaled such that the camera-frame depth is 1
+      double rc[3] = {(u-cx)/fx, -(v-cy)/fy, -1.};
+      double rw[3];
+      for(uint i=0;i<3;i++) rw[i] = R[3*i]*rc[0] + R[3*i+1]*rc[1] + R[3*i+2]*rc[2];
+      double d0 = d-truncation, d1 = d+truncation;
+      if(d0<0.) d0=0.;
+      double len = (d1-d0)*sqrt(rw[0]*rw[0]+rw[1]*rw[1]+rw[2]*rw[2]);
+      uint steps = uint(ceil(2.*len/blockEdge));
+      if(!steps) steps=1;
+      uint64_t last=0;
+      for(uint s=0; s<=steps; s++){
+        double z = d0 + (d1-d0)*s/steps;
+        int bx = int(floor((t[0]+z*rw[0])/blockEdge));
+        int by = int(floor((t[1]+z*rw[1])/blockEdge));
+        int bz = int(floor((t[2]+z*rw[2])/blockEdge));
+        uint64_t kk = key(bx, by, bz);
+        if(s && kk==last) continue;
+        K.push_back(kk);
+        last = kk;
+      }
+    }
+    std::sort(K.begin(), K.end());
+    K.erase(std::unique(K.begin(), K.end()), K.end());
+  });
+
+  //-- allocate (sequentially -- the map is not thread-safe) and list the blocks to update
+  std::vector<uint64_t> all;
+  for(auto& K:keys) all.insert(all.end(), K.begin(), K.end());
+  std::sort(all.begin(), all.end());
+  all.erase(std::unique(all.begin(), all.end()), all.end());
+  std::vector<std::pair<uint64_t, Block*>> visible;
+  visible.reserve(all.size());
+  for(uint64_t k:all) visible.push_back({k, &blocks[k]});
+  allocTime = rai::realTime()-time;
+
+  //-- 2. update all voxels of these blocks, in parallel over blocks (projective distance along the optical axis)
+  time = rai::realTime();
+  std::atomic<uint> next{0};
+  const float trunc = truncation;
+  pool->run([&](uint){
+    for(;;){
+      uint b = next.fetch_add(1);
+      if(b>=visible.size()) break;
+      int bx, by, bz;
+      unkey(visible[b].first, bx, by, bz);
+      Block& blk = *visible[b].second;
+      //camera coordinates of the first voxel center, and the increments along the world axes: cam = R^T (world - t)
+      double o[3] = {(bx*B+.5)*voxelSize-t[0], (by*B+.5)*voxelSize-t[1], (bz*B+.5)*voxelSize-t[2]};
+      double p0[3], ex[3], ey[3], ez[3];
+      for(uint i=0;i<3;i++){
+        p0[i] = R[i]*o[0] + R[3+i]*o[1] + R[6+i]*o[2];
+        ex[i] = R[i]*voxelSize;
+        ey[i] = R[3+i]*voxelSize;
+        ez[i] = R[6+i]*voxelSize;
+      }
+      for(int i=0;i<B;i++) for(int j=0;j<B;j++){
+        double p[3];
+        for(uint a=0;a<3;a++) p[a] = p0[a] + i*ex[a] + j*ey[a];
+        for(int l=0;l<B;l++, p[0]+=ez[0], p[1]+=ez[1], p[2]+=ez[2]){
+          double z = -p[2];
+          if(z<=0.) continue;
+          int u = int(fx*p[0]/z + cx + .5);
+          int v = int(-fy*p[1]/z + cy + .5);
+          if(u<0 || v<0 || u>=int(W) || v>=int(H)) continue;
+          float d = depth.p[v*W+u];
+          if(d<=0.f || d>maxDepth) continue;
+          float sdf = d - float(z);
+          if(sdf < -trunc) continue; //behind the surface: unobserved
+          float tsdf = sdf<trunc ? sdf/trunc : 1.f;
+          uint idx = (i*B+j)*B+l;
+          float w = blk.weight[idx];
+          blk.tsdf[idx] = (blk.tsdf[idx]*w + tsdf)/(w+1.f);
+          if(hasColor && sdf<trunc){
+            const byte *c = image.p + 3*(v*W+u);
+            for(uint a=0;a<3;a++) blk.color[idx][a] = byte((blk.color[idx][a]*w + c[a])/(w+1.f));
+          }
+          blk.weight[idx] = w+1.f<maxWeight ? w+1.f : maxWeight;
+        }
+      }
+    }
+  });
+  integrateTime = rai::realTime()-time;
+  lastBlocks = visible.size();
+}
+
+//===========================================================================
+
+void TSDFFusion::getPointCloud(arr& points, byteA& colors, float minWeight){
+  std::vector<double> P;
+  std::vector<byte> C;
+  for(auto& it:blocks){
+    int bx, by, bz;
+    unkey(it.first, bx, by, bz);
+    const Block& blk = it.second;
+    //neighbor blocks in +x, +y, +z (for zero crossings across the block border)
+    const Block* nb[3] = {0, 0, 0};
+    auto f = blocks.find(key(bx+1, by, bz)); if(f!=blocks.end()) nb[0]=&f->second;
+    f = blocks.find(key(bx, by+1, bz)); if(f!=blocks.end()) nb[1]=&f->second;
+    f = blocks.find(key(bx, by, bz+1)); if(f!=blocks.end()) nb[2]=&f->second;
+    for(int i=0;i<B;i++) for(int j=0;j<B;j++) for(int l=0;l<B;l++){
+      uint idx = (i*B+j)*B+l;
+      if(blk.weight[idx]<minWeight) continue;
+      float s0 = blk.tsdf[idx];
+      for(uint a=0;a<3;a++){
+        int n[3] = {i, j, l};
+        n[a]++;
+        const Block* nblk = &blk;
+        if(n[a]==B){ nblk = nb[a]; n[a]=0; }
+        if(!nblk) continue;
+        uint nidx = (n[0]*B+n[1])*B+n[2];
+        if(nblk->weight[nidx]<minWeight) continue;
+        float s1 = nblk->tsdf[nidx];
+        if((s0>0.f) == (s1>0.f) || s0==s1) continue;
+        //only real surfaces: both sides within the truncation band (not the border between free and unobserved space)
+        if(fabs(s0)>=1.f || fabs(s1)>=1.f) continue;
+        double alpha = s0/(s0-s1);
+        double x[3] = {(bx*B+i+.5)*voxelSize, (by*B+j+.5)*voxelSize, (bz*B+l+.5)*voxelSize};
+        x[a] += alpha*voxelSize;
+        P.insert(P.end(), x, x+3);
+        C.insert(C.end(), blk.color[idx], blk.color[idx]+3);
+      }
+    }
+  }
+  points.resize(P.size()/3, 3);
+  if(P.size()) memcpy(points.p, P.data(), P.size()*sizeof(double));
+  colors.resize(C.size()/3, 3);
+  if(C.size()) memcpy(colors.p, C.data(), C.size());
+}
+
+rai::Frame* TSDFFusion::exportOccupancy(rai::Configuration& C, const char* name, double cellSize, float minWeight){
+  if(cellSize<=0.) cellSize = B*voxelSize;
+
+  //-- occupied cells: voxels within one voxel of the surface
+  float occupied = voxelSize/truncation;
+  std::unordered_set<uint64_t> cells;
+  for(auto& it:blocks){
+    int bx, by, bz;
+    unkey(it.first, bx, by, bz);
+    const Block& blk = it.second;
+    for(int i=0;i<B;i++) for(int j=0;j<B;j++) for(int l=0;l<B;l++){
+      uint idx = (i*B+j)*B+l;
+      if(blk.weight[idx]<minWeight || fabs(blk.tsdf[idx])>occupied) continue;
+      cells.insert(key(int(floor((bx*B+i+.5)*voxelSize/cellSize)),
+                       int(floor((by*B+j+.5)*voxelSize/cellSize)),
+                       int(floor((bz*B+l+.5)*voxelSize/cellSize))));
+    }
+  }
+
+  //-- merge cells into runs along x (sorted by z, y, then x)
+  struct Cell { int x, y, z; };
+  std::vector<Cell> sorted;
+  sorted.reserve(cells.size());
+  for(uint64_t k:cells){ Cell c; unkey(k, c.x, c.y, c.z); sorted.push_back(c); }
+  std::sort(sorted.begin(), sorted.end(), [](const Cell& a, const Cell& b){
+    if(a.z!=b.z) return a.z<b.z;
+    if(a.y!=b.y) return a.y<b.y;
+    return a.x<b.x;
+  });
+
+  //-- replace the boxes of the previous export
+  rai::Frame *base = C.getFrame(name, false);
+  if(!base){
+    base = C.addFrame(name);
+  }else{
+    while(base->children.N) delete base->children.last();
+  }
+
+  uint n=0;
+  for(uint i=0; i<sorted.size();){
+    uint j=i+1;
+    while(j<sorted.size() && sorted[j].z==sorted[i].z && sorted[j].y==sorted[i].y && sorted[j].x==sorted[j-1].x+1) j++;
+    double len = (j-i)*cellSize;
+    C.addFrame(STRING(name <<'_' <<n++), name)
+        ->setShape(rai::ST_box, {len, cellSize, cellSize})
+        .setPosition({sorted[i].x*cellSize + .5*len, (sorted[i].y+.5)*cellSize, (sorted[i].z+.5)*cellSize})
+        .setColor({.5, .5, .8, .5})
+        .setContact(1);
+    i=j;
+  }
+  return base;
+}
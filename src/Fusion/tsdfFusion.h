@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Kin/kin.h>
+#include <Control/CtrlMsgs.h>
+#include <Utils/workerPool.h>
+
+#include <unordered_map>
+#include <memory>
+
+//===========================================================================
+
+/// incremental TSDF fusion of depth images into a world-frame volume (voxel hashing): voxels are allocated in blocks of
+/// 8x8x8 only around observed surfaces; integrate() runs on a worker pool, in parallel over the blocks the camera sees.
+/// Camera convention as in depthData2pointCloud (looking along -z, y up); poses map camera to world coordinates
+struct TSDFFusion {
+  static constexpr int B = 8; ///< voxels per block edge
+  struct Block {
+    float tsdf[B*B*B];      ///< signed distance / truncation, in [-1,1]
+    float weight[B*B*B];    ///< 0: never observed
+    byte color[B*B*B][3];
+    Block();
+  };
+
+  double voxelSize;  ///< fusion/voxelSize [m]
+  double truncation; ///< fusion/truncation [m] -- width of the band around the surface that is updated
+  double maxDepth;   ///< fusion/maxDepth [m] -- farther measurements are ignored
+  float maxWeight;   ///< fusion/maxWeight -- caps the running average (small: adapts faster to a changing scene)
+  uint allocStride;  ///< fusion/allocStride -- pixel stride when finding the blocks to allocate (blocks are much larger than pixels)
+
+  //-- timing of the last integrate [sec]
+  double allocTime=0., integrateTime=0.;
+  uint lastBlocks=0; ///< blocks updated by the last integrate
+
+  TSDFFusion(double _voxelSize=-1., double _truncation=-1., uint nThreads=0);
+
+  /// fuse a depth image (metres, 0: invalid) and optionally a color image of the same size (or empty)
+  void integrate(const floatA& depth, const byteA& image, const arr& fxycxy, const rai::Transformation& camPose);
+  /// fuse the current image of a camera (getImageAndDepth, getFxycxy, getPose)
+  void integrate(rai::CameraAbstraction& cam);
+
+  /// surface points (zero crossings between neighboring voxels, linearly interpolated) with their colors
+  void getPointCloud(arr& points, byteA& colors, float minWeight=1.f);
+  /// occupied cells (voxels within one voxel of the surface) at resolution cellSize (<=0: block size) as box frames with
+  /// contact below the frame 'name' -- replaces the boxes of the previous export; cells are merged into runs along x
+  rai::Frame* exportOccupancy(rai::Configuration& C, const char* name="fusedOccupancy", double cellSize=-1., float minWeight=1.f);
+
+  void clear(){ blocks.clear(); }
+  uint numBlocks() const{ return blocks.size(); }
+  uint numThreads() const{ return pool->numThreads(); }
+
+private:
+  std::unordered_map<uint64_t, Block> blocks; //node-based: Block pointers stay valid when the map grows
+
+  static uint64_t key(int x, int y, int z){
+    const int64_t off = 1<<20;
+    return (uint64_t((x+off)&0x1fffff)<<42) | (uint64_t((y+off)&0x1fffff)<<21) | uint64_t((z+off)&0x1fffff);
+  }
+  static void unkey(uint64_t k, int& x, int& y, int& z){
+    const int64_t off = 1<<20;
+    x = int(int64_t((k>>42)&0x1fffff)-off);
+    y = int(int64_t((k>>21)&0x1fffff)-off);
+    z = int(int64_t(k&0x1fffff)-off);
+  }
+
+  std::unique_ptr<rai::WorkerPool> pool; //(fusion/threads)
+};
+
+//===========================================================================
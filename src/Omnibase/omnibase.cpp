@@ -97,7 +97,7 @@ struct OmnibaseController{
 OmnibaseThread::OmnibaseThread(uint robotID, const uintA &_qIndices, const Var<rai::CtrlCmdMsg> &_cmd, const Var<rai::CtrlStateMsg> &_state)
     : RobotAbstraction(_cmd, _state), Thread("OmnibaseThread", .015){
     init(robotID, _qIndices);
-    writeData = 10;
+    setDataLogLevel(10);
 }
 
 OmnibaseThread::~OmnibaseThread(){
@@ -111,6 +111,7 @@ void OmnibaseThread::init(uint _robotID, const uintA& _qIndices) {
 
   CHECK_EQ(qIndices.N, 3, "");
   qIndices_max = rai::max(qIndices);
+  loopStats.init(STRING("OmnibaseThread" <<robotID), metronome.ticInterval);
 
   //-- basic Kp Kd settings for reference control mode
   outer_Kp = rai::getParameter<double>("Omnibase/outer_Kp", 4.);
@@ -164,6 +165,7 @@ void OmnibaseThread::open(){
 
 void OmnibaseThread::step(){
   steps++;
+  loopStats.tickBegin();
 
   //-- get current state from robot
   arr q_real, qDot_real;
@@ -185,6 +187,7 @@ void OmnibaseThread::step(){
     state_q_real = stateSet->q;
     state_qDot_real = stateSet->qDot;
   }
+  if(robotID==0) tickEvents(ctrlTime); //wakes BotOp::wait when the motion ends
 
   //-- get current ctrl command
   arr q_ref, qDot_ref, qDDot_ref, Kp_ref, Kd_ref, P_compliance;
@@ -194,7 +197,9 @@ void OmnibaseThread::step(){
     //get commanded reference from the reference callback (e.g., sampling a spline reference)
     arr cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref;
     if(cmdGet->ref){
+      loopStats.refBegin();
       cmdGet->ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, state_q_real, state_qDot_real, ctrlTime);
+      loopStats.refEnd();
       CHECK(!cmd_q_ref.N || cmd_q_ref.N > qIndices_max, "");
       CHECK(!cmd_qDot_ref.N || cmd_qDot_ref.N > qIndices_max, "");
       CHECK(!cmd_qDDot_ref.N || cmd_qDDot_ref.N > qIndices_max, "");
@@ -237,6 +242,7 @@ void OmnibaseThread::step(){
     }
     if(err>1.05){ //stall!
       state.set()->stall = 2; //no progress in reference time! for at least 2 iterations (to ensure continuous stall with multiple threads)
+      loopStats.stall();
       cout <<"STALLING - step:" <<steps <<" err: " <<err <<endl;
     }
   }
@@ -258,27 +264,38 @@ void OmnibaseThread::step(){
     v += Jinv * qDot_ref;
   }
 
-  //-- data log?
-  if(writeData>0 && !(steps%1)){
-      if(!dataFile.is_open()) dataFile.open(STRING("z.omnibase"<<robotID <<".dat"));
-      dataFile <<ctrlTime <<' '; //single number
-      q_real.modRaw().write(dataFile); //3
-      q_ref.modRaw().write(dataFile); //3
-      if(writeData>1){
-      qDot_real.modRaw().write(dataFile); //3
-      qDot_ref.modRaw().write(dataFile); //3
-      v.modRaw().write(dataFile); //3
-      qDDot_ref.modRaw().write(dataFile);
-      }
-      dataFile <<endl;
+  //-- data log? (built by setDataLogLevel on the user thread, written asynchronously by the DataLogger thread)
+  {
+    rai::DataLogHandoff::Use log(dataLog);
+    if(log.log){
+      rai::DataLogger::Record rec(*log.log);
+      rec(ctrlTime)(q_real, 3)(q_ref, 3);
+      if(log.log->level>1) rec(qDot_real, 3)(qDot_ref, 3)(v, 3)(qDDot_ref, 3);
+    }
   }
+
   robot->setVelocities(v);
+
+  loopStats.tickEnd();
 }
 
 void OmnibaseThread::close(){
   robot.reset();
 }
 
+void OmnibaseThread::setDataLogLevel(int level){
+  writeData = level;
+  if(level<=0){ dataLog.pause(); return; } //(a later call with the same level continues the file)
+  if(dataLog.resume(level)) return;
+  StringA names = {"ctrlTime", "q", "q_ref"};
+  uintA dims = {1, 3, 3};
+  if(level>1){ names.append(StringA{"qDot", "qDot_ref", "v", "qDDot_ref"}); dims.append(uintA{3, 3, 3, 3}); }
+  dataLog.set(0); //close the previous log (and its file) before opening the same file again
+  auto log = make_shared<rai::DataLogger>(STRING("z.omnibase"<<robotID <<".log"), names, dims);
+  log->level = level;
+  dataLog.set(log);
+}
+
 #else //RAI_Omnibase
 
 OmnibaseThread::~OmnibaseThread(){ NICO }
@@ -286,5 +303,6 @@ void OmnibaseThread::init(uint _robotID, const uintA& _qIndices) { NICO }
 void OmnibaseThread::step(){ NICO }
 void OmnibaseThread::open(){ NICO }
 void OmnibaseThread::close(){ NICO }
+void OmnibaseThread::setDataLogLevel(int level){ NICO }
 
 #endif
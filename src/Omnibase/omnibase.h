@@ -4,13 +4,18 @@
 #include <Core/thread.h>
 #include <Control/ctrlMsg.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/dataLogger.h>
+#include <Utils/loopStats.h>
+#include <Utils/botEvents.h>
 
 struct OmnibaseController;
 
-struct OmnibaseThread : rai::RobotAbstraction, Thread {
+struct OmnibaseThread : rai::RobotAbstraction, Thread, rai::LoopStatsProvider, rai::BotEventSource, rai::DataLogSource {
   OmnibaseThread(uint robotID, const uintA& _qIndices, const Var<rai::CtrlCmdMsg>& _cmd, const Var<rai::CtrlStateMsg>& _state);
   ~OmnibaseThread();
 
+  void setDataLogLevel(int level);
+
 private:
   int robotID=0;
   double outer_Kp;
@@ -22,7 +27,6 @@ private:
   uint qIndices_max=0;
 
   uint steps=0;
-  ofstream dataFile;
   double ctrlTime=0.;
 
   std::shared_ptr<OmnibaseController> robot;
@@ -450,7 +450,7 @@ struct RangerController
 RangerThread::RangerThread(uint robotID, const uintA &_qIndices, const Var<rai::CtrlCmdMsg> &_cmd, const Var<rai::CtrlStateMsg> &_state)
     : RobotAbstraction(_cmd, _state), Thread("RangerThread", .015){
     init(robotID, _qIndices);
-    writeData = 10;
+    setDataLogLevel(10);
 }
 
 RangerThread::~RangerThread(){
@@ -464,6 +464,7 @@ void RangerThread::init(uint _robotID, const uintA& _qIndices) {
 
   CHECK_EQ(qIndices.N, 3, "");
   qIndices_max = rai::max(qIndices);
+  loopStats.init(STRING("RangerThread" <<robotID), metronome.ticInterval);
 
   //-- basic Kp Kd settings for reference control mode
   Kp = rai::getParameter<arr>("Ranger/Kp", arr{20., 20., 20.});
@@ -507,6 +508,7 @@ void RangerThread::open(){
 
 void RangerThread::step(){
   steps++;
+  loopStats.tickBegin();
 
   //-- get current state from robot
   arr q_real, qDot_real;
@@ -528,6 +530,7 @@ void RangerThread::step(){
     state_q_real = stateSet->q;
     state_qDot_real = stateSet->qDot;
   }
+  if(robotID==0) tickEvents(ctrlTime); //wakes BotOp::wait when the motion ends
 
   //-- get current ctrl command
   arr q_ref, qDot_ref, qDDot_ref, P_compliance;
@@ -537,7 +540,9 @@ void RangerThread::step(){
     //get commanded reference from the reference callback (e.g., sampling a spline reference)
     arr cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref;
     if(cmdGet->ref){
+      loopStats.refBegin();
       cmdGet->ref->getReference(cmd_q_ref, cmd_qDot_ref, cmd_qDDot_ref, state_q_real, state_qDot_real, ctrlTime);
+      loopStats.refEnd();
       CHECK(!cmd_q_ref.N || cmd_q_ref.N > qIndices_max, "");
       CHECK(!cmd_qDot_ref.N || cmd_qDot_ref.N > qIndices_max, "");
       CHECK(!cmd_qDDot_ref.N || cmd_qDDot_ref.N > qIndices_max, "");
@@ -578,6 +583,7 @@ void RangerThread::step(){
     double steering_error = abs(robot->real_steering_rad_s-robot->target_steering_rad_s);
     if(err>.3 || steering_error > .1){ //stall!
       state.set()->stall = 2; //no progress in reference time! for at least 2 iterations (to ensure continuous stall with multiple threads)
+      loopStats.stall();
       cout <<"STALLING - step:" <<steps <<" err: " <<err <<endl;
       if (steering_error > .1) {
         robot->setSteeringAngle(robot->target_steering_rad_s);
@@ -603,27 +609,38 @@ void RangerThread::step(){
     qDotTarget = p_term + d_term;
   }
 
-  //-- data log
-  if(writeData>0 && !(steps%1)){
-      if(!dataFile.is_open()) dataFile.open(STRING("z.ranger"<<robotID <<".dat"));
-      dataFile <<ctrlTime <<' ';
-      q_real.modRaw().write(dataFile);
-      q_ref.modRaw().write(dataFile);
-      if(writeData>1){
-      qDot_real.modRaw().write(dataFile);
-      qDot_ref.modRaw().write(dataFile);
-      qDDot_ref.modRaw().write(dataFile);
-      }
-      dataFile <<endl;
+  //-- data log? (built by setDataLogLevel on the user thread, written asynchronously by the DataLogger thread)
+  {
+    rai::DataLogHandoff::Use log(dataLog);
+    if(log.log){
+      rai::DataLogger::Record rec(*log.log);
+      rec(ctrlTime)(q_real, 3)(q_ref, 3);
+      if(log.log->level>1) rec(qDot_real, 3)(qDot_ref, 3)(qDDot_ref, 3);
+    }
   }
 
   robot->setVelocities(qDotTarget);
+
+  loopStats.tickEnd();
 }
 
 void RangerThread::close(){
   robot.reset();
 }
 
+void RangerThread::setDataLogLevel(int level){
+  writeData = level;
+  if(level<=0){ dataLog.pause(); return; } //(a later call with the same level continues the file)
+  if(dataLog.resume(level)) return;
+  StringA names = {"ctrlTime", "q", "q_ref"};
+  uintA dims = {1, 3, 3};
+  if(level>1){ names.append(StringA{"qDot", "qDot_ref", "qDDot_ref"}); dims.append(uintA{3, 3, 3}); }
+  dataLog.set(0); //close the previous log (and its file) before opening the same file again
+  auto log = make_shared<rai::DataLogger>(STRING("z.ranger"<<robotID <<".log"), names, dims);
+  log->level = level;
+  dataLog.set(log);
+}
+
 #else // RAI_RANGER
 
 RangerThread::~RangerThread(){ NICO }
@@ -631,5 +648,6 @@ void RangerThread::init(uint _robotID, const uintA& _qIndices) { NICO }
 void RangerThread::step(){ NICO }
 void RangerThread::open(){ NICO }
 void RangerThread::close(){ NICO }
+void RangerThread::setDataLogLevel(int level){ NICO }
 
 #endif
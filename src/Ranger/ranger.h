@@ -4,13 +4,18 @@
 #include <Core/thread.h>
 #include <Control/ctrlMsg.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/dataLogger.h>
+#include <Utils/loopStats.h>
+#include <Utils/botEvents.h>
 
 struct RangerController;
 
-struct RangerThread : rai::RobotAbstraction, Thread {
+struct RangerThread : rai::RobotAbstraction, Thread, rai::LoopStatsProvider, rai::BotEventSource, rai::DataLogSource {
   RangerThread(uint robotID, const uintA& _qIndices, const Var<rai::CtrlCmdMsg>& _cmd, const Var<rai::CtrlStateMsg>& _state);
   ~RangerThread();
 
+  void setDataLogLevel(int level);
+
 private:
   int robotID=0;
 
@@ -22,7 +27,6 @@ private:
   uint qIndices_max=0;
 
   uint steps=0;
-  ofstream dataFile;
   double ctrlTime=0.;
 
   std::shared_ptr<RangerController> robot;
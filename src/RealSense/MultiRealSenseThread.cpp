@@ -6,6 +6,7 @@
 #include <librealsense2/rsutil.h>
 
 #include "utils.h"
+#include <Utils/depthConvert.h>
 
 
 namespace {
@@ -66,6 +67,26 @@ void setSettings(rs2::pipeline_profile& profile, bool autoExposure, double expos
   }
 }
 
+void setSync(rs2::pipeline_profile& profile, int syncMode) {
+  for(rs2::sensor& sensor : profile.get_device().query_sensors()) {
+    //global timestamps (host clock) on all sensors -- needed to match frames across cameras
+    if(sensor.supports(RS2_OPTION_GLOBAL_TIME_ENABLED)) sensor.set_option(RS2_OPTION_GLOBAL_TIME_ENABLED, 1);
+    if(syncMode && !strcmp(sensor.get_info(RS2_CAMERA_INFO_NAME),"Stereo Module")) {
+      if(sensor.supports(RS2_OPTION_INTER_CAM_SYNC_MODE)) {
+        sensor.set_option(RS2_OPTION_INTER_CAM_SYNC_MODE, syncMode);
+        LOG(1) <<"  inter-cam sync mode " <<syncMode <<(syncMode==1?" (master)":" (slave)");
+      } else {
+        LOG(-1) <<"camera does not support inter-cam sync";
+      }
+    }
+  }
+}
+
+bool isHostTime(const rs2::frame& f){
+  rs2_timestamp_domain d = f.get_frame_timestamp_domain();
+  return d==RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME || d==RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+}
+
 }
 
 #endif
@@ -109,14 +130,16 @@ RealSenseCamera::RealSenseCamera(std::string cameraName, bool captureColor, bool
   pipe = std::make_shared<rs2::pipeline>();
   pipe->start(*cfg);
 
-  bool alignToDepth = rai::getParameter<bool>(STRING("RealSense/" << cameraName << "/alignToDepth"), false);
+  alignToDepth = rai::getParameter<bool>(STRING("RealSense/" << cameraName << "/alignToDepth"), false);
   bool autoExposure = rai::getParameter<bool>(STRING("RealSense/" << cameraName << "/autoExposure"), false);
   double exposure = rai::getParameter<double>(STRING("RealSense/" << cameraName << "/exposure"), 500);
   double white = rai::getParameter<double>(STRING("RealSense/" << cameraName << "/white"), 4000);
   double gain = rai::getParameter<double>(STRING("RealSense/" << cameraName << "/gain"), 50);
+  syncMode = rai::getParameter<int>(STRING("RealSense/" << cameraName << "/syncMode"), 0);
 
   rs2::pipeline_profile profile = pipe->get_active_profile();
   setSettings(profile, autoExposure, exposure, white, gain);
+  setSync(profile, syncMode);
 
   //-- info on all streams
   for(rs2::stream_profile sp : profile.get_streams()) {
@@ -125,8 +148,8 @@ RealSenseCamera::RealSenseCamera(std::string cameraName, bool captureColor, bool
     if(vsp){
       rs2_intrinsics intrinsics = vsp.get_intrinsics();
       LOG(1) <<"  is video: w=" <<intrinsics.width <<" h=" <<intrinsics.height <<" px=" <<intrinsics.ppx << " py=" <<intrinsics.ppy <<" fx=" <<intrinsics.fx <<" fy=" <<intrinsics.fy <<" distorsion=" <<intrinsics.model <<floatA().referTo(intrinsics.coeffs, 5);
-      if(sp.stream_type()==RS2_STREAM_DEPTH) depth_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
-      if(sp.stream_type()==RS2_STREAM_COLOR) color_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
+      if(sp.stream_type()==RS2_STREAM_DEPTH) { depth_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy}; depthIntrinsics = toIntrinsics(intrinsics); }
+      if(sp.stream_type()==RS2_STREAM_COLOR) { color_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy}; colorIntrinsics = toIntrinsics(intrinsics); }
     }
   }
 
@@ -136,13 +159,27 @@ RealSenseCamera::RealSenseCamera(std::string cameraName, bool captureColor, bool
 
   //-- align with depth or color?
   if(captureColor && captureDepth) {
+    if(!rai::getParameter<bool>("RealSense/rs2Align", false)) aligner = std::make_shared<DepthAligner>();
     if(alignToDepth){
-      align = std::make_shared<rs2::align>(RS2_STREAM_DEPTH);
+      if(!aligner) align = std::make_shared<rs2::align>(RS2_STREAM_DEPTH);
       fxycxy = depth_fxycxy;
+      intrinsics = depthIntrinsics;
     }else{
-      align = std::make_shared<rs2::align>(RS2_STREAM_COLOR);
+      if(!aligner) align = std::make_shared<rs2::align>(RS2_STREAM_COLOR);
       fxycxy = color_fxycxy;
+      intrinsics = colorIntrinsics;
     }
+  } else {
+    fxycxy = captureDepth ? depth_fxycxy : color_fxycxy;
+    intrinsics = captureDepth ? depthIntrinsics : colorIntrinsics;
+  }
+
+  //-- depth post-processing off the capture thread?
+  StringA stages = DepthFilterPipeline::stagesFromConfig();
+  if(captureDepth && stages.N) {
+    int alignTo = align ? (alignToDepth ? RS2_STREAM_DEPTH : RS2_STREAM_COLOR) : -1;
+    filters = std::make_shared<DepthFilterPipeline>(stages, rai::getParameter<int>("RealSense/filterThreads", 2), alignTo,
+                                                    [this](const rs2::frameset& processed){ publishFrameset(processed); });
   }
 }
 
@@ -157,6 +194,7 @@ MultiRealSenseThread::MultiRealSenseThread(const std::vector<std::string> camera
     cameraNames(cameraNames),
     color(this, color),
     depth(this, depth),
+    frameset(this),
     captureColor(captureColor),
     captureDepth(captureDepth)
 {
@@ -176,14 +214,24 @@ uint MultiRealSenseThread::getNumberOfCameras() {
 
 void MultiRealSenseThread::open() {
   rs2::log_to_console(RS2_LOG_SEVERITY_ERROR);
+  skewTolerance = rai::getParameter<double>("RealSense/skewTolerance", skewTolerance);
 
   for(const auto& cameraName : cameraNames) {
     cameras.push_back(new RealSenseCamera(cameraName, captureColor, captureDepth));
   }
+
+  //-- one capture thread per camera: a slow or stalled camera does not throttle the others
+  for(auto camera : cameras) {
+    camera->capturing = true;
+    camera->capture = std::thread([camera]{ while(camera->capturing) camera->grab(); });
+  }
 }
 
 void MultiRealSenseThread::close() {
   LOG(0) << "REALSENSE STOPPING";
+  for(auto cam : cameras) cam->capturing = false;
+  for(auto cam : cameras) if(cam->capture.joinable()) cam->capture.join();
+  for(auto cam : cameras) cam->filters.reset(); //joins the workers
   for(auto cam : cameras) {
     cam->pipe->stop();
     rai::wait(0.2);
@@ -192,54 +240,165 @@ void MultiRealSenseThread::close() {
   cameras.clear();
 }
 
+MultiRealSenseThread::SyncStats MultiRealSenseThread::getSyncStats() {
+  SyncStats S;
+  for(auto cam : cameras) S.fps.push_back(cam->fps);
+  S.framesets = framesets;
+  S.rejected = rejected;
+  S.skew.set(skewHist);
+  return S;
+}
+
 void MultiRealSenseThread::step() {
-  std::vector<byteA> colorNew;
-  std::vector<floatA> depthNew;
-  for(auto camera : cameras) {
-    rs2::frameset data;
-    try {
-      data = camera->pipe->wait_for_frames(); // Wait for next set of frames from the camera
-    } catch(rs2::error& err) {
-      LOG(-1) <<"Can't get frames from RealSense: " << err.what();
-      return;
+  if(!cameras.size()) return;
+
+  //-- the first camera's next frame defines the frameset time
+  Frameset F;
+  F.frames.resize(cameras.size());
+  if(!cameras[0]->waitNext(F.frames[0], lastRefCount, 1.)) {
+    LOG(-1) <<"no frames from camera '" <<cameras[0]->cameraName <<"'";
+    return;
+  }
+  lastRefCount = F.frames[0].count;
+  F.time = RealSenseCamera::matchTime(F.frames[0]);
+
+  //-- all others: the closest frame -- waiting (at most skewTolerance) for frames that are not there yet
+  double tmin=F.time, tmax=F.time;
+  for(uint i=1; i<cameras.size(); i++) {
+    RealSenseCamera* camera = cameras[i];
+    double deadline = rai::realTime() + skewTolerance;
+    rai::CameraFrame f;
+    while(!(camera->getLatest(f) && RealSenseCamera::matchTime(f)>=F.time) && rai::realTime()<deadline) {
+      camera->waitNext(f, f.count, deadline-rai::realTime());
     }
+    if(!camera->nearest(F.frames[i], F.time)) { rejected++; return; }
+    double t = RealSenseCamera::matchTime(F.frames[i]);
+    if(t<tmin) tmin=t;
+    if(t>tmax) tmax=t;
+  }
+  F.skew = tmax-tmin;
+  if(F.skew>skewTolerance) { rejected++; return; }
+
+  //-- publish
+  skewHist.record(uint64_t(1e9*F.skew));
+  F.count = ++framesets;
+  if(captureColor) {
+    std::vector<byteA> colorNew;
+    for(const rai::CameraFrame& f : F.frames) colorNew.push_back(*f.image);
+    color.set() = std::move(colorNew);
+  }
+  if(captureDepth) {
+    std::vector<floatA> depthNew;
+    for(const rai::CameraFrame& f : F.frames) depthNew.push_back(*f.depth);
+    depth.set() = std::move(depthNew);
+  }
+  frameset.set() = F;
+}
 
-    rs2::frameset processed;
-    if(captureColor & captureDepth) {
-      processed = camera->align->process(data);
-    } else {
-      processed = data;
-    }
+bool RealSenseCamera::grab() {
+  rs2::frameset data;
+  try {
+    if(!pipe->try_wait_for_frames(&data, 500)) return false; //bounded, so that capture threads stop promptly
+  } catch(rs2::error& err) {
+    LOG(-1) <<"Can't get frames from RealSense '" <<cameraName <<"': " << err.what();
+    return false;
+  }
+
+  if(filters) { //filtered, aligned and published by the workers
+    filters->submit(data);
+    return true;
+  }
 
-    if(captureColor) {
+  if(align) {
+    publishFrameset(align->process(data));
+  } else {
+    publishFrameset(data); //single stream, or aligned while filling the buffers
+  }
+  return true;
+}
+
+void RealSenseCamera::publishFrameset(const rs2::frameset& processed) {
+  rai::CameraFrame F;
+  int64_t frameNumber=-1;
+
+  //-- unaligned frames: align while filling the buffers (tables rebuilt only if the resolution changed)
+  const uint16_t *depthData=0;
+  uint depthW=0, depthH=0;
+  if(captureDepth) {
+    rs2::depth_frame rs_depth = processed.get_depth_frame();
+    depthData = reinterpret_cast<const uint16_t*>(rs_depth.get_data());
+    depthW = rs_depth.get_width();
+    depthH = rs_depth.get_height();
+    if(aligner) {
       rs2::video_frame rs_color = processed.get_color_frame();
-      byteA colorArr;
-      colorArr.resize(rs_color.get_height(), rs_color.get_width(), 3);
-      CHECK(rs_color.get_bytes_per_pixel()==3,"");
-      memmove(colorArr.p, rs_color.get_data(), colorArr.N);
-      colorNew.push_back(std::move(colorArr));
+      if(depthW!=aligner->depth.width || depthH!=aligner->depth.height) aligner->set(rs_depth.get_profile(), rs_color.get_profile(), depth_scale);
+      if(alignToDepth) {
+        auto C = imagePool.acquire();
+        C->resize(depthH, depthW, 3);
+        aligner->colorToDepth(C->p, reinterpret_cast<const byte*>(rs_color.get_data()), depthData);
+        F.image = C;
+      } else {
+        alignedDepth.resize(rs_color.get_height(), rs_color.get_width());
+        aligner->depthToColor(alignedDepth.p, depthData);
+        depthData = alignedDepth.p;
+        depthW = alignedDepth.d1;
+        depthH = alignedDepth.d0;
+      }
     }
+  }
 
-    if(captureDepth) {
-      rs2::depth_frame rs_depth = processed.get_depth_frame();
+  if(captureColor) {
+    rs2::video_frame rs_color = processed.get_color_frame();
+    CHECK(rs_color.get_bytes_per_pixel()==3,"");
+    if(!F.image) {
+      auto C = imagePool.acquire();
+      C->resize(rs_color.get_height(), rs_color.get_width(), 3);
+      memmove(C->p, rs_color.get_data(), C->N);
+      F.image = C;
+    }
+    F.deviceTime = 1e-3*rs_color.get_timestamp();
+    F.deviceTimeIsHost = isHostTime(rs_color);
+    frameNumber = rs_color.get_frame_number();
+  }
 
-      /*rs2::hole_filling_filter hole_filter(2);
-      rs_depth = hole_filter.process(rs_depth);*/
+  if(captureDepth) {
+    rs2::depth_frame rs_depth = processed.get_depth_frame();
+
+    /*rs2::hole_filling_filter hole_filter(2);
+    rs_depth = hole_filter.process(rs_depth);*/
+
+    auto D = depthPool.acquire();
+    D->resize(depthH, depthW);
+    CHECK_EQ(rs_depth.get_bits_per_pixel(), 16, "");
+    CHECK_EQ(rs_depth.get_stride_in_bytes(), rs_depth.get_width()*2, "");
+    rai::convertZ16ToMeters(D->p, depthData, D->N, depth_scale);
+    F.depth = D;
+    F.deviceTime = 1e-3*rs_depth.get_timestamp(); //depth time if both are captured
+    F.deviceTimeIsHost = isHostTime(rs_depth);
+    frameNumber = rs_depth.get_frame_number();
+  }
 
-      floatA depthArr;
-      depthArr.resize(rs_depth.get_height(), rs_depth.get_width());
-      CHECK_EQ(rs_depth.get_bits_per_pixel(), 16, "");
-      CHECK_EQ(rs_depth.get_stride_in_bytes(), rs_depth.get_width()*2, "");
-      const uint16_t *data = reinterpret_cast<const uint16_t*>(rs_depth.get_data());
-      for(uint i=0;i<depthArr.N;i++){
-        depthArr.p[i] = float(data[i]) * camera->depth_scale;
-      }
-      depthNew.push_back(std::move(depthArr));
-    }
+  publishFrame(F, frameNumber);
+
+  //-- achieved frame rate, and the history for matching
+  std::lock_guard<std::mutex> lock(historyMux);
+  if(history.size()) {
+    double dt = matchTime(F) - matchTime(history.back());
+    if(dt>0.) fps = fps>0. ? .9*fps + .1/dt : 1./dt;
   }
+  history.push_back(F);
+  if(history.size()>4) history.pop_front();
+}
 
-  if(captureColor) color.set() = std::move(colorNew);
-  if(captureDepth) depth.set() = std::move(depthNew);
+bool RealSenseCamera::nearest(rai::CameraFrame& f, double t) {
+  std::lock_guard<std::mutex> lock(historyMux);
+  if(!history.size()) return false;
+  const rai::CameraFrame* best=0;
+  for(const rai::CameraFrame& h : history) {
+    if(!best || fabs(matchTime(h)-t) < fabs(matchTime(*best)-t)) best=&h;
+  }
+  f = *best;
+  return true;
 }
 
 
@@ -249,8 +408,13 @@ RealSenseCamera::RealSenseCamera(std::string serialNumber, bool captureColor, bo
 
 MultiRealSenseThread::MultiRealSenseThread(const std::vector<std::string> cameraNames, const Var<std::vector<byteA>>& color, const Var<std::vector<floatA>>& depth, bool captureColor, bool captureDepth)
   : Thread("MultiRealSenseThread") { NICO }
+bool RealSenseCamera::grab() { NICO }
+void RealSenseCamera::publishFrameset(const rs2::frameset& processed) { NICO }
+bool RealSenseCamera::nearest(rai::CameraFrame& f, double t) { NICO }
+
 MultiRealSenseThread::~MultiRealSenseThread() { NICO }
 uint MultiRealSenseThread::getNumberOfCameras() { NICO }
+MultiRealSenseThread::SyncStats MultiRealSenseThread::getSyncStats() { NICO }
 void MultiRealSenseThread::open(){ NICO }
 void MultiRealSenseThread::close(){ NICO }
 void MultiRealSenseThread::step(){ NICO }
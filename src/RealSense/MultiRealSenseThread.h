@@ -2,12 +2,21 @@
 
 #include <Core/array.h>
 #include <Core/thread.h>
+#include <Utils/cameraFrames.h>
+#include <Utils/rayTable.h>
+#include <Utils/framePool.h>
+#include <Utils/loopStats.h>
+#include "depthFilters.h"
+#include "depthAlign.h"
 #include <unordered_map>
+#include <deque>
+#include <thread>
 
 namespace rs2 {
 struct config;
 struct pipeline;
 struct align;
+class frameset;
 }
 
 namespace rai {
@@ -15,26 +24,72 @@ namespace realsense {
 
 extern std::unordered_map<std::string, std::string> cameraMapping;
 
-struct RealSenseCamera {
+struct RealSenseCamera : rai::FrameSource, rai::IntrinsicsSource {
   std::string cameraName;
   bool captureColor;
   bool captureDepth;
   std::string serialNumber;
   std::shared_ptr<rs2::config> cfg;
   std::shared_ptr<rs2::pipeline> pipe;
-  std::shared_ptr<rs2::align> align;
+  std::shared_ptr<rs2::align> align;           ///< RealSense/rs2Align only
+  std::shared_ptr<DepthAligner> aligner;       ///< lookup-table alignment of color and depth (default)
+  bool alignToDepth=false;
+  std::shared_ptr<DepthFilterPipeline> filters; ///< RealSense/filters: post-processing (and alignment) on workers
   float depth_scale;
   arr fxycxy, color_fxycxy, depth_fxycxy;
+  rai::CameraIntrinsics intrinsics, colorIntrinsics, depthIntrinsics; ///< full intrinsics (incl. distortion): of the published images, and per stream
+  int syncMode=0;          ///< RealSense/<name>/syncMode: inter-cam hardware sync (0: off, 1: master, 2: slave)
+  std::atomic<double> fps{0.}; ///< achieved frame rate (smoothed over the last ~10 frames)
 
   RealSenseCamera(std::string cameraName, bool captureColor, bool captureDepth);
+
+  /// capture one frame (blocking) and publish it (or hand it to the filters) -- the body of the camera's capture thread
+  bool grab();
+  /// aligned frames -> pooled buffers -> publishFrame and the matching history
+  void publishFrameset(const rs2::frameset& processed);
+  /// the recent frame closest in time to t (false if there is none yet)
+  bool nearest(rai::CameraFrame& f, double t);
+  rai::CameraIntrinsics getIntrinsics(){ return intrinsics; }
+
+  /// the time used for matching frames across cameras: device time if it is in the host clock, otherwise the host time
+  static double matchTime(const rai::CameraFrame& f){ return f.deviceTimeIsHost ? f.deviceTime : f.hostTime; }
+
+private:
+  rai::FramePool<byte> imagePool;
+  rai::FramePool<float> depthPool;
+  uint16A alignedDepth;
+  std::mutex historyMux;
+  std::deque<rai::CameraFrame> history; //last few frames, for matching
+  std::thread capture;
+  std::atomic<bool> capturing{false};
+  friend struct MultiRealSenseThread;
 };
 
+/// every camera captures in its own thread; this thread assembles framesets by matching each frame of the first camera
+/// with the closest-in-time frames of all others, and publishes them only if they lie within RealSense/skewTolerance
 struct MultiRealSenseThread : Thread {
+  /// one frame per camera, captured (nearly) simultaneously
+  struct Frameset {
+    uint64_t count=0;
+    double time=0.; ///< match time of the first camera's frame
+    double skew=0.; ///< max - min match time over all cameras
+    std::vector<rai::CameraFrame> frames;
+  };
+
+  struct SyncStats {
+    std::vector<double> fps;       ///< per camera
+    uint64_t framesets=0;          ///< published
+    uint64_t rejected=0;           ///< skew above tolerance, or a camera had no frame
+    rai::LoopStats::Summary skew;  ///< of the published framesets
+  };
+
   std::vector<std::string> cameraNames;
   Var<std::vector<byteA>> color;
   Var<std::vector<floatA>> depth;
+  Var<Frameset> frameset;
   bool captureColor;
   bool captureDepth;
+  double skewTolerance=.02; ///< RealSense/skewTolerance [sec]
 
   std::vector<RealSenseCamera*> cameras;
 
@@ -45,10 +100,18 @@ struct MultiRealSenseThread : Thread {
   ~MultiRealSenseThread();
 
   uint getNumberOfCameras();
+  /// timestamped frames of camera i (getLatest/waitNext), as captured -- the Vars color/depth/frameset are set per matched frameset
+  rai::FrameSource& frames(uint i){ CHECK_LE(i+1, cameras.size(), "camera " <<i <<" out of range"); return *cameras[i]; }
+  SyncStats getSyncStats();
 
   void open();
   void close();
   void step();
+
+private:
+  uint64_t lastRefCount=0;
+  std::atomic<uint64_t> framesets{0}, rejected{0};
+  rai::LatencyHistogram skewHist;
 };
 
 }
@@ -5,6 +5,9 @@
 #include <librealsense2/rs.hpp>
 #include <librealsense2/rsutil.h>
 #include "utils.h"
+#include "depthAlign.h"
+#include <Utils/depthConvert.h>
+#include <Utils/framePool.h>
 
 rs2_stream find_stream_to_align(const std::vector<rs2::stream_profile>& streams);
 
@@ -12,17 +15,26 @@ struct sRealSenseThread{
   std::shared_ptr<rs2::config> cfg;
   std::shared_ptr<rs2::pipeline> pipe;
   std::shared_ptr<rs2::align> align;
+  std::shared_ptr<rai::realsense::DepthAligner> aligner; //lookup-table alignment (unless RealSense/rs2Align): frames stay unaligned until publishFrameset
+  bool alignToDepth=false;
+  uint16A alignedDepth;
   float depth_scale;
   rs2_intrinsics depth_intrinsics;
 
-  rs2::temporal_filter temp_filter;
-  rs2::hole_filling_filter hole_filter;
+  std::shared_ptr<rai::realsense::DepthFilterPipeline> filters; //RealSense/filters: post-processing (and alignment) on workers
+  bool updateIntrinsics=false; //decimation with alignToDepth: fxycxy of the decimated depth
+  std::mutex intrinsicsMux;
+  rai::CameraIntrinsics intrinsics, colorIntrinsics, depthIntrinsics; //full intrinsics: of the aligned-to stream (guarded by intrinsicsMux), and per stream
+
+  bool rawDepth=false;
+  rai::FramePool<byte> imagePool;
+  rai::FramePool<float> depthPool;
+  rai::FramePool<uint16_t> depthRawPool;
 };
 
 RealSenseThread::RealSenseThread(const char *_name)
   : Thread("RealSenseThread"),
-    image(this),
-    depth(this){
+    frame(this){
   if(_name) CameraAbstraction::name=_name;
   threadOpen(true);
   threadLoop();
@@ -33,15 +45,24 @@ RealSenseThread::~RealSenseThread(){
   threadClose();
 }
 
-void RealSenseThread::getImageAndDepth(byteA& _image, floatA& _depth){
+RealSenseThread::Frame RealSenseThread::getFrame(){
   uint n=60;
-  if(image.getRevision()<n){
+  if(frame.getRevision()<n){
     LOG(0) <<"waiting to get " <<n <<" images from RealSense for autoexposure settling";
-    image.waitForRevisionGreaterThan(n); //need many starting images for autoexposure to get settled!!
-    depth.waitForRevisionGreaterThan(n);
+    frame.waitForRevisionGreaterThan(n); //need many starting images for autoexposure to get settled!!
+  }
+  return frame.get();
+}
+
+void RealSenseThread::getImageAndDepth(byteA& _image, floatA& _depth){
+  Frame F = getFrame();
+  _image = *F.image;
+  if(F.depth){
+    _depth = *F.depth;
+  }else{
+    _depth.resize(F.depthRaw->d0, F.depthRaw->d1);
+    rai::convertZ16ToMeters(_depth.p, F.depthRaw->p, _depth.N, F.depthScale);
   }
-  _image = image.get();
-  _depth = depth.get();
 }
 
 void RealSenseThread::open(){
@@ -53,6 +74,7 @@ void RealSenseThread::open(){
   double white = rai::getParameter<double>("RealSense/white", 4000);
 
   s = new sRealSenseThread;
+  s->rawDepth = rai::getParameter<bool>("RealSense/rawDepth", false);
 
   s->cfg = std::make_shared<rs2::config>();
   if(resolution==480){
@@ -136,8 +158,8 @@ void RealSenseThread::open(){
     if(vsp){
       rs2_intrinsics intrinsics = vsp.get_intrinsics();
       LOG(1) <<"  is video: w=" <<intrinsics.width <<" h=" <<intrinsics.height <<" px=" <<intrinsics.ppx << " py=" <<intrinsics.ppy <<" fx=" <<intrinsics.fx <<" fy=" <<intrinsics.fy <<" distorsion=" <<intrinsics.model <<floatA().referTo(intrinsics.coeffs, 5);
-      if(sp.stream_type()==RS2_STREAM_DEPTH) depth_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
-      if(sp.stream_type()==RS2_STREAM_COLOR) color_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
+      if(sp.stream_type()==RS2_STREAM_DEPTH){ depth_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy}; s->depthIntrinsics = rai::realsense::toIntrinsics(intrinsics); }
+      if(sp.stream_type()==RS2_STREAM_COLOR){ color_fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy}; s->colorIntrinsics = rai::realsense::toIntrinsics(intrinsics); }
     }
 
     if(sp.stream_type()==RS2_STREAM_COLOR) rs2_get_video_stream_intrinsics(sp.get(), &s->depth_intrinsics, NULL);
@@ -148,17 +170,32 @@ void RealSenseThread::open(){
   LOG(1) <<"depth scale: " <<s->depth_scale;
 
   //-- align with depth or color?
+  s->alignToDepth = alignToDepth;
+  if(!rai::getParameter<bool>("RealSense/rs2Align", false)) s->aligner = std::make_shared<rai::realsense::DepthAligner>();
   if(alignToDepth){
     s->align = std::make_shared<rs2::align>(RS2_STREAM_DEPTH);
     fxycxy = depth_fxycxy;
+    s->intrinsics = s->depthIntrinsics;
   }else{
     s->align = std::make_shared<rs2::align>(RS2_STREAM_COLOR);
     fxycxy = color_fxycxy;
+    s->intrinsics = s->colorIntrinsics;
+  }
+
+  //-- depth post-processing off the capture thread?
+  StringA filters = rai::realsense::DepthFilterPipeline::stagesFromConfig();
+  if(filters.N){
+    s->updateIntrinsics = alignToDepth && filters.contains(rai::String("decimation"));
+    s->filters = std::make_shared<rai::realsense::DepthFilterPipeline>(filters, rai::getParameter<int>("RealSense/filterThreads", 2),
+                                                                       s->aligner ? -1 : (alignToDepth ? RS2_STREAM_DEPTH : RS2_STREAM_COLOR),
+                                                                       [this](const rs2::frameset& processed){ publishFrameset(processed); });
   }
 }
 
 void RealSenseThread::close(){
   LOG(0) <<"STOPPING";
+  s->filters.reset(); //joins the workers
+  s->aligner.reset();
   s->pipe->stop();
   rai::wait(.1);
   delete s;
@@ -173,41 +210,96 @@ void RealSenseThread::step(){
     return;
   }
 
-  rs2::frameset processed = s->align->process(data);
-//  rs2::frameset processed = data;
+  if(s->filters){ //filtered, aligned and published by the workers
+    s->filters->submit(data);
+    return;
+  }
 
+  if(s->aligner) publishFrameset(data); //aligned while filling the buffers
+  else publishFrameset(s->align->process(data));
+}
+
+void RealSenseThread::publishFrameset(const rs2::frameset& processed){
   rs2::depth_frame rs_depth = processed.get_depth_frame();
   rs2::video_frame rs_color = processed.get_color_frame();
 
-//  rs2::depth_frame rs_depth2 = s->temp_filter.process(rs_depth);
-//  rs_depth = rs_depth2;
-//  rs_depth = s->hole_filter.process(rs_depth2);
-
-  {
-    auto depthSet = depth.set();
-    depthSet->resize(rs_depth.get_height(), rs_depth.get_width());
-#if 0
-    for(uint y=0;y<depthSet->d0;y++) for(uint x=0;x<depthSet->d1;x++){
-      float d = rs_depth.get_distance(x,y);
-      if(d>2.) d=2.;
-      depthSet->p[y*depthSet->d1+x] = d;
+  if(s->updateIntrinsics){
+    rs2_intrinsics intrinsics = rs_depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+    fxycxy = arr{intrinsics.fx, intrinsics.fy, intrinsics.ppx, intrinsics.ppy};
+    {
+      std::lock_guard<std::mutex> lock(s->intrinsicsMux);
+      s->intrinsics = rai::realsense::toIntrinsics(intrinsics);
     }
-#else
-    CHECK_EQ(rs_depth.get_bits_per_pixel(), 16, "");
-    CHECK_EQ(rs_depth.get_stride_in_bytes(), rs_depth.get_width()*2, "");
-    const uint16_t *data = reinterpret_cast<const uint16_t*>(rs_depth.get_data());
-    for(uint i=0;i<depthSet->N;i++){
-      depthSet->p[i] = float(data[i])*s->depth_scale;
+    s->updateIntrinsics = false;
+  }
+
+  //-- fill pooled buffers (same size each frame -> no allocation) and publish them as one immutable frame
+  Frame F;
+  F.depthScale = s->depth_scale;
+  CHECK_EQ(rs_depth.get_bits_per_pixel(), 16, "");
+  CHECK_EQ(rs_depth.get_stride_in_bytes(), rs_depth.get_width()*2, "");
+  CHECK(rs_color.get_bytes_per_pixel()==3,"");
+  const uint16_t *depthData = reinterpret_cast<const uint16_t*>(rs_depth.get_data());
+  uint depthW = rs_depth.get_width(), depthH = rs_depth.get_height();
+
+  if(s->aligner){ //the frames are unaligned: align while filling the buffers (tables rebuilt only if the resolution changed)
+    if(depthW!=s->aligner->depth.width || depthH!=s->aligner->depth.height) s->aligner->set(rs_depth.get_profile(), rs_color.get_profile(), s->depth_scale);
+    if(s->alignToDepth){
+      auto C = s->imagePool.acquire();
+      C->resize(depthH, depthW, 3);
+      s->aligner->colorToDepth(C->p, reinterpret_cast<const byte*>(rs_color.get_data()), depthData);
+      F.image = C;
+    }else{
+      s->alignedDepth.resize(rs_color.get_height(), rs_color.get_width());
+      s->aligner->depthToColor(s->alignedDepth.p, depthData);
+      depthData = s->alignedDepth.p;
+      depthW = s->alignedDepth.d1;
+      depthH = s->alignedDepth.d0;
     }
-#endif
   }
 
-  {
-    auto colorSet = image.set();
-    colorSet->resize(rs_color.get_height(), rs_color.get_width(), 3);
-    CHECK(rs_color.get_bytes_per_pixel()==3,"");
-    memmove(colorSet->p, rs_color.get_data(), colorSet->N);
+  if(s->rawDepth){
+    auto D = s->depthRawPool.acquire();
+    D->resize(depthH, depthW);
+    memcpy(D->p, depthData, D->N*sizeof(uint16_t));
+    F.depthRaw = D;
+  }else{
+    auto D = s->depthPool.acquire();
+    D->resize(depthH, depthW);
+    rai::convertZ16ToMeters(D->p, depthData, D->N, s->depth_scale);
+    F.depth = D;
+  }
+
+  if(!F.image){
+    auto C = s->imagePool.acquire();
+    C->resize(rs_color.get_height(), rs_color.get_width(), 3);
+    memcpy(C->p, rs_color.get_data(), C->N);
+    F.image = C;
   }
+
+  frame.set() = F;
+
+  //-- the same buffers as a timestamped frame (device time is in the host clock when the camera runs in global time)
+  rai::CameraFrame CF;
+  CF.image = F.image;
+  CF.depth = F.depth;
+  CF.depthRaw = F.depthRaw;
+  CF.depthScale = F.depthScale;
+  CF.deviceTime = 1e-3*rs_depth.get_timestamp();
+  CF.deviceTimeIsHost = (rs_depth.get_frame_timestamp_domain()==RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME
+                         || rs_depth.get_frame_timestamp_domain()==RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME);
+  publishFrame(CF, rs_depth.get_frame_number());
+}
+
+rai::realsense::DepthFilterPipeline::Stats RealSenseThread::getFilterStats(){
+  if(!s || !s->filters) return {};
+  return s->filters->getStats();
+}
+
+rai::CameraIntrinsics RealSenseThread::getIntrinsics(){
+  CHECK(s, "camera not open");
+  std::lock_guard<std::mutex> lock(s->intrinsicsMux);
+  return s->intrinsics;
 }
 
 void rs2_get_motion_intrinsics(const rs2_stream_profile* mode, rs2_motion_device_intrinsic * intrinsics, rs2_error ** error);
@@ -216,9 +308,13 @@ void rs2_get_motion_intrinsics(const rs2_stream_profile* mode, rs2_motion_device
 
 RealSenseThread::RealSenseThread(const char *_name) : Thread("RealSenseThread") { NICO }
 RealSenseThread::~RealSenseThread(){ NICO }
+RealSenseThread::Frame RealSenseThread::getFrame(){ NICO }
 void RealSenseThread::getImageAndDepth(byteA& _image, floatA& _depth){ NICO }
 void RealSenseThread::open(){ NICO }
 void RealSenseThread::close(){ NICO }
 void RealSenseThread::step(){ NICO }
+void RealSenseThread::publishFrameset(const rs2::frameset& processed){ NICO }
+rai::realsense::DepthFilterPipeline::Stats RealSenseThread::getFilterStats(){ NICO }
+rai::CameraIntrinsics RealSenseThread::getIntrinsics(){ NICO }
 
 #endif
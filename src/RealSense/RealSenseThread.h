@@ -3,23 +3,42 @@
 #include <Core/array.h>
 #include <Core/thread.h>
 #include <Control/CtrlMsgs.h>
+#include <Utils/cameraFrames.h>
+#include <Utils/rayTable.h>
+#include "depthFilters.h"
 
-namespace rs2 { class pipeline; }
+namespace rs2 { class pipeline; class frameset; }
+
+struct RealSenseThread : Thread, rai::CameraAbstraction, rai::FrameSource, rai::IntrinsicsSource {
+  /// one captured frame: immutable and shared -- consumers may keep it as long as they like, the buffers return to the
+  /// thread's frame pool once released (no per-frame allocation or copy)
+  struct Frame {
+    std::shared_ptr<const byteA> image;
+    std::shared_ptr<const floatA> depth;      ///< metres (null with RealSense/rawDepth)
+    std::shared_ptr<const uint16A> depthRaw;  ///< Z16 camera units (only with RealSense/rawDepth)
+    float depthScale=0.;                      ///< metres per depthRaw unit
+  };
 
-struct RealSenseThread : Thread, rai::CameraAbstraction {
   struct sRealSenseThread *s=0;
-  Var<byteA> image;
-  Var<floatA> depth;
+  Var<Frame> frame;
   arr fxycxy, color_fxycxy, depth_fxycxy;
 
   RealSenseThread(const char *_name);
   ~RealSenseThread();
 
+  /// the latest frame, without copying -- waits for auto-exposure settling (like getImageAndDepth); getLatest/waitNext never do
+  Frame getFrame();
+  /// copies into the caller's arrays (converts raw depth if necessary)
   virtual void getImageAndDepth(byteA& _image, floatA& _depth);
   arr getFxycxy(){ return fxycxy; }
+  /// full intrinsics (incl. distortion) of the stream the images are aligned to
+  rai::CameraIntrinsics getIntrinsics();
+  /// timing of the depth post-processing stages (RealSense/filters) -- empty without filters
+  rai::realsense::DepthFilterPipeline::Stats getFilterStats();
 
 protected:
   void open();
   void close();
   void step();
+  void publishFrameset(const rs2::frameset& processed); //aligned frames -> pooled buffers -> frame
 };
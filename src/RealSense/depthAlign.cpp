@@ -0,0 +1,190 @@
+#include "depthAlign.h"
+
+#include <cmath>
+
+#ifdef RAI_REALSENSE
+#include <librealsense2/rs.hpp>
+#include "utils.h"
+#endif
+
+namespace rai {
+namespace realsense {
+
+DepthAligner::DepthAligner(uint nThreads)
+  : pool(nThreads ? nThreads : rai::getParameter<int>("RealSense/alignThreads", 2)){
+  for(uint i=0;i<9;i++) R[i] = (i%4==0);
+  for(uint i=0;i<3;i++) t[i] = 0.f;
+}
+
+//===========================================================================
+
+void DepthAligner::set(const rai::CameraIntrinsics& _depth, const rai::CameraIntrinsics& _color, const float* _R, const float* _t, float _depthScale){
+  bool changed = (_depth!=depth || _color!=color || _depthScale!=depthScale);
+  for(uint i=0;i<9;i++) if(_R[i]!=R[i]) changed=true;
+  for(uint i=0;i<3;i++) if(_t[i]!=t[i]) changed=true;
+  if(!changed) return;
+  depth = _depth;
+  color = _color;
+  memcpy(R, _R, sizeof(R));
+  memcpy(t, _t, sizeof(t));
+  depthScale = _depthScale;
+  colorDistorted = color.hasDistortion();
+  cornerRays.clear();
+  centerRays.clear();
+  distortion.clear();
+}
+
+void DepthAligner::buildRays(floatA& rays, uint W, uint H, double offset){
+  rays.resize(H, W, 3);
+  float *r = rays.p;
+  for(uint v=0;v<H;v++) for(uint u=0;u<W;u++, r+=3){
+    double x, y;
+    depth.undistort(x, y, u+offset, v+offset);
+    for(uint i=0;i<3;i++) r[i] = R[i]*x + R[3+i]*y + R[6+i];
+  }
+}
+
+void DepthAligner::buildDistortion(){
+  //-- the undistorted field of view of the color camera (its border pixels), plus a margin
+  float x0=1e10f, y0=1e10f, x1=-1e10f, y1=-1e10f;
+  auto extend = [&](double u, double v){
+    double x, y;
+    color.undistort(x, y, u, v);
+    x0=std::min(x0, float(x));  x1=std::max(x1, float(x));
+    y0=std::min(y0, float(y));  y1=std::max(y1, float(y));
+  };
+  for(uint u=0;u<=color.width;u++){ extend(u-.5, -.5); extend(u-.5, color.height-.5); }
+  for(uint v=0;v<=color.height;v++){ extend(-.5, v-.5); extend(color.width-.5, v-.5); }
+  gridStep = 1./std::max(color.fx, color.fy);
+  gridX0 = x0 - 2.f*gridStep;
+  gridY0 = y0 - 2.f*gridStep;
+  uint gw = uint((x1-gridX0)/gridStep) + 4, gh = uint((y1-gridY0)/gridStep) + 4;
+
+  distortion.resize(gh, gw, 2);
+  float *g = distortion.p;
+  for(uint j=0;j<gh;j++) for(uint i=0;i<gw;i++, g+=2){
+    double u, v;
+    color.distort(u, v, gridX0+i*gridStep, gridY0+j*gridStep);
+    g[0]=u;  g[1]=v;
+  }
+}
+
+bool DepthAligner::project(int& x, int& y, float z, const float* ray) const{
+  float p[3] = {z*ray[0]+t[0], z*ray[1]+t[1], z*ray[2]+t[2]};
+  if(p[2]<=0.f) return false;
+  float iz = 1.f/p[2], u, v;
+  if(colorDistorted){ //bilinear in the distortion grid -- outside of it is outside of the color image
+    float gx = (p[0]*iz-gridX0)/gridStep, gy = (p[1]*iz-gridY0)/gridStep;
+    if(gx<0.f || gy<0.f || gx>=distortion.d1-1 || gy>=distortion.d0-1) return false;
+    int i=gx, j=gy;
+    float a=gx-i, b=gy-j;
+    const float *g00 = distortion.p + 2*(j*distortion.d1+i), *g10 = g00+2*distortion.d1;
+    u = (1.f-b)*((1.f-a)*g00[0] + a*g00[2]) + b*((1.f-a)*g10[0] + a*g10[2]);
+    v = (1.f-b)*((1.f-a)*g00[1] + a*g00[3]) + b*((1.f-a)*g10[1] + a*g10[3]);
+  }else{
+    u = color.fx*p[0]*iz + color.cx;
+    v = color.fy*p[1]*iz + color.cy;
+  }
+  u += .5f;  v += .5f; //round to the nearest pixel (negative: outside anyway -- avoids the floor call)
+  x = u<0.f ? -1 : int(u);
+  y = v<0.f ? -1 : int(v);
+  return true;
+}
+
+//===========================================================================
+
+void DepthAligner::depthToColor(uint16_t* out, const uint16_t* in){
+  const int W=depth.width, H=depth.height, CW=color.width, CH=color.height;
+  if(!cornerRays.N){
+    buildRays(cornerRays, W+1, H+1, -.5);
+    rects.resize(W*H);
+    rowSpan.resize(H, 2);
+  }
+  if(colorDistorted && !distortion.N) buildDistortion();
+  uint n = numThreads();
+
+  //-- color pixels covered by each depth pixel (tiles of depth rows)
+  pool.run([&](uint k){
+    for(int v=k*H/n; v<int((k+1)*H/n); v++){
+      int ymin=CH, ymax=-1;
+      for(int u=0; u<W; u++){
+        Rect& r = rects.p[v*W+u];
+        r.x0 = -1;
+        if(!in[v*W+u]) continue;
+        float z = depthScale*in[v*W+u];
+        int x0, y0, x1, y1;
+        if(!project(x0, y0, z, cornerRays.p+3*(v*(W+1)+u))) continue;
+        if(!project(x1, y1, z, cornerRays.p+3*((v+1)*(W+1)+u+1))) continue;
+        if(x0>x1) std::swap(x0, x1);
+        if(y0>y1) std::swap(y0, y1);
+        if(x1<0 || y1<0 || x0>=CW || y0>=CH) continue;
+        r.x0 = std::max(x0, 0);  r.x1 = std::min(x1, CW-1);
+        r.y0 = std::max(y0, 0);  r.y1 = std::min(y1, CH-1);
+        ymin = std::min(ymin, int(r.y0));
+        ymax = std::max(ymax, int(r.y1));
+      }
+      rowSpan.p[2*v] = ymin;
+      rowSpan.p[2*v+1] = ymax;
+    }
+  });
+
+  //-- splat into the color image (tiles of color rows: no two workers write the same pixel)
+  pool.run([&](uint k){
+    int c0 = k*CH/n, c1 = (k+1)*CH/n;
+    memset(out+c0*CW, 0, (c1-c0)*CW*sizeof(uint16_t));
+    for(int v=0; v<H; v++){
+      if(rowSpan.p[2*v+1]<c0 || rowSpan.p[2*v]>=c1) continue;
+      for(int u=0; u<W; u++){
+        const Rect& r = rects.p[v*W+u];
+        if(r.x0<0) continue;
+        uint16_t d = in[v*W+u];
+        for(int y=std::max(int(r.y0), c0); y<=std::min(int(r.y1), c1-1); y++){
+          uint16_t *o = out + y*CW;
+          for(int x=r.x0; x<=r.x1; x++) if(!o[x] || d<o[x]) o[x] = d;
+        }
+      }
+    }
+  });
+}
+
+void DepthAligner::colorToDepth(byte* out, const byte* in, const uint16_t* depthIn, uint bytesPerPixel){
+  const int W=depth.width, H=depth.height, CW=color.width, CH=color.height;
+  if(!centerRays.N) buildRays(centerRays, W, H, 0.);
+  if(colorDistorted && !distortion.N) buildDistortion();
+  uint n = numThreads();
+
+  pool.run([&](uint k){
+    for(int v=k*H/n; v<int((k+1)*H/n); v++){
+      for(int u=0; u<W; u++){
+        byte *o = out + bytesPerPixel*(v*W+u);
+        int x, y;
+        if(!depthIn[v*W+u] || !project(x, y, depthScale*depthIn[v*W+u], centerRays.p+3*(v*W+u)) || x<0 || y<0 || x>=CW || y>=CH){
+          for(uint i=0;i<bytesPerPixel;i++) o[i]=0;
+          continue;
+        }
+        const byte *c = in + bytesPerPixel*(y*CW+x);
+        for(uint i=0;i<bytesPerPixel;i++) o[i]=c[i];
+      }
+    }
+  });
+}
+
+//===========================================================================
+
+#ifdef RAI_REALSENSE
+
+void DepthAligner::set(const rs2::stream_profile& depthProfile, const rs2::stream_profile& colorProfile, float _depthScale){
+  rs2_extrinsics X = depthProfile.get_extrinsics_to(colorProfile);
+  set(toIntrinsics(depthProfile.as<rs2::video_stream_profile>().get_intrinsics()),
+      toIntrinsics(colorProfile.as<rs2::video_stream_profile>().get_intrinsics()),
+      X.rotation, X.translation, _depthScale);
+}
+
+#else //REALSENSE
+
+void DepthAligner::set(const rs2::stream_profile& depthProfile, const rs2::stream_profile& colorProfile, float _depthScale){ NICO }
+
+#endif
+
+} //namespace
+} //namespace
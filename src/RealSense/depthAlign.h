@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Core/array.h>
+#include <Utils/rayTable.h>
+#include <Utils/workerPool.h>
+
+namespace rs2 { class stream_profile; }
+
+namespace rai {
+namespace realsense {
+
+//===========================================================================
+//
+// depth <-> color alignment by lookup tables, replacing rs2::align per frame: for a fixed pair of intrinsics and
+// extrinsics, the undistorted and rotated rays of all depth pixels are computed once -- aligning a frame is then a
+// multiply-add, a division and a rounding per pixel. Row tiles run on a small worker pool.
+//
+// rai.cfg:
+//   RealSense/rs2Align: false   (true: use rs2::align instead)
+//   RealSense/alignThreads: 2
+//
+
+struct DepthAligner {
+  rai::CameraIntrinsics depth, color;
+  float R[9], t[3];   ///< depth to color extrinsics, as rs2_extrinsics (R column-major, t in metres)
+  float depthScale=0; ///< metres per Z16 unit
+
+  DepthAligner(uint nThreads=0); ///< 0: RealSense/alignThreads
+
+  /// (re)set the cameras -- the tables are rebuilt (lazily) only if anything changed
+  void set(const rai::CameraIntrinsics& _depth, const rai::CameraIntrinsics& _color, const float* _R, const float* _t, float _depthScale);
+  /// the same, from the depth and color stream profiles of a pipeline
+  void set(const rs2::stream_profile& depthProfile, const rs2::stream_profile& colorProfile, float _depthScale);
+
+  /// Z16 depth (depth.height x depth.width) -> Z16 depth on the color image's pixels (color.height x color.width, 0: none);
+  /// each depth pixel covers the color pixels between its projected corners, where two overlap the nearer one wins
+  void depthToColor(uint16_t* out, const uint16_t* in);
+  /// color image (color.height x color.width x bytesPerPixel) -> on the depth image's pixels (depth.height x depth.width x
+  /// bytesPerPixel): the color pixel each depth pixel projects to (0: no depth, or outside the color image)
+  void colorToDepth(byte* out, const byte* in, const uint16_t* depthIn, uint bytesPerPixel=3);
+
+  uint numThreads() const{ return pool.numThreads(); }
+
+private:
+  floatA cornerRays; //(depth.height+1) x (depth.width+1) x 3: rotated rays of the pixel corners (u-.5, v-.5), z=1 before rotation
+  floatA centerRays; //depth.height x depth.width x 3: rotated rays of the pixel centers
+  struct Rect { int16_t x0, y0, x1, y1; }; //color pixels covered by a depth pixel (x0<0: none)
+  rai::Array<Rect> rects;
+  intA rowSpan; //per depth row: min and max color row covered
+  bool colorDistorted=false;
+  floatA distortion; //color lens distortion: pixel of undistorted normalized coordinates, on a grid of one-pixel steps (interpolated)
+  float gridX0=0.f, gridY0=0.f, gridStep=1.f;
+
+  void buildRays(floatA& rays, uint W, uint H, double offset);
+  void buildDistortion();
+  bool project(int& x, int& y, float z, const float* ray) const;
+
+  WorkerPool pool;
+};
+
+} //namespace
+} //namespace
@@ -0,0 +1,241 @@
+#include "depthFilters.h"
+
+#ifdef RAI_REALSENSE
+
+#include <librealsense2/rs.hpp>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace rai {
+namespace realsense {
+
+namespace {
+
+std::shared_ptr<rs2::filter> makeFilter(const rai::String& name){
+  if(name=="decimation"){
+    auto f = std::make_shared<rs2::decimation_filter>();
+    f->set_option(RS2_OPTION_FILTER_MAGNITUDE, rai::getParameter<double>("RealSense/decimation/magnitude", 2));
+    return f;
+  }
+  if(name=="spatial"){
+    auto f = std::make_shared<rs2::spatial_filter>();
+    f->set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, rai::getParameter<double>("RealSense/spatial/alpha", .5));
+    f->set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, rai::getParameter<double>("RealSense/spatial/delta", 20));
+    f->set_option(RS2_OPTION_FILTER_MAGNITUDE, rai::getParameter<double>("RealSense/spatial/iterations", 2));
+    return f;
+  }
+  if(name=="temporal"){
+    auto f = std::make_shared<rs2::temporal_filter>();
+    f->set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, rai::getParameter<double>("RealSense/temporal/alpha", .4));
+    f->set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, rai::getParameter<double>("RealSense/temporal/delta", 20));
+    return f;
+  }
+  if(name=="holeFilling"){
+    return std::make_shared<rs2::hole_filling_filter>(rai::getParameter<int>("RealSense/holeFilling/mode", 1));
+  }
+  if(name=="clamp"){
+    return std::make_shared<rs2::threshold_filter>(rai::getParameter<double>("RealSense/clamp/min", .1),
+                                                   rai::getParameter<double>("RealSense/clamp/max", 4.));
+  }
+  HALT("unknown depth filter '" <<name <<"' (available: decimation, spatial, temporal, holeFilling, clamp)");
+  return {};
+}
+
+bool isOrdered(const rai::String& name){ return name=="temporal"; } //stateful: needs the frames in capture order
+
+int64_t nanos(){ return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+} //namespace
+
+//===========================================================================
+
+struct sDepthFilterPipeline {
+  struct Job { uint64_t seq; rs2::frameset data; };
+  struct Worker {
+    std::vector<std::shared_ptr<rs2::filter>> filters; //stateless stages: own instance; ordered stages: the shared one
+    std::shared_ptr<rs2::align> align;
+    std::thread thread;
+  };
+
+  StringA names;
+  std::vector<bool> ordered;
+  std::vector<std::shared_ptr<rs2::filter>> shared; //instances of the ordered stages
+  int alignTo;
+  DepthFilterPipeline::Publish publish;
+  std::vector<Worker> workers;
+
+  //job queue
+  std::mutex mux;
+  std::condition_variable cond;
+  std::deque<Job> queue;
+  uint maxQueue;
+  uint64_t seq=0, submitted=0, dropped=0, published=0;
+  bool stop=false;
+
+  //ordered sections: turn[k] is the seq that may enter ordered stage k (the last one is publish)
+  std::mutex turnMux;
+  std::condition_variable turnCond;
+  std::vector<uint64_t> turn;
+
+  //per-stage timing (workers record concurrently, the histograms have a single writer)
+  std::mutex statsMux;
+  std::deque<rai::LatencyHistogram> times; //not movable -- no vector
+
+  void run(Worker& w);
+  void enter(uint k, uint64_t seq){
+    std::unique_lock<std::mutex> lock(turnMux);
+    turnCond.wait(lock, [&]{ return turn[k]==seq; });
+  }
+  void leave(uint k){
+    { std::lock_guard<std::mutex> lock(turnMux); turn[k]++; }
+    turnCond.notify_all();
+  }
+  void record(uint k, int64_t t0){
+    std::lock_guard<std::mutex> lock(statsMux);
+    times[k].record(nanos()-t0);
+  }
+};
+
+void sDepthFilterPipeline::run(Worker& w){
+  uint nOrdered=0;
+  for(bool o:ordered) if(o) nOrdered++;
+  for(;;){
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mux);
+      cond.wait(lock, [&]{ return stop || queue.size(); });
+      if(!queue.size()) return; //stop
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    //-- the stages (after a failure, only pass through the ordered sections, so that later frames are not blocked)
+    rs2::frame f = job.data;
+    bool ok=true;
+    uint o=0;
+    for(uint k=0; k<names.N; k++){
+      if(ordered[k]) enter(o, job.seq);
+      if(ok){
+        int64_t t0 = nanos();
+        try{ f = w.filters[k]->process(f); }
+        catch(rs2::error& err){ LOG(-1) <<"depth filter '" <<names(k) <<"' failed: " <<err.what(); ok=false; }
+        record(k, t0);
+      }
+      if(ordered[k]) leave(o++);
+    }
+    rs2::frameset processed = f;
+    if(ok && w.align){
+      int64_t t0 = nanos();
+      try{ processed = w.align->process(processed); }
+      catch(rs2::error& err){ LOG(-1) <<"align failed: " <<err.what(); ok=false; }
+      record(names.N, t0);
+    }
+
+    //-- publish in capture order
+    enter(nOrdered, job.seq);
+    if(ok){
+      int64_t t0 = nanos();
+      publish(processed);
+      record(times.size()-1, t0);
+      std::lock_guard<std::mutex> lock(mux);
+      published++;
+    }
+    leave(nOrdered);
+  }
+}
+
+//===========================================================================
+
+DepthFilterPipeline::DepthFilterPipeline(const StringA& stages, uint threads, int alignTo, const Publish& publish){
+  s = new sDepthFilterPipeline;
+  s->names = stages;
+  s->alignTo = alignTo;
+  s->publish = publish;
+  if(!threads) threads=1;
+  s->maxQueue = threads;
+
+  uint nOrdered=0;
+  for(const rai::String& n:stages){
+    s->ordered.push_back(isOrdered(n));
+    s->shared.push_back(isOrdered(n) ? makeFilter(n) : std::shared_ptr<rs2::filter>());
+    if(isOrdered(n)) nOrdered++;
+  }
+  s->turn.assign(nOrdered+1, 0);
+  for(uint k=0; k<stages.N + (alignTo>=0 ? 1 : 0) + 1; k++) s->times.emplace_back();
+
+  s->workers.resize(threads);
+  for(sDepthFilterPipeline::Worker& w:s->workers){
+    for(uint k=0; k<stages.N; k++) w.filters.push_back(s->ordered[k] ? s->shared[k] : makeFilter(stages(k)));
+    if(alignTo>=0) w.align = std::make_shared<rs2::align>(rs2_stream(alignTo));
+  }
+  for(sDepthFilterPipeline::Worker& w:s->workers){
+    sDepthFilterPipeline *_s = s;
+    w.thread = std::thread([_s, &w]{ _s->run(w); });
+  }
+  LOG(1) <<"depth filters " <<stages <<" on " <<threads <<" threads";
+}
+
+DepthFilterPipeline::~DepthFilterPipeline(){
+  {
+    std::lock_guard<std::mutex> lock(s->mux);
+    s->stop = true;
+  }
+  s->cond.notify_all();
+  for(sDepthFilterPipeline::Worker& w:s->workers) w.thread.join(); //the queue is drained first
+  delete s;
+}
+
+void DepthFilterPipeline::submit(const rs2::frameset& data){
+  {
+    std::lock_guard<std::mutex> lock(s->mux);
+    s->submitted++;
+    if(s->queue.size()>=s->maxQueue){ s->dropped++; return; } //do not hold on to more frames than librealsense can spare
+    s->queue.push_back({s->seq++, data});
+  }
+  s->cond.notify_one();
+}
+
+DepthFilterPipeline::Stats DepthFilterPipeline::getStats(){
+  Stats S;
+  {
+    std::lock_guard<std::mutex> lock(s->mux);
+    S.submitted = s->submitted;
+    S.dropped = s->dropped;
+    S.published = s->published;
+  }
+  std::lock_guard<std::mutex> lock(s->statsMux);
+  for(uint k=0; k<s->times.size(); k++){
+    StageStats& st = S.stages.append();
+    if(k<s->names.N) st.name = s->names(k);
+    else if(k+1<s->times.size()) st.name = "align";
+    else st.name = "publish";
+    st.time.set(s->times[k]);
+  }
+  return S;
+}
+
+StringA DepthFilterPipeline::stagesFromConfig(){
+  return rai::getParameter<StringA>("RealSense/filters", {});
+}
+
+} //namespace
+} //namespace
+
+#else //REALSENSE
+
+namespace rai {
+namespace realsense {
+
+DepthFilterPipeline::DepthFilterPipeline(const StringA& stages, uint threads, int alignTo, const Publish& publish){ NICO }
+DepthFilterPipeline::~DepthFilterPipeline(){ NICO }
+void DepthFilterPipeline::submit(const rs2::frameset& data){ NICO }
+DepthFilterPipeline::Stats DepthFilterPipeline::getStats(){ NICO }
+StringA DepthFilterPipeline::stagesFromConfig(){ NICO }
+
+} //namespace
+} //namespace
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Core/array.h>
+#include <Utils/loopStats.h>
+
+#include <functional>
+
+namespace rs2 { class frameset; }
+
+namespace rai {
+namespace realsense {
+
+//===========================================================================
+//
+// depth post-processing off the capture thread: the capture thread only submits framesets; a small worker pool runs the
+// filter stages (and the alignment) and publishes the results in capture order. Stateless stages run in parallel on
+// per-worker instances; the temporal filter (which needs the previous frame) and the publish step run in frame order.
+//
+// rai.cfg:
+//   RealSense/filters: [decimation, spatial, temporal, holeFilling, clamp]   (any subset, in this order or any other)
+//   RealSense/filterThreads: 2
+//   RealSense/decimation/magnitude: 2
+//   RealSense/spatial/alpha: .5,  RealSense/spatial/delta: 20,  RealSense/spatial/iterations: 2
+//   RealSense/temporal/alpha: .4, RealSense/temporal/delta: 20
+//   RealSense/holeFilling/mode: 1   (0: fill from left, 1: farthest from around, 2: nearest from around)
+//   RealSense/clamp/min: .1,  RealSense/clamp/max: 4.   (metres -- depth outside is set to 0)
+//
+
+struct DepthFilterPipeline {
+  struct StageStats {
+    rai::String name;
+    rai::LoopStats::Summary time; ///< per frame, seconds
+  };
+  struct Stats {
+    uint64_t submitted=0; ///< framesets handed over by the capture thread
+    uint64_t dropped=0;   ///< not processed since all workers were busy and the queue was full
+    uint64_t published=0;
+    rai::Array<StageStats> stages; ///< the filter stages, then "align" (if aligning) and "publish"
+  };
+
+  typedef std::function<void(const rs2::frameset&)> Publish;
+
+  /// alignTo: an rs2_stream to align the filtered frames to (-1: none); publish is called in capture order, never concurrently
+  DepthFilterPipeline(const StringA& stages, uint threads, int alignTo, const Publish& publish);
+  ~DepthFilterPipeline();
+
+  /// capture thread: hand over a frameset -- never blocks
+  void submit(const rs2::frameset& data);
+  Stats getStats();
+
+  /// the stages listed in RealSense/filters (empty: no post-processing)
+  static StringA stagesFromConfig();
+
+private:
+  struct sDepthFilterPipeline *s=0;
+};
+
+} //namespace
+} //namespace
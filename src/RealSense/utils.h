@@ -4,6 +4,7 @@
 
 #include <librealsense2/rs.hpp>
 #include <librealsense2/rsutil.h>
+#include <Utils/rayTable.h>
 
 namespace rai {
 namespace realsense {
@@ -19,6 +20,16 @@ inline float get_depth_scale(rs2::device dev) {
   throw std::runtime_error("Device does not have a depth sensor");
 }
 
+/// full intrinsics (incl. distortion -- the model numbers coincide) of a video stream
+inline rai::CameraIntrinsics toIntrinsics(const rs2_intrinsics& in) {
+  rai::CameraIntrinsics I;
+  I.width = in.width;  I.height = in.height;
+  I.fx = in.fx;  I.fy = in.fy;  I.cx = in.ppx;  I.cy = in.ppy;
+  I.model = in.model;
+  for(uint i=0;i<5;i++) I.coeffs[i] = in.coeffs[i];
+  return I;
+}
+
 }
 }
 
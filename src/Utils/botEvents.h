@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+
+namespace rai {
+
+//===========================================================================
+
+/// wake-up signal for BotOp::wait: the control thread (motion end), grippers (done) and the viewer (key press) notify,
+/// wait blocks until something happened instead of polling. The control thread only ever touches an atomic (tick): the
+/// motion end it flags is turned into a notification by the waker thread, which polls (every wakerPeriod) only while
+/// a motion end is armed
+struct BotEvents {
+  std::mutex mux;
+  std::condition_variable cond, armed;
+  uint64_t count=0;
+
+  /// end time of the current motion, armed by the waiting thread (>=0); -1: nothing armed, -2: passed, not yet notified
+  std::atomic<double> motionEnd{-1.};
+
+  BotEvents(double _wakerPeriod=.001) : wakerPeriod(_wakerPeriod), waker([this]{ wakerLoop(); }) {}
+  ~BotEvents(){
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      quit=true;
+    }
+    armed.notify_all();
+    waker.join();
+  }
+
+  void notify(){
+    {
+      std::lock_guard<std::mutex> lock(mux);
+      count++;
+    }
+    cond.notify_all();
+  }
+
+  uint64_t revision(){
+    std::lock_guard<std::mutex> lock(mux);
+    return count;
+  }
+
+  /// block until a notification after 'revision' (true), or timeout (false)
+  bool waitForNotification(uint64_t revision, double timeout){
+    std::unique_lock<std::mutex> lock(mux);
+    return cond.wait_for(lock, std::chrono::duration<double>(timeout), [&]{ return count!=revision; });
+  }
+
+  void armMotionEnd(double endTime){
+    motionEnd.store(endTime, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> lock(mux);
+    }
+    armed.notify_all();
+  }
+
+  /// called by the lead control thread each tick (real-time safe: no lock, no syscall): a single atomic load unless the
+  /// armed motion end was just passed, then flags it for the waker
+  void tick(double ctrlTime){
+    double e = motionEnd.load(std::memory_order_acquire);
+    if(e>=0. && ctrlTime>=e) motionEnd.compare_exchange_strong(e, -2.);
+  }
+
+private:
+  double wakerPeriod;
+  bool quit=false;
+  std::thread waker; //(declared last: started once all other members are initialized)
+
+  void wakerLoop(){
+    std::unique_lock<std::mutex> lock(mux);
+    while(!quit){
+      double e = motionEnd.load(std::memory_order_acquire);
+      if(e==-2.){
+        if(motionEnd.compare_exchange_strong(e, -1.)){ count++; cond.notify_all(); }
+      }else if(e<0.){
+        armed.wait(lock, [&]{ return quit || motionEnd.load(std::memory_order_acquire)!=-1.; });
+      }else{
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::duration<double>(wakerPeriod));
+        lock.lock();
+      }
+    }
+  }
+};
+
+//===========================================================================
+
+/// mixin for threads that signal BotEvents (BotOp attaches its events via dynamic_cast; the events outlive the thread)
+struct BotEventSource {
+  std::atomic<BotEvents*> events{0};
+  virtual ~BotEventSource(){}
+
+  void notifyEvents(){ BotEvents* e=events.load(std::memory_order_acquire); if(e) e->notify(); }
+  void tickEvents(double ctrlTime){ BotEvents* e=events.load(std::memory_order_acquire); if(e) e->tick(ctrlTime); }
+};
+
+} //namespace
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "loopStats.h"
+
+#include <Core/array.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace rai {
+
+//===========================================================================
+
+/// one camera frame with its provenance -- image and depth are shared and immutable
+struct CameraFrame {
+  uint64_t count=0;        ///< frame counter of the source (1, 2, ...)
+  double deviceTime=-1.;   ///< capture time: the device timestamp, in the host clock if deviceTimeIsHost (sec)
+  double hostTime=0.;      ///< when the frame was published on the host (system clock, sec since epoch)
+  bool deviceTimeIsHost=false; ///< deviceTime is comparable to hostTime (RealSense global time) -- otherwise e.g. the device or simulation clock
+  std::shared_ptr<const byteA> image;
+  std::shared_ptr<const floatA> depth;      ///< metres (null if the source delivers depthRaw)
+  std::shared_ptr<const uint16A> depthRaw;  ///< Z16 camera units (RealSense/rawDepth)
+  float depthScale=0.;                      ///< metres per depthRaw unit
+  std::shared_ptr<const uintA> segmentation; ///< per-pixel frame IDs (simulation with botsim/segmentation)
+};
+
+/// counters of a FrameSource
+struct CameraFrameStats {
+  uint64_t frames=0;  ///< frames published
+  uint64_t dropped=0; ///< frames the device produced but the source never published (gaps in the device frame numbers)
+  uint64_t skipped=0; ///< published frames a consumer never saw (gaps between consecutive getLatest/waitNext results)
+  uint64_t stale=0;   ///< getLatest calls that found no newer frame
+  LoopStats::Summary latency; ///< hostTime - deviceTime (only frames with deviceTimeIsHost)
+  LoopStats::Summary render;   ///< time to render a frame (rendering sources only)
+  LoopStats::Summary stateAge; ///< age of the state a frame shows when it is published (rendering sources only)
+};
+
+//===========================================================================
+
+/// mixin for cameras with a timestamped frame stream (BotOp finds it via dynamic_cast): producers call publishFrame,
+/// consumers poll with getLatest or block with waitNext -- both pass the count of the frame they have already seen
+struct FrameSource {
+  virtual ~FrameSource(){}
+
+  /// non-blocking: the latest frame if its count is larger than 'after' (true), otherwise false and f is untouched
+  bool getLatest(CameraFrame& f, uint64_t after=0){
+    pollFrame();
+    std::lock_guard<std::mutex> lock(frameMux);
+    if(latest.count<=after){ frameStale++; return false; }
+    take(f, after);
+    return true;
+  }
+
+  /// blocking: wait for a frame with count larger than 'after' (false on timeout)
+  bool waitNext(CameraFrame& f, uint64_t after, double timeout=1.){
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    for(;;){
+      pollFrame();
+      std::unique_lock<std::mutex> lock(frameMux);
+      if(latest.count>after){ take(f, after); return true; }
+      auto wakeup = std::chrono::steady_clock::now() + std::chrono::duration<double>(pollPeriod>0. ? pollPeriod : timeout);
+      if(wakeup>deadline) wakeup=deadline;
+      frameCond.wait_until(lock, wakeup, [&]{ return latest.count>after; });
+      if(latest.count>after){ take(f, after); return true; }
+      if(std::chrono::steady_clock::now()>=deadline) return false;
+    }
+  }
+
+  uint64_t frameCount(){ std::lock_guard<std::mutex> lock(frameMux); return latest.count; }
+
+  CameraFrameStats getFrameStats(){
+    CameraFrameStats S;
+    std::lock_guard<std::mutex> lock(frameMux);
+    S.frames = latest.count;
+    S.dropped = frameDropped;
+    S.skipped = frameSkipped;
+    S.stale = frameStale;
+    S.latency.set(frameLatency);
+    S.render.set(frameRender);
+    S.stateAge.set(frameStateAge);
+    return S;
+  }
+
+  static double hostNow(){ return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count(); }
+
+protected:
+  double pollPeriod=0.; //>0: pull-driven source (frames are produced in pollFrame) -- waitNext polls at this period
+
+  /// producer: publish a frame (count and hostTime are set here); deviceFrameNumber (if known) detects dropped frames
+  void publishFrame(CameraFrame& f, int64_t deviceFrameNumber=-1){
+    f.hostTime = hostNow();
+    {
+      std::lock_guard<std::mutex> lock(frameMux);
+      if(f.deviceTimeIsHost && f.deviceTime>0. && f.hostTime>=f.deviceTime) frameLatency.record(uint64_t(1e9*(f.hostTime-f.deviceTime)));
+      if(deviceFrameNumber>=0 && lastDeviceFrameNumber>=0 && deviceFrameNumber>lastDeviceFrameNumber+1) frameDropped += deviceFrameNumber-lastDeviceFrameNumber-1;
+      lastDeviceFrameNumber = deviceFrameNumber;
+      f.count = latest.count+1;
+      latest = f;
+    }
+    frameCond.notify_all();
+  }
+
+  /// rendering sources: timing of the frame about to be published (single producer)
+  void recordRender(double renderTime, double stateAge){
+    frameRender.record(uint64_t(1e9*renderTime));
+    if(stateAge>0.) frameStateAge.record(uint64_t(1e9*stateAge));
+  }
+
+  /// pull-driven sources produce (and publish) a new frame here if one is due
+  virtual void pollFrame(){}
+
+private:
+  std::mutex frameMux;
+  std::condition_variable frameCond;
+  CameraFrame latest;
+  int64_t lastDeviceFrameNumber=-1;
+  uint64_t frameDropped=0, frameSkipped=0, frameStale=0;
+  LatencyHistogram frameLatency, frameRender, frameStateAge;
+
+  void take(CameraFrame& f, uint64_t after){
+    if(after && latest.count>after+1) frameSkipped += latest.count-after-1;
+    f = latest;
+  }
+};
+
+} //namespace
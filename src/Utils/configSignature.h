@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Kin/kin.h>
+#include <Kin/frame.h>
+
+#include <cstdint>
+
+namespace rai {
+
+//===========================================================================
+//
+// signature of a configuration's structure -- which frames exist, their parents, joints and shapes (by identity, not by
+// value): consumers that keep their own copy of a configuration (viewers, renderers) compare it to notice that the copy
+// needs a refresh. Frame count alone misses deletes followed by adds, attach/detach and replaced shapes. Identities are
+// pointers: the signature only compares states of the same Configuration object, not copies. Without the tree, parents
+// and joints are left out (for consumers that restore the kinematic tree themselves -- attaching creates joints)
+//
+
+inline uint64_t structureSignature(const rai::Configuration& C, bool tree=true){
+  uint64_t h = 1469598103934665603ull; //FNV-1a over 64-bit words
+  auto mix = [&h](uint64_t x){ h = (h^x)*1099511628211ull; };
+  mix(C.frames.N);
+  for(rai::Frame *f:C.frames){
+    mix(uint64_t(f));
+    if(tree){
+      mix(f->parent ? f->parent->ID : uint64_t(-1));
+      mix(uint64_t(f->joint));
+    }
+    mix(uint64_t(f->shape));
+    if(f->shape) mix(uint64_t(f->shape->type()));
+  }
+  return h;
+}
+
+} //namespace
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "seqlock.h"
+
+#include <Core/array.h>
+#include <Control/ctrlMsg.h>
+#include <Control/CtrlMsgs.h>
+
+#include <mutex>
+#include <thread>
+
+namespace rai {
+
+//===========================================================================
+//
+// wait-free alternative to the Var<CtrlStateMsg>/Var<CtrlCmdMsg> pair shared between control threads and BotOp:
+// - each control thread (writer) owns one SeqLock'ed state slot and publishes its joints without taking any lock
+// - the user side reads all slots and merges them into a consistent (ctrlTime, q, qDot, tauExternal) tuple
+// - the command is published by the user side into a DoubleBuffer; control threads only copy it when its revision changed
+// - the command's reference lives in a small slot table: when the user side switches to a new reference, the old slot is
+//   released after a grace period in which no control thread is still inside pullCmd (control threads never wait)
+//
+
+struct CtrlChannel {
+  static constexpr uint maxDim = 32;
+  static constexpr uint maxWriters = 4;
+  static constexpr uint maxRefs = 2; //the current reference and the one being switched to
+
+  struct StateSlot {
+    double ctrlTime;
+    double q[maxDim], qDot[maxDim], tauExternalIntegral[maxDim];
+    uint tauExternalCount;
+    bool owned[maxDim]; //which joints this writer publishes
+  };
+
+  struct CmdSlot {
+    rai::ControlType controlType;
+    int refIndex; //index into refs (-1: no reference)
+    uint Kp_d0, Kp_d1, Kd_d0, Kd_d1, P_d0, P_d1;
+    double Kp[maxDim*maxDim], Kd[maxDim*maxDim], P_compliance[maxDim*maxDim];
+  };
+
+  SeqLock<StateSlot> states[maxWriters];
+  std::atomic<double> ctrlTime{0.};
+  std::atomic<int> stall{0};
+  DoubleBuffer<CmdSlot> cmd;
+
+  //reference slots: written only by the user side, and only while no control thread can read them
+  std::shared_ptr<rai::ReferenceFeed> refs[maxRefs];
+  std::atomic<uint> pulling{0}; //number of control threads currently inside pullCmd
+
+  //user side (may block other user threads, never the control threads)
+  std::mutex userMutex;
+  CmdSlot userCmd;
+  arr tauLastIntegral;
+  uint tauLastCount=0;
+
+  CtrlChannel(){
+    memset((void*)&userCmd, 0, sizeof(CmdSlot));
+    userCmd.refIndex=-1;
+    cmd.write(userCmd); //control threads pulling before the first publishCmd get 'no reference'
+    for(uint w=0;w<maxWriters;w++){
+      StateSlot& s = states[w].writeBegin();
+      memset((void*)&s, 0, sizeof(StateSlot));
+      states[w].writeEnd();
+    }
+  }
+
+  //-- control thread side
+
+  /// called once (before the loop) to declare which joints writer 'w' owns
+  void initWriter(uint w, const uintA& qIndices){
+    CHECK_LE(w+1, maxWriters, "too many control threads for the CtrlChannel");
+    StateSlot& s = states[w].writeBegin();
+    for(uint i=0;i<qIndices.N;i++){
+      uint j=qIndices.elem(i);
+      CHECK_LE(j+1, maxDim, "CtrlChannel::maxDim too small");
+      s.owned[j]=true;
+    }
+    states[w].writeEnd();
+  }
+
+  /// lead robot: advance the control time unless some thread requested a stall
+  double stepCtrlTime(double tau){
+    int s = stall.load(std::memory_order_relaxed);
+    if(s>0) stall.fetch_sub(1, std::memory_order_relaxed);
+    else ctrlTime.store(ctrlTime.load(std::memory_order_relaxed)+tau, std::memory_order_release);
+    return ctrlTime.load(std::memory_order_relaxed);
+  }
+
+  void requestStall(int ticks=2){ stall.store(ticks, std::memory_order_relaxed); }
+
+  /// publish the joints of writer 'w' (q, qDot, tauExternal given in qIndices order) -- never blocks
+  void publishState(uint w, double _ctrlTime, const uintA& qIndices, const double* q, const double* qDot, const double* tauExternal){
+    StateSlot& s = states[w].writeBegin();
+    s.ctrlTime = _ctrlTime;
+    for(uint i=0;i<qIndices.N;i++){
+      uint j=qIndices.elem(i);
+      s.q[j]=q[i];
+      s.qDot[j]=qDot[i];
+      if(tauExternal) s.tauExternalIntegral[j] += tauExternal[i];
+    }
+    s.tauExternalCount++;
+    states[w].writeEnd();
+  }
+
+  /// same, but q and qDot are full-dimensional and only the entries qIndices are published
+  void publishJoints(uint w, double _ctrlTime, const uintA& qIndices, const arr& q, const arr& qDot){
+    StateSlot& s = states[w].writeBegin();
+    s.ctrlTime = _ctrlTime;
+    for(uint i=0;i<qIndices.N;i++){
+      uint j=qIndices.elem(i);
+      s.q[j]=q.elem(j);
+      s.qDot[j]=qDot.elem(j);
+    }
+    s.tauExternalCount++;
+    states[w].writeEnd();
+  }
+
+  /// copy the command into 'msg' if it changed since 'revision' -- allocates only when matrix dimensions change
+  bool pullCmd(rai::CtrlCmdMsg& msg, uint& revision, CmdSlot& buffer){
+    pulling.fetch_add(1, std::memory_order_acq_rel); //announce before looking at the revision (see publishCmd)
+    uint rev = cmd.revision();
+    if(rev==revision){ pulling.fetch_sub(1, std::memory_order_release); return false; }
+    revision = rev;
+    cmd.read(buffer);
+    msg.controlType = buffer.controlType;
+    if(buffer.refIndex>=0) msg.ref = refs[buffer.refIndex]; else msg.ref.reset();
+    pulling.fetch_sub(1, std::memory_order_release);
+    setMatrix(msg.Kp, buffer.Kp, buffer.Kp_d0, buffer.Kp_d1);
+    setMatrix(msg.Kd, buffer.Kd, buffer.Kd_d0, buffer.Kd_d1);
+    setMatrix(msg.P_compliance, buffer.P_compliance, buffer.P_d0, buffer.P_d1);
+    return true;
+  }
+
+  //-- user side
+
+  /// mirror the (Var-based) command message into the channel
+  void publishCmd(const rai::CtrlCmdMsg& msg){
+    std::lock_guard<std::mutex> lock(userMutex);
+    int previous = userCmd.refIndex;
+    userCmd.controlType = msg.controlType;
+    userCmd.refIndex = -1;
+    if(msg.ref){
+      if(previous>=0 && refs[previous]==msg.ref) userCmd.refIndex=previous;
+      else{ //a free slot: released slots are not referenced by any published command a control thread could still read
+        for(uint i=0;i<maxRefs;i++) if(!refs[i]){ userCmd.refIndex=i; break; }
+        CHECK_GE(userCmd.refIndex, 0, "no free reference slot in the CtrlChannel");
+        refs[userCmd.refIndex] = msg.ref;
+      }
+    }
+    getMatrix(userCmd.Kp, userCmd.Kp_d0, userCmd.Kp_d1, msg.Kp);
+    getMatrix(userCmd.Kd, userCmd.Kd_d0, userCmd.Kd_d1, msg.Kd);
+    getMatrix(userCmd.P_compliance, userCmd.P_d0, userCmd.P_d1, msg.P_compliance);
+    cmd.write(userCmd);
+
+    //-- release the previous reference once no control thread can still copy it out of an older command
+    if(previous>=0 && previous!=userCmd.refIndex){
+      //an RMW on 'pulling': either a control thread announced itself before (-> wait), or it sees the new command
+      while(pulling.fetch_add(0, std::memory_order_acq_rel)) std::this_thread::yield();
+      refs[previous].reset(); //control threads hold their own copy while they still use it
+    }
+  }
+
+  /// consistent snapshot merged over all writers; ctrlTime is that of the lead (writer 0)
+  void getState(arr& q, arr& qDot, double& _ctrlTime, uint n){
+    StateSlot s;
+    if(!!q) q.resize(n).setZero();
+    if(!!qDot) qDot.resize(n).setZero();
+    for(uint w=0;w<maxWriters;w++){
+      states[w].read(s);
+      if(!w) _ctrlTime = s.ctrlTime;
+      for(uint j=0;j<n && j<maxDim;j++) if(s.owned[j]){
+        if(!!q) q.elem(j)=s.q[j];
+        if(!!qDot) qDot.elem(j)=s.qDot[j];
+      }
+    }
+  }
+
+  /// average external torque since the last call
+  arr getTauExternal(uint n){
+    std::lock_guard<std::mutex> lock(userMutex);
+    StateSlot s;
+    arr integral = zeros(n);
+    uint count=0;
+    for(uint w=0;w<maxWriters;w++){
+      states[w].read(s);
+      if(!w) count = s.tauExternalCount;
+      for(uint j=0;j<n && j<maxDim;j++) if(s.owned[j]) integral.elem(j) = s.tauExternalIntegral[j];
+    }
+    if(tauLastIntegral.N!=n) tauLastIntegral = zeros(n);
+    arr tau = integral - tauLastIntegral;
+    tau /= double(count - tauLastCount);
+    tauLastIntegral = integral;
+    tauLastCount = count;
+    return tau;
+  }
+
+private:
+  static void setMatrix(arr& X, const double* p, uint d0, uint d1){
+    if(!d0){ X.clear(); return; }
+    if(d1) X.resize(d0, d1); else X.resize(d0);
+    memcpy(X.p, p, X.N*sizeof(double));
+  }
+  static void getMatrix(double* p, uint& d0, uint& d1, const arr& X){
+    CHECK_LE(X.N, maxDim*maxDim, "CtrlChannel::maxDim too small");
+    d0 = X.N ? X.d0 : 0;
+    d1 = X.nd==2 ? X.d1 : 0;
+    if(X.N) memcpy(p, X.p, X.N*sizeof(double));
+  }
+};
+
+} //namespace
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "spscRing.h"
+
+#include <Core/array.h>
+#include <Core/thread.h>
+
+#include <fstream>
+#include <math.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace rai {
+
+//===========================================================================
+//
+// binary control-data log, written asynchronously from a SpscRing
+//
+// file layout (little endian, everything 8-byte aligned -> the file can be memory-mapped):
+//   header:  char magic[8]="RAILOG1", uint64 headerBytes, uint64 recordDim, uint64 nFields,
+//            nFields x { char name[24], uint64 dim }
+//   chunks:  uint64 chunkMagic='CHNK', uint64 nRecords, nRecords x recordDim doubles (row-major)
+// fields are contiguous within a record, in header order; missing values are NaN
+//
+
+static const char dataLog_magic[8] = "RAILOG1";
+static const uint64_t dataLog_chunkMagic = 0x4b4e4843; //'CHNK'
+
+struct DataLogger : Thread {
+  rai::String filename;
+  StringA names;
+  uintA dims;
+  int level=1; //detail level (writeData) the producer fills the fields for
+  SpscRing<double> ring;
+  std::atomic<uint64_t> malformed{0}; //records not committed: more or fewer values than recordDim
+  std::ofstream fil;
+
+  DataLogger(const char* _filename, const StringA& _names, const uintA& _dims, uint ringSize=1<<12)
+    : Thread(STRING("DataLogger_" <<_filename), .01),
+      filename(_filename), names(_names), dims(_dims),
+      ring(sum(_dims), ringSize){
+    CHECK_EQ(names.N, dims.N, "");
+    fil.open(filename, std::ios::binary);
+    CHECK(fil.good(), "could not open '" <<filename <<"'");
+    writeHeader();
+    threadLoop();
+  }
+
+  ~DataLogger(){
+    threadClose();
+    drain();
+    if(ring.dropped) LOG(-1) <<"DataLogger '" <<filename <<"' dropped " <<ring.dropped <<" records (ring full)";
+    if(malformed) LOG(-1) <<"DataLogger '" <<filename <<"' dropped " <<malformed <<" malformed records (not " <<ring.recordDim <<" values)";
+  }
+
+  uint recordDim() const{ return ring.recordDim; }
+
+  /// control thread: fill a record in-place (in field order); it is committed on destruction -- never blocks, never allocates,
+  /// never throws (if the ring is full, the record is silently dropped and counted; a record with fewer or more values than
+  /// recordDim is not committed either, only counted as malformed -- values beyond recordDim are never written)
+  struct Record {
+    DataLogger& log; double* p; uint i=0;
+    Record(DataLogger& _log) : log(_log), p(_log.ring.acquire()) {}
+    Record(const Record&) = delete;
+    ~Record(){
+      if(!p) return;
+      if(i==log.ring.recordDim) log.ring.commit();
+      else log.malformed.fetch_add(1, std::memory_order_relaxed);
+    }
+    Record& operator()(double x){ if(p){ if(i<log.ring.recordDim) p[i]=x; i++; } return *this; }
+    Record& operator()(const double* x, uint n){ for(uint k=0;k<n;k++) operator()(x ? x[k] : NAN); return *this; }
+    Record& operator()(const arr& x, uint n){ return operator()(x.N==n ? x.p : 0, n); }
+  };
+
+  void step(){ drain(); }
+
+private:
+  void writeHeader(){
+    uint64_t headerBytes = 32 + 32*names.N, recordDim=ring.recordDim, nFields=names.N;
+    fil.write(dataLog_magic, 8);
+    fil.write((char*)&headerBytes, 8);
+    fil.write((char*)&recordDim, 8);
+    fil.write((char*)&nFields, 8);
+    for(uint k=0;k<names.N;k++){
+      char name[24];
+      memset(name, 0, 24);
+      strncpy(name, names(k).p, 23);
+      uint64_t dim=dims(k);
+      fil.write(name, 24);
+      fil.write((char*)&dim, 8);
+    }
+    fil.flush();
+  }
+
+  void drain(){
+    for(;;){
+      uint64_t n;
+      const double* p = ring.peek(n);
+      if(!n) break;
+      fil.write((char*)&dataLog_chunkMagic, 8);
+      fil.write((char*)&n, 8);
+      fil.write((char*)p, n*ring.recordDim*sizeof(double));
+      ring.release(n);
+    }
+    fil.flush();
+  }
+};
+
+//===========================================================================
+
+/// hands a DataLogger from the user thread to a control loop: the user side builds (or drops) the logger and swaps it in;
+/// the loop only picks up the current one -- it never opens files, allocates, or joins a logger thread
+struct DataLogHandoff {
+  /// user side: swap in 'log' (null: stop logging); the old logger is closed (drained and joined) here, once the loop let go
+  void set(const std::shared_ptr<DataLogger>& log){
+    std::lock_guard<std::mutex> lock(mutex);
+    publish(log.get());
+    owned = log;
+  }
+  /// user side: stop handing the logger to the loop, but keep it open
+  void pause(){ std::lock_guard<std::mutex> lock(mutex); publish(0); }
+  /// user side: continue the open (paused) logger if it has this level
+  bool resume(int level){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!owned || owned->level!=level) return false;
+    publish(owned.get());
+    return true;
+  }
+
+  /// control loop: the current logger (or null) for the scope of this object -- never blocks
+  struct Use {
+    DataLogHandoff& handoff;
+    DataLogger* log;
+    Use(DataLogHandoff& _handoff) : handoff(_handoff){
+      handoff.busy.fetch_add(1, std::memory_order_acq_rel);
+      log = handoff.current.load(std::memory_order_acquire);
+    }
+    ~Use(){ handoff.busy.fetch_sub(1, std::memory_order_release); }
+  };
+
+private:
+  std::atomic<DataLogger*> current{0};
+  std::atomic<int> busy{0};
+  std::mutex mutex;
+  std::shared_ptr<DataLogger> owned;
+
+  void publish(DataLogger* log){
+    current.store(log, std::memory_order_release);
+    while(busy.fetch_add(0, std::memory_order_acq_rel)) std::this_thread::yield(); //an RMW: a loop either announced itself, or sees 'log'
+  }
+};
+
+/// mixin of control threads that log (found via dynamic_cast by BotOp::setControllerWriteData)
+struct DataLogSource {
+  virtual ~DataLogSource(){}
+  /// build the log for detail level 'level' (<=0: stop logging) on the calling thread and hand it to the control loop
+  virtual void setDataLogLevel(int level) = 0;
+protected:
+  DataLogHandoff dataLog;
+};
+
+//===========================================================================
+
+/// read a DataLogger file: names/dims of the fields, and data as (#records x recordDim) matrix
+inline void readDataLog(const char* filename, StringA& names, uintA& dims, arr& data){
+  std::ifstream fil(filename, std::ios::binary);
+  CHECK(fil.good(), "could not open '" <<filename <<"'");
+  char magic[8];
+  uint64_t headerBytes, recordDim, nFields;
+  fil.read(magic, 8);
+  CHECK(!memcmp(magic, dataLog_magic, 8), "'" <<filename <<"' is not a DataLogger file");
+  fil.read((char*)&headerBytes, 8);
+  fil.read((char*)&recordDim, 8);
+  fil.read((char*)&nFields, 8);
+  names.resize(nFields);
+  dims.resize(nFields);
+  for(uint k=0;k<nFields;k++){
+    char name[25];
+    uint64_t dim;
+    fil.read(name, 24);
+    name[24]=0;
+    fil.read((char*)&dim, 8);
+    names(k)=name;
+    dims(k)=dim;
+  }
+  fil.seekg(headerBytes);
+
+  //-- chunks (an incomplete last chunk, e.g. after a crash, is ignored)
+  data.resize(0);
+  for(;;){
+    uint64_t chunkMagic, n;
+    fil.read((char*)&chunkMagic, 8);
+    fil.read((char*)&n, 8);
+    if(!fil.good()) break;
+    CHECK_EQ(chunkMagic, dataLog_chunkMagic, "corrupt chunk in '" <<filename <<"'");
+    uint N0=data.N;
+    data.resizeCopy(N0+n*recordDim);
+    fil.read((char*)(data.p+N0), n*recordDim*sizeof(double));
+    if(!fil.good()){ data.resizeCopy(N0); break; }
+  }
+  if(recordDim) data.reshape(data.N/recordDim, recordDim);
+}
+
+} //namespace
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define RAI_DEPTH_X86
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define RAI_DEPTH_NEON
+#endif
+
+namespace rai {
+
+//===========================================================================
+//
+// Z16 depth (camera units) -> float metres: depth[i] = float(raw[i])*scale, bit-identical to the scalar loop
+// x86: AVX2 if the CPU has it (dispatched at runtime, no -mavx2 needed), SSE2 otherwise; ARM: NEON
+//
+
+#ifdef RAI_DEPTH_X86
+__attribute__((target("avx2")))
+inline size_t convertZ16_avx2(float* depth, const uint16_t* raw, size_t n, float scale){
+  __m256 s = _mm256_set1_ps(scale);
+  size_t i=0;
+  for(;i+16<=n;i+=16){
+    __m256i x = _mm256_loadu_si256((const __m256i*)(raw+i));
+    __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(x));
+    __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1));
+    _mm256_storeu_ps(depth+i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+    _mm256_storeu_ps(depth+i+8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+  }
+  return i;
+}
+
+inline size_t convertZ16_sse2(float* depth, const uint16_t* raw, size_t n, float scale){
+  __m128 s = _mm_set1_ps(scale);
+  __m128i zero = _mm_setzero_si128();
+  size_t i=0;
+  for(;i+8<=n;i+=8){
+    __m128i x = _mm_loadu_si128((const __m128i*)(raw+i));
+    _mm_storeu_ps(depth+i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, zero)), s));
+    _mm_storeu_ps(depth+i+4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, zero)), s));
+  }
+  return i;
+}
+#endif
+
+#ifdef RAI_DEPTH_NEON
+inline size_t convertZ16_neon(float* depth, const uint16_t* raw, size_t n, float scale){
+  size_t i=0;
+  for(;i+8<=n;i+=8){
+    uint16x8_t x = vld1q_u16(raw+i);
+    vst1q_f32(depth+i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(x))), scale));
+    vst1q_f32(depth+i+4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(x))), scale));
+  }
+  return i;
+}
+#endif
+
+inline void convertZ16ToMeters(float* depth, const uint16_t* raw, size_t n, float scale){
+  size_t i=0;
+#if defined(RAI_DEPTH_X86)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  i = avx2 ? convertZ16_avx2(depth, raw, n, scale) : convertZ16_sse2(depth, raw, n, scale);
+#elif defined(RAI_DEPTH_NEON)
+  i = convertZ16_neon(depth, raw, n, scale);
+#endif
+  for(;i<n;i++) depth[i] = float(raw[i])*scale;
+}
+
+} //namespace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Core/array.h>
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+namespace rai {
+
+//===========================================================================
+
+/// recycles the buffers of shared, immutable frames: the producer acquires a buffer (one nobody else holds any more),
+/// fills it and hands it out as shared_ptr<const Array>; consumers keep it as long as they like -- once all of them
+/// released it, it is reused. Same-sized frames are neither allocated nor copied
+template<class T> struct FramePool {
+  uint maxBuffers;
+  uint overflows=0; ///< acquires that found all buffers in use (got an unpooled buffer)
+
+  FramePool(uint _maxBuffers=8) : maxBuffers(_maxBuffers) {}
+
+  /// producer only: a buffer for the next frame, to be resized and filled before it is shared
+  std::shared_ptr<Array<T>> acquire(){
+    std::lock_guard<std::mutex> lock(mux);
+    for(std::shared_ptr<Array<T>>& b:buffers) if(b.use_count()==1){ //only the pool holds it -- nobody else can get a copy
+      //use_count is a relaxed load: the fence orders the last consumer's reads (before its release decrement) before our writes
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return b;
+    }
+    if(buffers.size()<maxBuffers){
+      buffers.push_back(std::make_shared<Array<T>>());
+      return buffers.back();
+    }
+    overflows++;
+    return std::make_shared<Array<T>>();
+  }
+
+private:
+  std::mutex mux;
+  std::vector<std::shared_ptr<Array<T>>> buffers;
+};
+
+} //namespace
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Core/util.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace rai {
+
+//===========================================================================
+
+/// HDR-style (log-linear) latency histogram over nanoseconds: 32 linear sub-buckets per power of two,
+/// i.e. <3% relative error, covering 1ns..68s in 1024 fixed buckets
+/// single writer (the control thread), any number of concurrent readers -- recording is wait-free
+struct LatencyHistogram {
+  static constexpr uint subBits = 5, subN = 1<<subBits;
+  static constexpr uint64_t maxValue = (uint64_t(1)<<36) - 1;
+  static constexpr uint N = 1024;
+
+  std::atomic<uint64_t> counts[N];
+  std::atomic<uint64_t> count{0}, sum{0}, max{0};
+
+  LatencyHistogram(){ clear(); }
+
+  static uint index(uint64_t v){
+    if(v>maxValue) v=maxValue;
+    uint msb = 63 - __builtin_clzll(v|1);
+    uint e = msb>subBits ? msb-subBits : 0;
+    return e*subN + uint(v>>e);
+  }
+  static uint64_t lowerBound(uint i){
+    if(i<2*subN) return i;
+    uint e = i/subN - 1;
+    return uint64_t(i - e*subN) << e;
+  }
+  static uint64_t upperBound(uint i){ return i+1<N ? lowerBound(i+1)-1 : maxValue; }
+
+  //-- writer
+  void record(uint64_t ns){
+    bump(counts[index(ns)], 1);
+    bump(count, 1);
+    bump(sum, ns);
+    if(ns>max.load(std::memory_order_relaxed)) max.store(ns, std::memory_order_relaxed);
+  }
+  void clear(){
+    for(uint i=0;i<N;i++) counts[i].store(0, std::memory_order_relaxed);
+    count=0; sum=0; max=0;
+  }
+
+  //-- readers
+  /// the value (in ns) below which a fraction p of all recorded values lie (upper bucket bound, clipped by max)
+  uint64_t percentile(double p) const{
+    uint64_t total = count.load(std::memory_order_relaxed);
+    if(!total) return 0;
+    uint64_t target = uint64_t(ceil(p*total));
+    if(target<1) target=1;
+    uint64_t c=0;
+    for(uint i=0;i<N;i++){
+      c += counts[i].load(std::memory_order_relaxed);
+      if(c>=target){
+        uint64_t m = max.load(std::memory_order_relaxed);
+        uint64_t u = upperBound(i);
+        return u<m ? u : m;
+      }
+    }
+    return max.load(std::memory_order_relaxed);
+  }
+  double mean() const{
+    uint64_t n = count.load(std::memory_order_relaxed);
+    return n ? double(sum.load(std::memory_order_relaxed))/n : 0.;
+  }
+
+private:
+  static void bump(std::atomic<uint64_t>& x, uint64_t d){ x.store(x.load(std::memory_order_relaxed)+d, std::memory_order_relaxed); }
+};
+
+//===========================================================================
+
+/// per-control-thread timing: tick interval (jitter), compute time per tick, and reference evaluation time
+/// the control thread calls tickBegin/tickEnd (and refBegin/refEnd around getReference) -- no locks, no allocation
+struct LoopStats {
+  /// summary of one histogram, in seconds
+  struct Summary {
+    uint64_t count=0;
+    double mean=0., p50=0., p90=0., p99=0., p999=0., max=0.;
+    void set(const LatencyHistogram& h){
+      count = h.count.load(std::memory_order_relaxed);
+      mean = 1e-9*h.mean();
+      p50 = 1e-9*h.percentile(.5);
+      p90 = 1e-9*h.percentile(.9);
+      p99 = 1e-9*h.percentile(.99);
+      p999 = 1e-9*h.percentile(.999);
+      max = 1e-9*h.max.load(std::memory_order_relaxed);
+    }
+  };
+
+  /// what BotOp::getLoopStats reports per control thread
+  struct Report {
+    rai::String name;
+    double period=0.;    ///< nominal tick period
+    uint64_t ticks=0;
+    uint64_t overruns=0; ///< ticks whose compute time exceeded the period
+    uint64_t late=0;     ///< ticks started more than 1.5 periods after the previous one
+    uint64_t stalls=0;   ///< ticks that requested a reference stall
+    Summary interval, compute, refEval;
+  };
+
+  rai::String name;
+  double period=0.;
+  LatencyHistogram interval, compute, refEval;
+  std::atomic<uint64_t> ticks{0}, overruns{0}, late{0}, stalls{0};
+  std::atomic<bool> resetRequest{false};
+
+  void init(const char* _name, double _period){ name=_name; period=_period; }
+
+  //-- control thread
+  void tickBegin(){
+    int64_t now = nanos();
+    if(resetRequest.load(std::memory_order_relaxed)){ //the reset is executed by the writer, so it never races with record()
+      interval.clear(); compute.clear(); refEval.clear();
+      ticks=0; overruns=0; late=0; stalls=0;
+      resetRequest.store(false, std::memory_order_relaxed);
+    }
+    if(lastBegin){
+      int64_t dt = now-lastBegin;
+      interval.record(dt);
+      if(period>0. && dt>1.5e9*period) late.fetch_add(1, std::memory_order_relaxed);
+    }
+    lastBegin = tickStart = now;
+  }
+  void tickEnd(){
+    int64_t dt = nanos()-tickStart;
+    compute.record(dt);
+    if(period>0. && dt>1e9*period) overruns.fetch_add(1, std::memory_order_relaxed);
+    ticks.fetch_add(1, std::memory_order_relaxed);
+  }
+  void refBegin(){ refStart = nanos(); }
+  void refEnd(){ refEval.record(nanos()-refStart); }
+  void stall(){ stalls.fetch_add(1, std::memory_order_relaxed); }
+
+  //-- user side
+  Report report(bool reset=false){
+    Report R;
+    R.name = name;
+    R.period = period;
+    R.ticks = ticks.load(std::memory_order_relaxed);
+    R.overruns = overruns.load(std::memory_order_relaxed);
+    R.late = late.load(std::memory_order_relaxed);
+    R.stalls = stalls.load(std::memory_order_relaxed);
+    R.interval.set(interval);
+    R.compute.set(compute);
+    R.refEval.set(refEval);
+    if(reset) resetRequest.store(true, std::memory_order_relaxed);
+    return R;
+  }
+
+private:
+  int64_t lastBegin=0, tickStart=0, refStart=0;
+  static int64_t nanos(){ return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+};
+
+//===========================================================================
+
+/// mixin for control threads that expose LoopStats (BotOp finds them via dynamic_cast)
+struct LoopStatsProvider {
+  LoopStats loopStats;
+  virtual ~LoopStatsProvider(){}
+};
+
+} //namespace
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <Core/array.h>
+
+#include <cmath>
+
+namespace rai {
+
+//===========================================================================
+
+/// full camera intrinsics: pinhole plus lens distortion (model numbers as rs2_distortion)
+struct CameraIntrinsics {
+  enum Distortion { none=0, modifiedBrownConrady=1, inverseBrownConrady=2, ftheta=3, brownConrady=4, kannalaBrandt4=5 };
+  uint width=0, height=0;
+  double fx=0., fy=0., cx=0., cy=0.;
+  int model=none;
+  double coeffs[5]={0., 0., 0., 0., 0.}; ///< k1, k2, p1, p2, k3 (Brown-Conrady) or k1..k4 (Kannala-Brandt)
+
+  CameraIntrinsics(){}
+  /// pinhole intrinsics from fxycxy (as CameraAbstraction::getFxycxy)
+  CameraIntrinsics(const arr& fxycxy, uint _width, uint _height)
+    : width(_width), height(_height), fx(fxycxy(0)), fy(fxycxy(1)), cx(fxycxy(2)), cy(fxycxy(3)) {}
+
+  bool operator==(const CameraIntrinsics& I) const{
+    if(width!=I.width || height!=I.height || fx!=I.fx || fy!=I.fy || cx!=I.cx || cy!=I.cy || model!=I.model) return false;
+    for(uint i=0;i<5;i++) if(coeffs[i]!=I.coeffs[i]) return false;
+    return true;
+  }
+  bool operator!=(const CameraIntrinsics& I) const{ return !(*this==I); }
+
+  /// normalized image coordinates (undistorted, z=1, y down) of pixel (u,v)
+  void undistort(double& x, double& y, double u, double v) const{
+    double xd = (u-cx)/fx, yd = (v-cy)/fy;
+    const double *k = coeffs;
+    x=xd; y=yd;
+    if(model==inverseBrownConrady){ //the coefficients map distorted to undistorted directly (as rs2_deproject_pixel_to_point)
+      double r2 = xd*xd + yd*yd;
+      double f = 1. + k[0]*r2 + k[1]*r2*r2 + k[4]*r2*r2*r2;
+      x = xd*f + 2.*k[2]*xd*yd + k[3]*(r2 + 2.*xd*xd);
+      y = yd*f + 2.*k[3]*xd*yd + k[2]*(r2 + 2.*yd*yd);
+    }else if(model==brownConrady || model==modifiedBrownConrady){ //forward models: invert by fixed-point iteration
+      for(uint i=0;i<20;i++){
+        double r2 = x*x + y*y;
+        double f = 1. + k[0]*r2 + k[1]*r2*r2 + k[4]*r2*r2*r2;
+        double tx = x, ty = y;
+        if(model==modifiedBrownConrady){ tx*=f; ty*=f; } //tangential terms act on the radially distorted point
+        double dx = 2.*k[2]*tx*ty + k[3]*(r2 + 2.*tx*tx);
+        double dy = 2.*k[3]*tx*ty + k[2]*(r2 + 2.*ty*ty);
+        x = (xd-dx)/f;
+        y = (yd-dy)/f;
+      }
+    }else if(model==kannalaBrandt4){ //theta_d = theta (1 + k1 theta^2 + k2 theta^4 + k3 theta^6 + k4 theta^8): solve for theta (Newton)
+      double rd = sqrt(xd*xd + yd*yd);
+      if(rd<1e-12) return;
+      double theta = rd;
+      for(uint i=0;i<20;i++){
+        double t2 = theta*theta;
+        double f = theta*(1. + t2*(k[0] + t2*(k[1] + t2*(k[2] + t2*k[3])))) - rd;
+        double df = 1. + t2*(3.*k[0] + t2*(5.*k[1] + t2*(7.*k[2] + t2*9.*k[3])));
+        theta -= f/df;
+      }
+      double s = tan(theta)/rd;
+      x = xd*s;
+      y = yd*s;
+    }else if(model==ftheta){
+      double rd = sqrt(xd*xd + yd*yd);
+      if(rd<1e-12) return;
+      double s = tan(k[0]*rd)/(2.*tan(k[0]/2.))/rd; //exact inverse of distort
+      x = xd*s;
+      y = yd*s;
+    }
+  }
+
+  /// pixel (u,v) of normalized image coordinates (undistorted, z=1, y down) -- the inverse of undistort
+  void distort(double& u, double& v, double x, double y) const{
+    const double *k = coeffs;
+    double xd=x, yd=y;
+    if(model==brownConrady || model==modifiedBrownConrady){
+      double r2 = x*x + y*y;
+      double f = 1. + k[0]*r2 + k[1]*r2*r2 + k[4]*r2*r2*r2;
+      double tx = x, ty = y;
+      if(model==modifiedBrownConrady){ tx*=f; ty*=f; }
+      xd = x*f + 2.*k[2]*tx*ty + k[3]*(r2 + 2.*tx*tx);
+      yd = y*f + 2.*k[3]*tx*ty + k[2]*(r2 + 2.*ty*ty);
+    }else if(model==inverseBrownConrady){ //the coefficients map distorted to undistorted: invert by fixed-point iteration
+      for(uint i=0;i<20;i++){
+        double r2 = xd*xd + yd*yd;
+        double f = 1. + k[0]*r2 + k[1]*r2*r2 + k[4]*r2*r2*r2;
+        double dx = 2.*k[2]*xd*yd + k[3]*(r2 + 2.*xd*xd);
+        double dy = 2.*k[3]*xd*yd + k[2]*(r2 + 2.*yd*yd);
+        xd = (x-dx)/f;
+        yd = (y-dy)/f;
+      }
+    }else if(model==kannalaBrandt4){
+      double r = sqrt(x*x + y*y);
+      if(r>1e-12){
+        double theta = atan(r), t2 = theta*theta;
+        double s = theta*(1. + t2*(k[0] + t2*(k[1] + t2*(k[2] + t2*k[3]))))/r;
+        xd = x*s;
+        yd = y*s;
+      }
+    }else if(model==ftheta){
+      double r = sqrt(x*x + y*y);
+      if(r>1e-12){
+        double s = atan(2.*r*tan(k[0]/2.))/k[0]/r;
+        xd = x*s;
+        yd = y*s;
+      }
+    }
+    u = xd*fx + cx;
+    v = yd*fy + cy;
+  }
+
+  /// false if undistort/distort are plain pinhole (no model, or all coefficients zero)
+  bool hasDistortion() const{
+    if(model==none) return false;
+    for(uint i=0;i<5;i++) if(coeffs[i]!=0.) return true;
+    return false;
+  }
+};
+
+//===========================================================================
+
+/// per-pixel rays of a camera, scaled to unit depth, in the rai camera convention (looking along -z, y up, as
+/// depthData2pointCloud): a depth image back-projects by a single multiply per pixel. Rebuilt only when the intrinsics change
+struct RayTable {
+  CameraIntrinsics intrinsics;
+  floatA rays; ///< height x width x 3
+
+  /// (re)build the table -- no-op if the intrinsics did not change
+  void set(const CameraIntrinsics& I){
+    if(rays.N && I==intrinsics) return;
+    intrinsics = I;
+    rays.resize(I.height, I.width, 3);
+    float *r = rays.p;
+    for(uint v=0;v<I.height;v++) for(uint u=0;u<I.width;u++, r+=3){
+      double x, y;
+      I.undistort(x, y, u, v);
+      r[0] = x;
+      r[1] = -y;
+      r[2] = -1.f;
+    }
+  }
+
+  /// points (rows x cols x 3, camera frame) of the region roi={u0, v0, u1, v1} (empty: whole image), every stride-th pixel;
+  /// if colors is given (and image has the depth's size), also the aligned colors (rows x cols x 3). Invalid depth gives (0,0,0)
+  void backProject(arr& points, const floatA& depth, const uintA& roi={}, uint stride=1, byteA* colors=0, const byteA& image={}) const{
+    CHECK(depth.nd==2 && depth.d0==intrinsics.height && depth.d1==intrinsics.width,
+          "depth image (" <<depth.d0 <<'x' <<depth.d1 <<") does not match the ray table (" <<intrinsics.height <<'x' <<intrinsics.width <<")");
+    if(!stride) stride=1;
+    uint u0=0, v0=0, u1=depth.d1, v1=depth.d0;
+    if(roi.N){
+      CHECK_EQ(roi.N, 4, "roi needs to be {u0, v0, u1, v1}");
+      u0=roi(0); v0=roi(1);
+      if(roi(2)<u1) u1=roi(2);
+      if(roi(3)<v1) v1=roi(3);
+      CHECK(u0<u1 && v0<v1, "empty roi");
+    }
+    uint rows=(v1-v0+stride-1)/stride, cols=(u1-u0+stride-1)/stride, W=depth.d1;
+    points.resize(rows, cols, 3);
+    double *p = points.p;
+    for(uint v=v0; v<v1; v+=stride){
+      const float *d = depth.p + v*W + u0, *r = rays.p + 3*(v*W + u0);
+      if(stride==1){
+        for(uint i=0; i<cols; i++){ p[3*i] = d[i]*r[3*i]; p[3*i+1] = d[i]*r[3*i+1]; p[3*i+2] = d[i]*r[3*i+2]; }
+      }else{
+        for(uint i=0; i<cols; i++){ const float *ri = r + 3*stride*i; float di = d[stride*i]; p[3*i] = di*ri[0]; p[3*i+1] = di*ri[1]; p[3*i+2] = di*ri[2]; }
+      }
+      p += 3*cols;
+    }
+
+    if(colors){
+      if(!(image.nd==3 && image.d0==depth.d0 && image.d1==depth.d1 && image.d2==3)){ colors->clear(); return; }
+      colors->resize(rows, cols, 3);
+      byte *c = colors->p;
+      for(uint v=v0; v<v1; v+=stride){
+        const byte *im = image.p + 3*(v*W + u0);
+        for(uint i=0; i<cols; i++, c+=3) memcpy(c, im + 3*stride*i, 3);
+      }
+    }
+  }
+};
+
+//===========================================================================
+
+/// mixin for cameras that know their full intrinsics (incl. distortion) of the images they deliver (BotOp finds it via dynamic_cast)
+struct IntrinsicsSource {
+  virtual ~IntrinsicsSource(){}
+  virtual CameraIntrinsics getIntrinsics() = 0;
+};
+
+} //namespace
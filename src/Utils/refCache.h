@@ -0,0 +1,101 @@
+#pragma once
+
+#include "seqlock.h"
+
+#include <Core/array.h>
+#include <Control/CtrlMsgs.h>
+
+namespace rai {
+
+//===========================================================================
+//
+// per-tick cache in front of a time-only reference (e.g. BSplineCtrlReference): with several control threads, the first
+// thread to ask for a ctrlTime evaluates the inner reference and publishes the result; all others copy it without taking
+// a lock. Only correct for references whose output does not depend on q_real/qDot_real (not for ZeroReference).
+//
+
+struct TickCachedReference : ReferenceFeed {
+  static constexpr uint maxDim = 32;
+  static constexpr uint maxSpin = 2000; //~tens of us: waiting for a concurrent evaluation before evaluating ourselves
+
+  struct Entry {
+    double ctrlTime;
+    uint generation;
+    uint n_q, n_qDot, n_qDDot;
+    double q[maxDim], qDot[maxDim], qDDot[maxDim];
+  };
+
+  std::shared_ptr<ReferenceFeed> ref;
+  SeqLock<Entry> cache;
+  std::atomic<double> claimed{-1.};     //the ctrlTime whose evaluation was claimed last
+  std::atomic<uint> generation{0};      //bumped whenever the inner reference changed
+  std::atomic_flag writing = ATOMIC_FLAG_INIT; //guards the single-writer SeqLock
+  std::atomic<uint64_t> hits{0}, evaluations{0};
+
+  TickCachedReference(const std::shared_ptr<ReferenceFeed>& _ref) : ref(_ref) {
+    Entry& e = cache.writeBegin();
+    memset((void*)&e, 0, sizeof(Entry));
+    e.ctrlTime = -1.;
+    cache.writeEnd();
+  }
+
+  /// call after modifying the inner reference (e.g. spline append/overwrite) -- otherwise a stalled ctrlTime would see stale values
+  void invalidate(){
+    generation.fetch_add(1, std::memory_order_release);
+    claimed.store(-1., std::memory_order_release);
+  }
+
+  virtual void getReference(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q_real, const arr& qDot_real, double ctrlTime){
+    uint gen = generation.load(std::memory_order_acquire);
+
+    //-- fast path: this tick was already evaluated by some thread
+    if(tryCached(q_ref, qDot_ref, qDDot_ref, ctrlTime, gen)) return;
+
+    //-- claim the evaluation of this tick -- or wait (bounded) for the thread that claimed it
+    double c = claimed.load(std::memory_order_acquire);
+    if(c!=ctrlTime && claimed.compare_exchange_strong(c, ctrlTime)){
+      evaluate(q_ref, qDot_ref, qDDot_ref, q_real, qDot_real, ctrlTime, gen);
+      return;
+    }
+    for(uint i=0;i<maxSpin;i++){
+      if(tryCached(q_ref, qDot_ref, qDDot_ref, ctrlTime, gen)) return;
+    }
+    evaluate(q_ref, qDot_ref, qDDot_ref, q_real, qDot_real, ctrlTime, gen);
+  }
+
+private:
+  bool tryCached(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, double ctrlTime, uint gen){
+    Entry e;
+    if(!cache.tryRead(e)) return false; //being written right now
+    if(e.ctrlTime!=ctrlTime || e.generation!=gen) return false;
+    copyOut(q_ref, e.q, e.n_q);
+    copyOut(qDot_ref, e.qDot, e.n_qDot);
+    copyOut(qDDot_ref, e.qDDot, e.n_qDDot);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void evaluate(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q_real, const arr& qDot_real, double ctrlTime, uint gen){
+    ref->getReference(q_ref, qDot_ref, qDDot_ref, q_real, qDot_real, ctrlTime);
+    evaluations.fetch_add(1, std::memory_order_relaxed);
+    if(q_ref.N>maxDim || qDot_ref.N>maxDim || qDDot_ref.N>maxDim) return; //too large to cache
+    if(writing.test_and_set(std::memory_order_acquire)) return; //another thread is publishing -- skip, the next caller evaluates
+    Entry& e = cache.writeBegin();
+    e.ctrlTime = ctrlTime;
+    e.generation = gen;
+    e.n_q = q_ref.N; e.n_qDot = qDot_ref.N; e.n_qDDot = qDDot_ref.N;
+    if(q_ref.N) memcpy(e.q, q_ref.p, q_ref.N*sizeof(double));
+    if(qDot_ref.N) memcpy(e.qDot, qDot_ref.p, qDot_ref.N*sizeof(double));
+    if(qDDot_ref.N) memcpy(e.qDDot, qDDot_ref.p, qDDot_ref.N*sizeof(double));
+    cache.writeEnd();
+    writing.clear(std::memory_order_release);
+  }
+
+  static void copyOut(arr& x, const double* p, uint n){
+    if(!n){ x.clear(); return; }
+    if(x.N!=n) x.resize(n); //same size -> no reallocation
+    memcpy(x.p, p, n*sizeof(double));
+  }
+};
+
+} //namespace
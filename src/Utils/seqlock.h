@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace rai {
+
+//===========================================================================
+
+/// single-writer sequence lock around a trivially copyable T
+/// the writer never blocks; readers retry until they copied an untorn version
+template<class T> struct SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+
+  std::atomic<uint32_t> seq{0};
+  T data;
+
+  //-- writer: modify data in-place between writeBegin() and writeEnd(), or use write()
+  T& writeBegin(){
+    seq.store(seq.load(std::memory_order_relaxed)+1, std::memory_order_relaxed); //odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    return data;
+  }
+  void writeEnd(){
+    seq.store(seq.load(std::memory_order_relaxed)+1, std::memory_order_release); //even: consistent
+  }
+  void write(const T& x){ writeBegin(); memcpy((void*)&data, &x, sizeof(T)); writeEnd(); }
+
+  /// the writer may access its own data without synchronization
+  const T& writerData() const{ return data; }
+
+  //-- reader
+  bool tryRead(T& x) const{
+    uint32_t s0 = seq.load(std::memory_order_acquire);
+    if(s0&1) return false;
+    memcpy((void*)&x, (const void*)&data, sizeof(T));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed)==s0;
+  }
+  void read(T& x) const{ while(!tryRead(x)){} }
+
+  uint32_t revision() const{ return seq.load(std::memory_order_acquire)>>1; }
+};
+
+//===========================================================================
+
+/// single-writer double buffer: the writer fills the back slot and flips; readers read the front slot
+/// (each slot is a SeqLock, so a reader that is overtaken by two writes retries instead of reading torn data)
+template<class T> struct DoubleBuffer {
+  SeqLock<T> slot[2];
+  std::atomic<uint32_t> front{0};
+  std::atomic<uint32_t> rev{0};
+
+  void write(const T& x){
+    uint32_t b = 1 - front.load(std::memory_order_relaxed);
+    slot[b].write(x);
+    front.store(b, std::memory_order_release);
+    rev.fetch_add(1, std::memory_order_release);
+  }
+
+  void read(T& x) const{
+    for(;;){
+      uint32_t f = front.load(std::memory_order_acquire);
+      if(slot[f].tryRead(x)) return;
+    }
+  }
+
+  /// number of writes so far -- readers can skip copying if unchanged
+  uint32_t revision() const{ return rev.load(std::memory_order_acquire); }
+};
+
+} //namespace
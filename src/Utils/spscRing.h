@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+namespace rai {
+
+//===========================================================================
+
+/// lock-free single-producer/single-consumer ring of fixed-size records (of recordDim T's each)
+/// the producer never blocks: if the ring is full, acquire() returns 0 and the record is dropped
+template<class T> struct SpscRing {
+  uint recordDim=0;
+  uint64_t capacity=0, mask=0;
+  std::vector<T> buffer;
+  alignas(64) std::atomic<uint64_t> head{0}; //written by producer
+  alignas(64) std::atomic<uint64_t> tail{0}; //written by consumer
+  alignas(64) std::atomic<uint64_t> dropped{0};
+
+  SpscRing(uint _recordDim, uint64_t minCapacity){
+    recordDim=_recordDim;
+    capacity=1;
+    while(capacity<minCapacity) capacity <<= 1;
+    mask=capacity-1;
+    buffer.resize(capacity*recordDim);
+  }
+
+  //-- producer
+  T* acquire(){
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) >= capacity){ dropped.fetch_add(1, std::memory_order_relaxed); return 0; }
+    return &buffer[(h&mask)*recordDim];
+  }
+  void commit(){ head.store(head.load(std::memory_order_relaxed)+1, std::memory_order_release); }
+
+  //-- consumer: contiguous span of available records (may be shorter than size() at the wrap-around)
+  const T* peek(uint64_t& n) const{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    n = head.load(std::memory_order_acquire) - t;
+    uint64_t untilWrap = capacity - (t&mask);
+    if(n>untilWrap) n=untilWrap;
+    return &buffer[(t&mask)*recordDim];
+  }
+  void release(uint64_t n){ tail.store(tail.load(std::memory_order_relaxed)+n, std::memory_order_release); }
+
+  uint64_t size() const{ return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+};
+
+} //namespace
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace rai {
+
+//===========================================================================
+
+/// fixed pool of worker threads for data-parallel loops: run(job) calls job(k) on every worker k=0..numThreads()-1 and
+/// returns when all of them are done (the job splits the work by k, e.g. strided over blocks, rows or tiles). run is
+/// called by one thread at a time; with a single thread, no worker is started and run calls job(0) inline
+struct WorkerPool {
+  WorkerPool(uint nThreads){
+    if(nThreads>1) for(uint k=0;k<nThreads;k++) workers.emplace_back(&WorkerPool::workerLoop, this, k);
+  }
+
+  ~WorkerPool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit=true;
+    }
+    wakeup.notify_all();
+    for(auto& w:workers) w.join();
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  uint numThreads() const{ return workers.size() ? workers.size() : 1; }
+
+  void run(const std::function<void(uint)>& _job){
+    if(workers.empty()){ _job(0); return; }
+    std::unique_lock<std::mutex> lock(mutex);
+    job = &_job; //(outlives the generation: run returns only when all workers are done)
+    pending = workers.size();
+    generation++;
+    wakeup.notify_all();
+    finished.wait(lock, [this]{ return pending==0; });
+    job = 0;
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wakeup, finished;
+  const std::function<void(uint)>* job=0;
+  uint generation=0, pending=0;
+  bool quit=false;
+
+  void workerLoop(uint k){
+    uint seen=0;
+    for(;;){
+      const std::function<void(uint)>* j;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [&]{ return quit || generation!=seen; });
+        if(quit) return;
+        seen = generation;
+        j = job;
+      }
+      (*j)(k);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!--pending) finished.notify_one();
+      }
+    }
+  }
+};
+
+} //namespace
@@ -17,44 +17,43 @@ int testDirect(){
   OpenGL gl, gl2;
 
   {
-    RS.depth.waitForNextRevision();
-    RS.image.waitForNextRevision();
-    Depth2PointCloud cvt2pcl(RS.depth, RS.fxycxy(0), RS.fxycxy(1), RS.fxycxy(2), RS.fxycxy(3));
-    PointCloudViewer pcview(cvt2pcl.points, RS.image);
+    Var<floatA> depth;
+    Var<byteA> image;
+    rai::CameraFrame F;
+    CHECK(RS.waitNext(F, 0, 10.), "no frames from RealSense");
+    depth.set() = *F.depth;
+    image.set() = *F.image;
+    Depth2PointCloud cvt2pcl(depth, RS.fxycxy(0), RS.fxycxy(1), RS.fxycxy(2), RS.fxycxy(3));
+    PointCloudViewer pcview(cvt2pcl.points, image);
 
     cout <<"Camera fxycxy: " <<RS.fxycxy <<endl;
 
-    {
-      auto depthGet = RS.depth.get();
-      gl.resize(depthGet->d1, depthGet->d0);
-    }
-    {
-      auto colorGet = RS.image.get();
-      gl2.resize(colorGet->d1, colorGet->d0);
-    }
+    gl.resize(F.depth->d1, F.depth->d0);
+    gl2.resize(F.image->d1, F.image->d0);
 
     CycleTimer tim;
     for(;;){
-      RS.depth.waitForNextRevision();
+      if(!RS.waitNext(F, F.count)) continue;
+      depth.set() = *F.depth;
+      image.set() = *F.image;
 
       tim.cycleStart();
       int key=0;
       {
-        floatA depth = RS.depth.get();
-        for(float& d:depth) d *= 128.f;
-        key = gl.watchImage(depth, false, 1.);
-      }
-
-      {
-        auto colorGet = RS.image.get();
-        key = gl2.watchImage(colorGet(), false, 1.);
+        floatA d = *F.depth;
+        for(float& x:d) x *= 128.f;
+        key = gl.watchImage(d, false, 1.);
       }
+      key = gl2.watchImage(*F.image, false, 1.);
       tim.cycleDone();
 
       if(key=='q') break;
     }
     cout <<"DISPLAY timer:   " <<tim.report() <<endl;
     cout <<"RealSense timer: " <<RS.timer.report() <<endl;
+    auto S = RS.getFilterStats();
+    cout <<"filters: submitted " <<S.submitted <<" dropped " <<S.dropped <<" published " <<S.published <<endl;
+    for(auto& stage:S.stages) cout <<"  " <<stage.name <<": mean " <<stage.time.mean <<" p99 " <<stage.time.p99 <<" max " <<stage.time.max <<endl;
   }
 
   LOG(0) <<"bye bye";
@@ -35,6 +35,9 @@ int main(int argc, char** argv) {
 
   cout <<"DISPLAY timer:   " <<tim.report() <<endl;
   cout <<"RealSense timer: " <<RS.timer.report() <<endl;
+  auto S = RS.getSyncStats();
+  for(uint i = 0; i < V; i++) cout <<"camera " <<i <<" fps: " <<S.fps[i] <<endl;
+  cout <<"framesets: " <<S.framesets <<" rejected: " <<S.rejected <<" skew mean: " <<S.skew.mean <<" p99: " <<S.skew.p99 <<" max: " <<S.skew.max <<endl;
 
   LOG(0) <<"bye bye";
 
@@ -109,12 +109,13 @@ void tracking2(){
   arr hsvFilter = rai::getParameter<arr>("hsvFilter").reshape(2,3);
 
   // looping
+  rai::CameraFrame F;
   for(uint i=0;i<10000;i++){
-    RS.depth.waitForNextRevision();
+    if(!RS.waitNext(F, F.count)) continue;
 
     // grap copies of rgb and depth
-    cv::Mat rgb = CV(RS.image.get()).clone();
-    cv::Mat depth = CV(RS.depth.get()).clone();
+    cv::Mat rgb = CV(*F.image).clone();
+    cv::Mat depth = CV(*F.depth).clone();
 
     if(rgb.rows != depth.rows) continue;
 
@@ -70,7 +70,9 @@ void test_withoutBotWrapper() {
   }else{
     robot = make_shared<BotThreadedSim>(C);
   }
-  robot->writeData = 2;
+  dynamic_cast<rai::DataLogSource&>(*robot).setDataLogLevel(2);
+  auto sim = std::dynamic_pointer_cast<BotThreadedSim>(robot);
+  auto advance = [&](double dt){ if(sim && sim->lockstep) sim->stepLockstep(dt); else rai::wait(dt); }; //(botsim/lockstep)
 
   //-- create 2 simple reference configurations
   arr q0 = robot->state.get()->q;
@@ -91,7 +93,7 @@ void test_withoutBotWrapper() {
   for(;;){
     if(C.view(false, STRING("time: "<<robot->state.get()->ctrlTime <<" - hit 'q' to append more"))=='q') break;
     C.setJointState(robot->state.get()->q);
-    rai::wait(.1);
+    advance(.1);
   }
 
   //2nd motion:
@@ -102,12 +104,12 @@ void test_withoutBotWrapper() {
   sp->append(~q0, {1.}, ctrlTime);
   sp->report(ctrlTime);
 
-  rai::wait(.1);
+  advance(.1);
   C.get_viewer()->_resetPressedKey();
   for(;;){
     if(C.view(false, STRING("time: "<<robot->state.get()->ctrlTime))=='q') break;
     C.setJointState(robot->state.get()->q);
-    rai::wait(.1);
+    advance(.1);
   }
   //rai::wait();
 }
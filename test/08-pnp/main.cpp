@@ -97,14 +97,15 @@ void testPnp() {
       if(bot.keypressed=='q' || bot.keypressed==27){ l=L; break; }
 
       if(bot.gripperL){
-        if(k==0){ bot.gripperCloseGrasp(rai::_left, boxName); rai::wait(.5); } //while(!bot.gripperDone(rai::_left) ) rai::wait(.1); }
-        if(k==1){ bot.gripperMove(rai::_left); rai::wait(.2); } //while(!bot.gripperDone(rai::_left)) rai::wait(.1); }
+        if(k==0){ bot.gripperCloseGrasp(rai::_left, boxName); bot.wait(C, false, false, true); }
+        if(k==1){ bot.gripperMove(rai::_left); bot.wait(C, false, false, true); }
       }
 
     }
   }
 
-  bot.gripperMove(rai::_left); rai::wait(.5);
+  bot.gripperMove(rai::_left);
+  bot.wait(C, false, false, true);
   bot.home(C);
 }
 
@@ -60,9 +60,9 @@ void rndPoses(){
 
       //write data
       if(writeData){
-        bot.robotL->writeData=2;
+        bot.setControllerWriteData(2);
         rai::wait(.05);
-        bot.robotL->writeData=0;
+        bot.setControllerWriteData(0);
       }
 
       cout <<" === -> executing === " <<endl;
@@ -87,10 +87,10 @@ void collectJointData(){
 
   rai::wait();
 
-  bot.robotL->writeData=2;
+  bot.setControllerWriteData(2);
   bot.move(path, times);
   while(bot.sync(C)){}
-  bot.robotL->writeData=0;
+  bot.setControllerWriteData(0);
 
 
   rai::wait();
@@ -0,0 +1,172 @@
+#include <BotOp/bot.h>
+#include <BotOp/simulation.h>
+#include <Utils/ctrlChannel.h>
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+//===========================================================================
+//
+// contention benchmark: 1kHz control-side exchange (as in FrankaThread) against user threads hammering the state,
+// once with the locked Vars, once with the wait-free CtrlChannel; then the same for BotOp in simulation
+//
+
+void report(const char* name, arr& durations){
+  std::sort(durations.p, durations.p+durations.N);
+  cout <<name <<": ticks=" <<durations.N
+      <<" median=" <<1e6*durations(durations.N/2)
+      <<"us p99=" <<1e6*durations(uint(.99*durations.N))
+      <<"us p99.9=" <<1e6*durations(uint(.999*durations.N))
+      <<"us max=" <<1e6*durations.last() <<"us" <<endl;
+}
+
+//===========================================================================
+
+void test_frankaPattern(bool waitFree){
+  uint n=14, readers = rai::getParameter<uint>("readers", 4);
+  double duration = rai::getParameter<double>("duration", 3.);
+  uintA qIndices = {0, 1, 2, 3, 4, 5, 6};
+
+  Var<rai::CtrlStateMsg> state;
+  Var<rai::CtrlCmdMsg> cmd;
+  state.set()->initZero(n);
+  rai::CtrlChannel channel;
+  rai::CtrlChannel::CmdSlot cmdBuffer;
+  rai::CtrlCmdMsg cmdLocal;
+  uint cmdRevision=-1;
+  channel.initWriter(0, qIndices);
+
+  std::atomic<bool> stop(false);
+  std::atomic<long> reads(0);
+
+  //-- user threads: read the state as fast as possible (like get_q, getState, sync in tight MPC loops)
+  std::vector<std::thread> users;
+  for(uint k=0;k<readers;k++) users.emplace_back([&](){
+    arr q, qDot;
+    double t;
+    while(!stop){
+      if(waitFree) channel.getState(q, qDot, t, n);
+      else { auto stateGet = state.get(); q = stateGet->q; qDot = stateGet->qDot; t = stateGet->ctrlTime; }
+      reads++;
+    }
+  });
+
+  //-- 'control thread': publish state, get cmd, at 1kHz
+  arr durations(uint(duration*1000.));
+  double q[7], qDot[7], tau[7];
+  arr state_q_real(n), state_qDot_real(n);
+  for(uint i=0;i<7;i++) q[i]=qDot[i]=tau[i]=0.;
+  Metronome tic(.001);
+  for(uint s=0;s<durations.N;s++){
+    tic.waitForTic();
+    double t0=rai::realTime();
+    if(waitFree){
+      double ctrlTime = channel.stepCtrlTime(.001);
+      channel.publishState(0, ctrlTime, qIndices, q, qDot, tau);
+      channel.pullCmd(cmdLocal, cmdRevision, cmdBuffer);
+    }else{
+      {
+        auto stateSet = state.set();
+        stateSet->ctrlTime += .001;
+        for(uint i=0;i<7;i++) stateSet->q.elem(qIndices(i)) = q[i];
+        state_q_real = stateSet->q;
+        state_qDot_real = stateSet->qDot;
+      }
+      {
+        auto cmdGet = cmd.get();
+        cmdLocal.controlType = cmdGet->controlType;
+      }
+    }
+    durations(s) = rai::realTime()-t0;
+  }
+  stop=true;
+  for(auto& th:users) th.join();
+
+  report(waitFree?"FrankaThread pattern, wait-free":"FrankaThread pattern, locked Var", durations);
+  cout <<"  user reads/sec: " <<double(reads)/duration <<endl;
+}
+
+//===========================================================================
+
+struct ConstReference : rai::ReferenceFeed {
+  void getReference(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q_real, const arr& qDot_real, double ctrlTime){ q_ref=q_real; }
+};
+
+void test_referenceSwitching(){
+  //many hold()/move() switches: each publishes a fresh reference -- slots must be recycled, old references released
+  uint switches = rai::getParameter<uint>("switches", 10000);
+  rai::CtrlChannel channel;
+  std::atomic<bool> stop(false);
+  std::atomic<long> pulls(0);
+  std::vector<std::thread> controls;
+  for(uint w=0;w<2;w++) controls.emplace_back([&](){
+    rai::CtrlChannel::CmdSlot cmdBuffer;
+    rai::CtrlCmdMsg cmdLocal;
+    uint cmdRevision=-1;
+    while(!stop){ if(channel.pullCmd(cmdLocal, cmdRevision, cmdBuffer)) pulls++; }
+  });
+
+  std::weak_ptr<rai::ReferenceFeed> first;
+  rai::CtrlCmdMsg msg;
+  double t0=rai::realTime();
+  for(uint i=0;i<switches;i++){
+    msg.ref = std::make_shared<ConstReference>();
+    if(!i) first = msg.ref;
+    channel.publishCmd(msg);
+  }
+  double t1=rai::realTime();
+  stop=true;
+  for(auto& th:controls) th.join();
+
+  cout <<"reference switching: " <<switches <<" switches, " <<1e6*(t1-t0)/switches <<"us/switch, pulls=" <<pulls
+      <<", first reference released: " <<first.expired() <<endl;
+  CHECK(first.expired(), "old references are not released");
+}
+
+//===========================================================================
+
+void test_simPattern(){
+  uint readers = rai::getParameter<uint>("readers", 4);
+  double duration = rai::getParameter<double>("duration", 3.);
+
+  rai::Configuration C;
+  C.addFile(rai::raiPath("../rai-robotModels/scenarios/pandaSingle.g"));
+
+  BotOp bot(C, false);
+  bot.home(C);
+
+  std::atomic<bool> stop(false);
+  std::atomic<long> reads(0);
+  std::vector<std::thread> users;
+  for(uint k=0;k<readers;k++) users.emplace_back([&](){
+    arr q, qDot;
+    double t;
+    while(!stop){ bot.getState(q, qDot, t); reads++; }
+  });
+
+  double t0 = bot.get_t(), r0=rai::realTime();
+  rai::wait(duration);
+  double t1 = bot.get_t(), r1=rai::realTime();
+  stop=true;
+  for(auto& th:users) th.join();
+
+  cout <<"BotThreadedSim pattern, " <<(bot.channel?"wait-free":"locked Var")
+      <<": sim ctrlTime/realTime=" <<(t1-t0)/(r1-r0)
+      <<" (hyperSpeed=" <<rai::getParameter<double>("botsim/hyperSpeed") <<")"
+      <<"  user reads/sec: " <<double(reads)/duration <<endl;
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_frankaPattern(false);
+  test_frankaPattern(true);
+  test_referenceSwitching();
+
+  test_simPattern(); //run with -bot/waitFree true/false to compare
+
+  return 0;
+}
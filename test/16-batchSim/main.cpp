@@ -0,0 +1,56 @@
+#include <BotOp/batchSim.h>
+
+//===========================================================================
+//
+// scaling benchmark: instance-steps per second of BatchSim against the number of worker threads
+//
+
+void test_scaling(){
+  rai::Configuration C;
+  C.addFile(rai::raiPath("../rai-robotModels/scenarios/pandaSingle.g"));
+
+  uint N = rai::getParameter<uint>("instances", 64);
+  uint T = rai::getParameter<uint>("steps", 200);
+  uint maxThreads = std::thread::hardware_concurrency();
+  if(!maxThreads) maxThreads=1;
+
+  //-- powers of two below all cores, then all cores
+  uintA threadCounts;
+  for(uint threads=1; threads<maxThreads; threads*=2) threadCounts.append(threads);
+  threadCounts.append(maxThreads);
+
+  arr q0 = C.getJointState();
+  double base=0.;
+  for(uint threads:threadCounts){
+    BatchSim S(C, N, -1., threads);
+    arr q_ref(N, S.dof), qDot_ref(N, S.dof);
+
+    double t0 = rai::realTime();
+    for(uint t=0;t<T;t++){
+      //a slow sine wave, different per instance
+      for(uint i=0;i<N;i++) for(uint j=0;j<S.dof;j++){
+        double phase = .1*i + .5*j;
+        q_ref(i,j) = q0(j) + .1*sin(S.time + phase);
+        qDot_ref(i,j) = .1*cos(S.time + phase);
+      }
+      S.step(q_ref, qDot_ref);
+    }
+    double dt = rai::realTime()-t0;
+
+    double rate = N*T/dt;
+    if(threads==1) base=rate;
+    cout <<"threads=" <<threads <<" instances=" <<N <<" steps=" <<T
+        <<" time=" <<dt <<"s instance-steps/sec=" <<rate <<" speedup=" <<rate/base
+        <<" realtime-factor=" <<N*T*S.tau/dt <<endl;
+  }
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_scaling();
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+#include <Algo/SplineCtrlFeed.h>
+#include <Utils/refCache.h>
+
+#include <thread>
+
+//===========================================================================
+//
+// per-tick reference cost with 1..4 control threads evaluating the same spline (as two arms + bases do in BotOp):
+// every thread evaluates the inner spline directly vs. through the shared TickCachedReference
+//
+
+//all threads enter tick k together -- like control loops driven by the same clock
+struct SpinBarrier {
+  uint n;
+  std::atomic<uint> count{0}, phase{0};
+  SpinBarrier(uint _n) : n(_n) {}
+  void wait(){
+    uint p = phase.load();
+    if(count.fetch_add(1)+1==n){ count=0; phase.fetch_add(1); }
+    else while(phase.load()==p){}
+  }
+};
+
+double run(const std::shared_ptr<rai::ReferenceFeed>& ref, uint threads, uint ticks, uint dof){
+  SpinBarrier barrier(threads);
+  std::vector<double> busy(threads, 0.);
+  std::vector<std::thread> T;
+  for(uint k=0;k<threads;k++) T.emplace_back([&, k](){
+    arr q_ref, qDot_ref, qDDot_ref, q_real=zeros(dof), qDot_real=zeros(dof);
+    for(uint t=0;t<ticks;t++){
+      barrier.wait();
+      double t0 = rai::realTime();
+      ref->getReference(q_ref, qDot_ref, qDDot_ref, q_real, qDot_real, .001*t);
+      busy[k] += rai::realTime()-t0;
+    }
+  });
+  for(auto& t:T) t.join();
+  double sum=0.;
+  for(double b:busy) sum+=b;
+  return sum/(threads*ticks);
+}
+
+void test_refCache(){
+  uint dof = rai::getParameter<uint>("dof", 14);
+  uint ticks = rai::getParameter<uint>("ticks", 20000);
+
+  //-- a spline with a few knots, spanning the whole benchmark duration
+  auto sp = make_shared<rai::BSplineCtrlReference>();
+  arr path = rand(10, dof);
+  arr times = range(0., .001*ticks, 9);
+  times += times(1);
+  sp->append(path, times, 0.);
+
+  for(uint threads=1; threads<=4; threads++){
+    double direct = run(sp, threads, ticks, dof);
+    auto cache = make_shared<rai::TickCachedReference>(sp);
+    double cached = run(cache, threads, ticks, dof);
+    cout <<"threads=" <<threads <<" dof=" <<dof
+        <<" direct=" <<1e6*direct <<"us/tick cached=" <<1e6*cached <<"us/tick"
+        <<" evaluations=" <<cache->evaluations <<" hits=" <<cache->hits <<endl;
+  }
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_refCache();
+
+  return 0;
+}
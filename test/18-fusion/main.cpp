@@ -0,0 +1,127 @@
+#include <Fusion/tsdfFusion.h>
+
+#include <random>
+
+//===========================================================================
+//
+// TSDF fusion of synthetic 640x360 depth images (a table with two spheres, cameras circling at 1m): integration rate,
+// and the distance of the extracted surface points to the true surfaces
+//
+
+struct Sphere { double c[3], r; };
+const Sphere spheres[2] = {{{0., 0., .1}, .1}, {{.25, -.15, .06}, .06}};
+
+//distance of x to the scene surface (table z=0 within |x|,|y|<.8, and the spheres)
+double sceneDistance(const double* x){
+  double dx = std::max(0., fabs(x[0])-.8), dy = std::max(0., fabs(x[1])-.8);
+  double d = sqrt(dx*dx + dy*dy + x[2]*x[2]);
+  for(const Sphere& s:spheres){
+    double e = sqrt((x[0]-s.c[0])*(x[0]-s.c[0]) + (x[1]-s.c[1])*(x[1]-s.c[1]) + (x[2]-s.c[2])*(x[2]-s.c[2])) - s.r;
+    d = std::min(d, fabs(e));
+  }
+  return d;
+}
+
+//camera at angle phi on a circle, looking at the table center (camera convention: looking along -z, y up)
+rai::Transformation cameraPose(double phi){
+  double p[3] = {cos(phi), sin(phi), .8};
+  double f[3] = {-p[0], -p[1], .1-p[2]};
+  double n = sqrt(f[0]*f[0]+f[1]*f[1]+f[2]*f[2]);
+  for(double& x:f) x/=n;
+  double x[3] = {f[1], -f[0], 0.}; //f x up
+  n = sqrt(x[0]*x[0]+x[1]*x[1]);
+  x[0]/=n; x[1]/=n;
+  double z[3] = {-f[0], -f[1], -f[2]};
+  double y[3] = {z[1]*x[2]-z[2]*x[1], z[2]*x[0]-z[0]*x[2], z[0]*x[1]-z[1]*x[0]};
+  double R[9] = {x[0], y[0], z[0], x[1], y[1], z[1], x[2], y[2], z[2]};
+  rai::Transformation X;
+  X.pos.x = p[0]; X.pos.y = p[1]; X.pos.z = p[2];
+  X.rot.setMatrix(R);
+  return X;
+}
+
+//ray-cast depth image (camera-frame depth, 0: no hit) with gaussian noise
+void renderDepth(floatA& depth, const rai::Transformation& X, const arr& fxycxy, uint W, uint H, double noise, std::mt19937& rnd){
+  std::normal_distribution<double> gauss(0., noise);
+  double R[9], t[3] = {X.pos.x, X.pos.y, X.pos.z};
+  X.rot.getMatrix(R);
+  depth.resize(H, W);
+  for(uint v=0;v<H;v++) for(uint u=0;u<W;u++){
+    double rc[3] = {(u-fxycxy(2))/fxycxy(0), -(v-fxycxy(3))/fxycxy(1), -1.};
+    double r[3];
+    for(uint i=0;i<3;i++) r[i] = R[3*i]*rc[0] + R[3*i+1]*rc[1] + R[3*i+2]*rc[2];
+    double s = 1e10;
+    if(r[2]<0.){
+      double st = -t[2]/r[2];
+      if(fabs(t[0]+st*r[0])<.8 && fabs(t[1]+st*r[1])<.8) s = st;
+    }
+    for(const Sphere& sp:spheres){
+      double o[3] = {t[0]-sp.c[0], t[1]-sp.c[1], t[2]-sp.c[2]};
+      double a = r[0]*r[0]+r[1]*r[1]+r[2]*r[2], b = 2.*(o[0]*r[0]+o[1]*r[1]+o[2]*r[2]), c = o[0]*o[0]+o[1]*o[1]+o[2]*o[2]-sp.r*sp.r;
+      double disc = b*b-4.*a*c;
+      if(disc<0.) continue;
+      double st = (-b-sqrt(disc))/(2.*a);
+      if(st>0. && st<s) s = st;
+    }
+    depth(v, u) = s<1e9 ? s + gauss(rnd) : 0.;
+  }
+}
+
+void test_fusion(){
+  uint frames = rai::getParameter<int>("frames", 300);
+  uint cameras = rai::getParameter<int>("cameras", 2);
+  double noise = rai::getParameter<double>("noise", .002);
+  const uint W=640, H=360;
+  arr fxycxy = {460., 460., 320., 180.};
+
+  //-- pre-render the depth images (not part of the timing)
+  std::mt19937 rnd(0);
+  std::vector<floatA> depths(frames);
+  std::vector<rai::Transformation> poses(frames);
+  for(uint k=0;k<frames;k++){
+    uint cam = k%cameras;
+    poses[k] = cameraPose(2.*RAI_PI*cam/cameras + .002*k);
+    renderDepth(depths[k], poses[k], fxycxy, W, H, noise, rnd);
+  }
+
+  TSDFFusion fusion;
+  double alloc=0., integrate=0., worst=0.;
+  double t0 = rai::realTime();
+  for(uint k=0;k<frames;k++){
+    fusion.integrate(depths[k], {}, fxycxy, poses[k]);
+    alloc += fusion.allocTime;
+    integrate += fusion.integrateTime;
+    worst = std::max(worst, fusion.allocTime+fusion.integrateTime);
+  }
+  double total = rai::realTime()-t0;
+  cout <<"threads=" <<fusion.numThreads() <<" frames=" <<frames <<" (" <<W <<'x' <<H <<", " <<cameras <<" cameras)"
+      <<" rate=" <<frames/total <<"Hz alloc=" <<1e3*alloc/frames <<"ms integrate=" <<1e3*integrate/frames <<"ms worst=" <<1e3*worst <<"ms"
+      <<" blocks=" <<fusion.numBlocks() <<" (last frame: " <<fusion.lastBlocks <<")" <<endl;
+
+  //-- surface accuracy
+  arr points;
+  byteA colors;
+  fusion.getPointCloud(points, colors, 5.f);
+  double err=0., errMax=0.;
+  for(uint i=0;i<points.d0;i++){
+    double d = sceneDistance(points.p+3*i);
+    err += d;
+    errMax = std::max(errMax, d);
+  }
+  cout <<"surface points=" <<points.d0 <<" mean error=" <<1e3*err/points.d0 <<"mm max error=" <<1e3*errMax <<"mm" <<endl;
+
+  //-- occupancy for collision checks
+  rai::Configuration C;
+  fusion.exportOccupancy(C, "fusedOccupancy", .02, 5.f);
+  cout <<"occupancy boxes=" <<C.getFrame("fusedOccupancy")->children.N <<endl;
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_fusion();
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include <RealSense/depthAlign.h>
+
+#ifdef RAI_REALSENSE
+#include <librealsense2/rs.hpp>
+#include <librealsense2/hpp/rs_internal.hpp>
+#endif
+
+//===========================================================================
+//
+// depth -> color alignment of synthetic frames (a tilted wall with a box in front, D435-like 15mm baseline):
+// the lookup-table DepthAligner against a per-pixel reference (deproject, transform, project -- what rs2::align
+// computes per frame), and against rs2::align itself (software device) when built with RealSense
+//
+
+struct Setup {
+  uint W, H;
+  rai::CameraIntrinsics depth, color;
+  float R[9], t[3];
+  float depthScale=.001f;
+  uint16A depthImage; //Z16
+  byteA colorImage;
+
+  Setup(uint _W, uint _H) : W(_W), H(_H){
+    double f = .9*W; //~70deg horizontal field of view
+    depth = rai::CameraIntrinsics(arr{f, f, .5*W-.3, .5*H+.7}, W, H);
+    depth.model = rai::CameraIntrinsics::brownConrady;
+    color = rai::CameraIntrinsics(arr{1.02*f, 1.02*f, .5*W+2.1, .5*H-1.4}, W, H);
+    color.model = rai::CameraIntrinsics::inverseBrownConrady;
+    double k[5] = {-.05, .06, .0005, -.0003, -.02};
+    for(uint i=0;i<5;i++) color.coeffs[i] = k[i];
+    //small rotation about y (column-major, as rs2_extrinsics), 15mm baseline
+    double a=.01;
+    float Rc[9] = {float(cos(a)), 0.f, float(-sin(a)),  0.f, 1.f, 0.f,  float(sin(a)), 0.f, float(cos(a))};
+    memcpy(R, Rc, sizeof(R));
+    t[0]=.015f; t[1]=.0002f; t[2]=.0004f;
+
+    //-- depth: wall at 1.2m (tilted), a box at .6m in the center
+    depthImage.resize(H, W);
+    for(uint v=0;v<H;v++) for(uint u=0;u<W;u++){
+      double x, y;
+      depth.undistort(x, y, u, v);
+      double z = 1.2/(1.+.3*x);
+      if(fabs(x)<.15 && fabs(y)<.12) z = .6;
+      if(u%97==13 && v%53==7) z = 0.; //some holes
+      depthImage(v, u) = uint16_t(z/depthScale + .5);
+    }
+    colorImage.resize(H, W, 3);
+    for(uint i=0;i<colorImage.N;i++) colorImage.p[i] = (i*7)%251;
+  }
+};
+
+//-- the per-pixel computation (as rs2::align): deproject both pixel corners, transform, project, fill the rectangle
+void referenceDepthToColor(uint16_t* out, const Setup& S){
+  memset(out, 0, S.W*S.H*sizeof(uint16_t));
+  for(uint v=0;v<S.H;v++) for(uint u=0;u<S.W;u++){
+    uint16_t d = S.depthImage(v, u);
+    if(!d) continue;
+    double z = S.depthScale*d;
+    int px[2], py[2];
+    for(uint c=0;c<2;c++){
+      double x, y;
+      S.depth.undistort(x, y, u+c-.5, v+c-.5);
+      double p[3];
+      for(uint i=0;i<3;i++) p[i] = S.R[i]*z*x + S.R[3+i]*z*y + S.R[6+i]*z + S.t[i];
+      double cu, cv;
+      S.color.distort(cu, cv, p[0]/p[2], p[1]/p[2]);
+      px[c] = int(floor(cu+.5));
+      py[c] = int(floor(cv+.5));
+    }
+    if(px[0]<0 || py[0]<0 || px[1]>=int(S.W) || py[1]>=int(S.H)) continue;
+    for(int y=py[0]; y<=py[1]; y++) for(int x=px[0]; x<=px[1]; x++){
+      uint16_t& o = out[y*S.W+x];
+      if(!o || d<o) o = d;
+    }
+  }
+}
+
+void compare(const char* name, const uint16A& A, const uint16A& B, float depthScale){
+  uint both=0, onlyA=0, onlyB=0, off=0;
+  double err=0.;
+  for(uint i=0;i<A.N;i++){
+    if(A.p[i] && B.p[i]){
+      both++;
+      double e = depthScale*fabs(double(A.p[i])-double(B.p[i]));
+      err += e;
+      if(e>.005) off++;
+    }else if(A.p[i]) onlyA++;
+    else if(B.p[i]) onlyB++;
+  }
+  cout <<"  vs " <<name <<": pixels both=" <<both <<" only LUT=" <<onlyA <<" only " <<name <<'=' <<onlyB
+       <<" mean |diff|=" <<1e3*err/both <<"mm (>5mm: " <<off <<')' <<endl;
+}
+
+void test_align(uint W, uint H){
+  uint frames = rai::getParameter<int>("frames", 20);
+  Setup S(W, H);
+  cout <<"== " <<W <<'x' <<H <<endl;
+
+  uint16A reference(H, W), lut(H, W);
+  double t0 = rai::realTime();
+  for(uint k=0;k<frames;k++) referenceDepthToColor(reference.p, S);
+  cout <<"  per-pixel reference: " <<1e3*(rai::realTime()-t0)/frames <<"ms/frame" <<endl;
+
+  for(uint threads:{1u, (uint)rai::getParameter<int>("RealSense/alignThreads", 2)}){
+    rai::realsense::DepthAligner aligner(threads);
+    t0 = rai::realTime();
+    aligner.set(S.depth, S.color, S.R, S.t, S.depthScale);
+    aligner.depthToColor(lut.p, S.depthImage.p); //includes building the tables
+    double first = rai::realTime()-t0;
+    t0 = rai::realTime();
+    for(uint k=0;k<frames;k++) aligner.depthToColor(lut.p, S.depthImage.p);
+    double depthToColor = (rai::realTime()-t0)/frames;
+    byteA colorAligned(H, W, 3);
+    t0 = rai::realTime();
+    for(uint k=0;k<frames;k++) aligner.colorToDepth(colorAligned.p, S.colorImage.p, S.depthImage.p);
+    double colorToDepth = (rai::realTime()-t0)/frames;
+    cout <<"  LUT, threads=" <<aligner.numThreads() <<": depthToColor " <<1e3*depthToColor <<"ms/frame (first, with tables: "
+         <<1e3*first <<"ms)  colorToDepth " <<1e3*colorToDepth <<"ms/frame" <<endl;
+  }
+  compare("reference", lut, reference, S.depthScale);
+
+#ifdef RAI_REALSENSE
+  //-- rs2::align on the same frames, fed through a software device
+  rs2::software_device dev;
+  rs2::software_sensor depthSensor = dev.add_sensor("Depth");
+  rs2::software_sensor colorSensor = dev.add_sensor("Color");
+  auto toRs2 = [](const rai::CameraIntrinsics& I){
+    rs2_intrinsics in;
+    in.width = I.width;  in.height = I.height;
+    in.fx = I.fx;  in.fy = I.fy;  in.ppx = I.cx;  in.ppy = I.cy;
+    in.model = rs2_distortion(I.model);
+    for(uint i=0;i<5;i++) in.coeffs[i] = I.coeffs[i];
+    return in;
+  };
+  rs2::stream_profile depthProfile = depthSensor.add_video_stream({RS2_STREAM_DEPTH, 0, 0, int(W), int(H), 30, 2, RS2_FORMAT_Z16, toRs2(S.depth)});
+  rs2::stream_profile colorProfile = colorSensor.add_video_stream({RS2_STREAM_COLOR, 0, 1, int(W), int(H), 30, 3, RS2_FORMAT_RGB8, toRs2(S.color)});
+  depthSensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, S.depthScale);
+  rs2_extrinsics X;
+  memcpy(X.rotation, S.R, sizeof(S.R));
+  memcpy(X.translation, S.t, sizeof(S.t));
+  depthProfile.register_extrinsics_to(colorProfile, X);
+  dev.create_matcher(RS2_MATCHER_DEFAULT);
+  rs2::syncer sync;
+  depthSensor.open(depthProfile);
+  colorSensor.open(colorProfile);
+  depthSensor.start(sync);
+  colorSensor.start(sync);
+  depthSensor.on_video_frame({S.depthImage.p, [](void*){}, int(2*W), 2, 0., RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK, 1, depthProfile.get()});
+  colorSensor.on_video_frame({S.colorImage.p, [](void*){}, int(3*W), 3, 0., RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK, 1, colorProfile.get()});
+  rs2::frameset fs = sync.wait_for_frames();
+
+  rs2::align align(RS2_STREAM_COLOR);
+  rs2::frameset aligned;
+  t0 = rai::realTime();
+  for(uint k=0;k<frames;k++) aligned = align.process(fs);
+  cout <<"  rs2::align: " <<1e3*(rai::realTime()-t0)/frames <<"ms/frame" <<endl;
+  uint16A rs2Aligned(H, W);
+  memcpy(rs2Aligned.p, aligned.get_depth_frame().get_data(), rs2Aligned.N*sizeof(uint16_t));
+  compare("rs2::align", lut, rs2Aligned, S.depthScale);
+  depthSensor.stop();  colorSensor.stop();
+  depthSensor.close();  colorSensor.close();
+#endif
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_align(640, 480);
+  test_align(1280, 720);
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <BotOp/rayCast.h>
+#include <Kin/kin.h>
+#include <Kin/frame.h>
+
+//===========================================================================
+//
+// headless depth + segmentation + color of the panda table scene with some objects, 640x360, by the CPU ray caster:
+// frame rate against the number of threads (target: 30Hz), while the robot moves between frames
+//
+
+//camera at p looking at target (camera convention: looking along -z, y up), as pose (position, quaternion wxyz)
+arr lookAt(const arr& p, const arr& target){
+  arr z = p-target;
+  z /= length(z);
+  arr x = crossProduct(arr{0., 0., 1.}, z);
+  x /= length(x);
+  arr y = crossProduct(z, x);
+  double R[9] = {x(0), y(0), z(0), x(1), y(1), z(1), x(2), y(2), z(2)};
+  rai::Transformation X;
+  X.pos.x = p(0); X.pos.y = p(1); X.pos.z = p(2);
+  X.rot.setMatrix(R);
+  return arr{X.pos.x, X.pos.y, X.pos.z, X.rot.w, X.rot.x, X.rot.y, X.rot.z};
+}
+
+void test_rayCast(){
+  rai::Configuration C;
+  C.addFile(rai::raiPath("../rai-robotModels/scenarios/pandaSingle.g"));
+  arr center = C["table"]->getPosition();
+  uint nObjects = rai::getParameter<uint>("objects", 8);
+  for(uint i=0;i<nObjects;i++){
+    rai::Frame *f = C.addFrame(STRING("obj" <<i), "table");
+    if(i%2) f->setShape(rai::ST_ssBox, {.06, .08, .1, .005});
+    else f->setShape(rai::ST_sphere, {.04});
+    f->setRelativePosition({-.3+.6*i/nObjects, .2*((i%3)-1.), .1});
+    f->setColor({.2+.1*i, .8-.1*i, .5});
+  }
+
+  uint frames = rai::getParameter<uint>("frames", 50);
+  rai::RayCastRenderer::Camera cam;
+  cam.I = rai::CameraIntrinsics(arr{.895*360., .895*360., 319.5, 179.5}, 640, 360);
+  arr pose = lookAt(center+arr{.9, -.6, .7}, center+arr{0., 0., .2});
+  arr q0 = C.getJointState();
+
+  uint maxThreads = std::thread::hardware_concurrency();
+  for(uint threads=1; ; threads=std::min(2*threads, maxThreads)){
+    rai::RayCastRenderer R(threads);
+    R.setScene(C);
+    floatA depth;
+    uintA seg;
+    byteA image;
+    double t=0.;
+    for(uint k=0;k<frames;k++){
+      C.setJointState(q0 + .3*sin(.1*k));
+      R.setFrameState(C.getFrameState());
+      double t0 = rai::realTime();
+      R.render(depth, cam, pose.p, &seg, &image);
+      t += rai::realTime()-t0;
+    }
+    t /= frames;
+    uint hits=0;
+    for(uint i=0;i<depth.N;i++) if(depth.p[i]>0.f) hits++;
+    cout <<"threads=" <<R.numThreads() <<" triangles=" <<R.numTriangles() <<": " <<1e3*t <<"ms/frame (" <<1./t <<"Hz)  hit pixels="
+         <<hits <<'/' <<depth.N <<endl;
+    if(threads>=maxThreads) break;
+  }
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_rayCast();
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <BotOp/simulation.h>
+
+//===========================================================================
+//
+// speed of one BotThreadedSim instance (lockstep, no metronome) on the pandaSingle scenario with a moving reference:
+// simulated seconds per wall-clock second for each engine, and the tracking error -- the fast kinematic engine should
+// run at more than 100x real time
+//
+// what-if rollouts from a running simulation: cost of snapshot/restore and of fork -- the first fork builds a pool
+// instance, later ones only restore -- and whether rollouts from the same state agree, also after a rollout in between
+// that opened the gripper (which the restore must undo)
+//
+
+//all joints on slow sines about q0
+struct SineReference : rai::ReferenceFeed {
+  arr q0;
+  double amplitude;
+  SineReference(const arr& _q0, double _amplitude=.2) : q0(_q0), amplitude(_amplitude) {}
+  virtual void getReference(arr& q_ref, arr& qDot_ref, arr& qDDot_ref, const arr& q_real, const arr& qDot_real, double ctrlTime){
+    q_ref.resize(q0.N);
+    qDot_ref.resize(q0.N);
+    qDDot_ref.resize(q0.N).setZero();
+    for(uint i=0;i<q0.N;i++){
+      q_ref(i) = q0(i) + amplitude*sin(.5*ctrlTime + i);
+      qDot_ref(i) = .5*amplitude*cos(.5*ctrlTime + i);
+    }
+  }
+};
+
+void test_engines(){
+  rai::Configuration C;
+  C.addFile(rai::raiPath("../rai-robotModels/scenarios/pandaSingle.g"));
+  arr q0 = C.getJointState();
+  StringA engines = rai::getParameter<StringA>("engines", {"physx", "fastKinematic"});
+  double duration = rai::getParameter<double>("duration", 20.);
+
+  for(const rai::String& engine:engines){
+    rai::setParameter<rai::String>("botsim/engine", engine);
+    Var<rai::CtrlCmdMsg> cmd;
+    Var<rai::CtrlStateMsg> state;
+    auto ref = make_shared<SineReference>(q0);
+    cmd.set()->ref = ref;
+    double t0 = rai::realTime();
+    BotThreadedSim sim(C, cmd, state);
+    double setup = rai::realTime()-t0;
+
+    t0 = rai::realTime();
+    uint steps = sim.stepLockstep(duration);
+    double wall = rai::realTime()-t0;
+
+    arr q_ref, qDot_ref, qDDot_ref;
+    auto stateGet = state.get();
+    //the state published at ctrlTime is the result of the previous step's reference
+    ref->getReference(q_ref, qDot_ref, qDDot_ref, stateGet->q, stateGet->qDot, stateGet->ctrlTime-sim.getTau());
+    cout <<engine <<": " <<steps <<" steps in " <<wall <<"s = " <<1e6*wall/steps <<"us/step, " <<duration/wall
+         <<"x real time (setup " <<setup <<"s)  |q - q_ref|=" <<length(stateGet->q - q_ref) <<endl;
+  }
+}
+
+//===========================================================================
+
+void test_fork(){
+  rai::Configuration C;
+  C.addFile(rai::raiPath("../rai-robotModels/scenarios/pandaSingle.g"));
+  arr q0 = C.getJointState();
+  StringA engines = rai::getParameter<StringA>("forkEngines", {"physx", "fastKinematic"});
+  uint forks = rai::getParameter<uint>("forks", 8);
+  double rollout = rai::getParameter<double>("rollout", 1.);
+
+  for(const rai::String& engine:engines){
+    rai::setParameter<rai::String>("botsim/engine", engine);
+    Var<rai::CtrlCmdMsg> cmd;
+    Var<rai::CtrlStateMsg> state;
+    cmd.set()->ref = make_shared<SineReference>(q0, .2);
+    BotThreadedSim sim(C, cmd, state);
+    sim.stepLockstep(1.);
+
+    //-- snapshot/restore on the live simulation
+    double t0 = rai::realTime();
+    auto S = sim.snapshot();
+    double tSnapshot = rai::realTime()-t0;
+    sim.stepLockstep(rollout);
+    t0 = rai::realTime();
+    sim.restore(*S);
+    double tRestore = rai::realTime()-t0;
+
+    //-- forks: each candidate a different amplitude, rolled out three times -- the second also opens the gripper
+    double tFirst=0., tFork=0., maxDiff=0.;
+    for(uint k=0;k<forks;k++){
+      arr X[3];
+      for(uint r=0;r<3;r++){
+        t0 = rai::realTime();
+        std::shared_ptr<BotThreadedSim> F = sim.fork();
+        double t = rai::realTime()-t0;
+        if(!k && !r) tFirst=t; else tFork+=t;
+        F->cmd.set()->ref = make_shared<SineReference>(q0, .1+.05*k);
+        if(r==1) GripperSim(F, "l_gripper").open();
+        F->stepLockstep(rollout);
+        X[r] = F->snapshot()->X;
+      }
+      maxDiff = std::max(maxDiff, length(X[0]-X[2]));
+    }
+    cout <<engine <<": snapshot " <<1e3*tSnapshot <<"ms, restore " <<1e3*tRestore <<"ms, first fork (builds) " <<1e3*tFirst
+         <<"ms, fork " <<1e3*tFork/(3*forks-1) <<"ms; rollouts from one state differ by " <<maxDiff <<endl;
+  }
+}
+
+//===========================================================================
+
+int main(int argc, char * argv[]){
+  rai::initCmdLine(argc, argv);
+
+  test_engines();
+  test_fork();
+
+  return 0;
+}
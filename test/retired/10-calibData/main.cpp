@@ -88,7 +88,7 @@ void driveToPoses(rai::Configuration& C, const arr& X, const uint kStart=0) {
   if(Kend>Kmax) Kend=Kmax;
 
   BotOp bot(C, rai::getParameter<bool>("real", false));
-  bot.robotL->writeData=0;
+  bot.setControllerWriteData(0);
 
   bot.home(C);
 
@@ -101,9 +101,9 @@ void driveToPoses(rai::Configuration& C, const arr& X, const uint kStart=0) {
 //    bot.moveTo(X[k], 3.);
     while(bot.sync(C));
     if(bot.keypressed=='q') break;
-    bot.robotL->writeData=2;
+    bot.setControllerWriteData(2);
     rai::wait(.1);
-    bot.robotL->writeData=0;
+    bot.setControllerWriteData(0);
   }
 
 }